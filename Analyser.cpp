@@ -5,264 +5,473 @@
 #include "Analyser.h"
 #include "SymbolTable.h"
 #include "Exception.h"
+#include "TreeVisitor.h"
+#include "WorkStealing.h"
 
 namespace Compiler::Analyser {
-    uintptr_t global_address = 0; // 用于分配内存地址
+    void report_analysis_error(const string_t &expr_name, int lineNumber) {
+        using namespace Compiler::Exception;
+        ExceptionHandle::getHandle().add_exception(ExceptionType::ANALYSIS_ERROR,
+                                                   expr_name + " check type error on line " +
+                                                   std::to_string(lineNumber));
+    }
+
+    // 先缓存起来的类型错误: (表达式名称, 行号)
+    using TypeErrors = std::vector<std::pair<const char *, int>>;
+
+    void report_type_errors(const TypeErrors &errors) {
+        for (auto &[name, lineNumber]:errors) {
+            report_analysis_error(name, lineNumber);
+        }
+    }
+
+    // 声明或者赋值时, value 类型的表达式能否赋给 target 类型的变量(规则见 TypeSystem.h 的 assignableTypes)
+    bool assignable(Type target, Type value) {
+        return assignableTypes[(size_t) target][(size_t) value];
+    }
+
+    Type constant_type(ExpKind kind) {
+        switch (kind) {
+            case ExpKind::ConstIntK:
+                return Type::Integer;
+            case ExpKind::ConstBoolK:
+                return Type::Boolean;
+            case ExpKind::ConstFloatK:
+                return Type::Float;
+            case ExpKind::ConstDoubleK:
+                return Type::Double;
+            case ExpKind::ConstStringK:
+                return Type::String;
+            default:
+                return Type::Void;
+        }
+    }
 
     /**
-     * 遍历AST.
-     * pre_proc: 先序处理节点的函数
-     * post_proc: 后序处理节点的函数
+     * 运算表达式的类型(查 TypeSystem.h 的 resultTypes). 操作数类型不对时返回 Void(空类型,作为类型错误标志).
+     * 单目运算 NOT 不使用 t2.
      */
-    void traverse_parser_tree(const TreeNode::ptr &n,
-                              const std::function<void(TreeNode::ptr)> &pre_proc,
-                              const std::function<void(TreeNode::ptr)> &post_proc) {
-        if (n != nullptr) {
-            pre_proc(n);
-            for (const auto &child:n->children) {
-                traverse_parser_tree(child, pre_proc, post_proc);
-            }
-            post_proc(n);
-            traverse_parser_tree(n->sibling, pre_proc, post_proc);
+    Type operator_type(TokenType op, Type t1, Type t2) {
+        return resultTypes[(size_t) operatorClass(op)][(size_t) t1][(size_t) t2];
+    }
+
+    // operator_type 返回 Void 时报告的表达式名称, 不认识的运算符不报告
+    const char *operator_expression_name(TokenType op) {
+        switch (operatorClass(op)) {
+            case OperatorClass::Not:
+                return "logical-not expression";
+            case OperatorClass::Arithmetic:
+                return "arithmetic expression";
+            case OperatorClass::Logical:
+                return "logical-and-or expression";
+            case OperatorClass::Comparison:
+                return "comparison expression";
+            default:
+                return nullptr;
         }
     }
 
-    void pre_traverse_parser_tree(const TreeNode::ptr &n,
-                                  const std::function<void(TreeNode::ptr)> &pre_proc) {
-        traverse_parser_tree(n, pre_proc, [](TreeNode::ptr) { return; });
+    void check_operator(TokenType op, Type t1, Type t2, Type &result, int lineNumber, TypeErrors &errors) {
+        result = operator_type(op, t1, t2);
+        auto name = operator_expression_name(op);
+        if (result == Type::Void && name != nullptr) {
+            errors.emplace_back(name, lineNumber);
+        }
     }
 
-    void post_traverse_parser_tree(const TreeNode::ptr &n,
-                                   const std::function<void(TreeNode::ptr)> &post_proc) {
-        traverse_parser_tree(n, [](TreeNode::ptr) { return; }, post_proc);
+    // kind 语句在第 child 个子节点之前是否进入一层块作用域: if 的 then/else 部分, repeat/do 的循环体
+    bool opens_scope(StmtKind kind, size_t child) {
+        switch (kind) {
+            case StmtKind::IfK:
+                return child >= 1;
+            case StmtKind::RepeatK:
+            case StmtKind::WhileK:
+                return child == 0;
+            default:
+                return false;
+        }
     }
 
-    void build_symbol_table(const TreeNode::ptr &n) {
-        pre_traverse_parser_tree(n, [](TreeNode::ptr n) {
-            if (n != nullptr) {
-                Type type;
-                TreeNode::ptr p;
-                switch (n->stmt_or_exp) {
-                    case StmtOrExp::StmtK:
-                        switch (std::get<StmtKind>(n->kind)) {
-                            case StmtKind::DeclarationK:
-                                type = TypeSystem::getTypeFromToken(std::get<TokenType>(n->attribute));
-                                p = n->children.at(0); // declaration_statement的第一个children是variable_list.
-                                while (p != nullptr) {
-                                    SymbolTable::globalTable().insert(
-                                            std::get<string_ptr>(p->attribute), p->lineNumber, global_address++, type);
-                                    p = p->sibling;
-                                }
-                                break;
-                            case StmtKind::AssignK:
-                            case StmtKind::ReadK:
-                                SymbolTable::globalTable().update(std::get<string_ptr>(n->attribute), n->lineNumber);
-                                break;
-                            default:
-                                break;
-                        }
-                        break;
-                    case StmtOrExp::ExpK:
-                        switch (std::get<ExpKind>(n->kind)) {
-                            case ExpKind::IdK:
-                                SymbolTable::globalTable().update(std::get<string_ptr>(n->attribute), n->lineNumber);
-                                break;
-                            default:
-                                break;
-                        }
-                        break;
+    // kind 语句在第 child 个子节点之后是否退出块作用域. 循环体的作用域到 until/while 条件之后才结束,
+    // 条件可以使用循环体里声明的变量(repeat int k := 1; write k until k < 0)
+    bool closes_scope(StmtKind kind, size_t child) {
+        switch (kind) {
+            case StmtKind::IfK:
+                return child >= 1;
+            case StmtKind::RepeatK:
+            case StmtKind::WhileK:
+                return child == 1;
+            default:
+                return false;
+        }
+    }
+
+    /**
+     * 指针形式的先序处理: 声明语句把变量登记到符号表(要先于它的初始化表达式), 赋值/读入语句和ID记录出现的行号,
+     * ID 的类型就是符号表里查到的类型, 赋值语句的 type 记下目标变量的类型.
+     * idLine 是这一次出现的ID的行号: --hash-cons 时共享的ID节点只记得第一次出现的行号(见 Parser::identifierLines).
+     */
+    void resolve_symbols(TreeNode &n, int idLine) {
+        if (n.stmt_or_exp == StmtOrExp::StmtK) {
+            switch (std::get<StmtKind>(n.kind)) {
+                case StmtKind::DeclarationK: {
+                    auto type = TypeSystem::getTypeFromToken(std::get<TokenType>(n.attribute));
+                    // declaration_statement的第一个children是variable_list.
+                    for (auto p = n.children.at(0); p != nullptr; p = p->sibling) {
+                        SymbolTable::globalTable().insert(std::get<atom_t>(p->attribute), p->lineNumber, type);
+                    }
+                    break;
                 }
+                case StmtKind::AssignK:
+                    n.type = SymbolTable::globalTable().update(std::get<atom_t>(n.attribute), n.lineNumber);
+                    break;
+                case StmtKind::ReadK:
+                    SymbolTable::globalTable().update(std::get<atom_t>(n.attribute), n.lineNumber);
+                    break;
+                default:
+                    break;
             }
-        });
+        } else if (std::get<ExpKind>(n.kind) == ExpKind::IdK) {
+            // 符号表没有ID的信息(ID没有正确声明)时返回void(空类型,实际上是语义错误的标志)
+            n.type = SymbolTable::globalTable().update(std::get<atom_t>(n.attribute), idLine);
+        }
     }
 
-    void report_analysis_error(const string_t &expr_name, int lineNumber) {
-        using namespace Compiler::Exception;
-        ExceptionHandle::getHandle().add_exception(ExceptionType::ANALYSIS_ERROR,
-                                                   expr_name + " check type error on line " +
-                                                   std::to_string(lineNumber));
+    /**
+     * 指针形式的后序处理: 子节点的类型都已经知道, 推导运算表达式的类型, 检查语句的类型要求.
+     * 只读写 n 和它的子节点, 不访问符号表.
+     */
+    void infer_type(TreeNode &n, TypeErrors &errors) {
+        if (n.stmt_or_exp == StmtOrExp::StmtK) {
+            switch (std::get<StmtKind>(n.kind)) {
+                case StmtKind::DeclarationK: {
+                    // Declaration => Type variable_list;
+                    // variable_list => ID[:=expr]{,ID[:=expr]}*
+                    // 检查　variable_list 中 所有 ID:=expr 的 expr 是否与 Type 匹配.
+                    auto type = TypeSystem::getTypeFromToken(std::get<TokenType>(n.attribute));
+                    for (auto p = n.children.at(0); p != nullptr; p = p->sibling) {
+                        if (!p->children.empty() && p->children[0] != nullptr &&
+                            !assignable(type, p->children[0]->type)) {
+                            errors.emplace_back("variable_list statement", p->lineNumber);
+                        }
+                    }
+                    break;
+                }
+                case StmtKind::AssignK:
+                    if (!assignable(n.type, n.children.at(0)->type)) {
+                        errors.emplace_back("assign statement", n.lineNumber);
+                    }
+                    break;
+                case StmtKind::IfK:
+                    if (n.children.at(0)->type != Type::Boolean) {
+                        errors.emplace_back("if statement", n.lineNumber);
+                    }
+                    break;
+                case StmtKind::RepeatK:
+                case StmtKind::WhileK:
+                    if (n.children.at(1)->type != Type::Boolean) {
+                        errors.emplace_back("loop statement", n.lineNumber);
+                    }
+                    break;
+                case StmtKind::WriteK:
+                    // 不限制输出类型,除了void
+                    if (n.children.at(0)->type == Type::Void) {
+                        errors.emplace_back("write statement", n.lineNumber);
+                    }
+                    break;
+                default:
+                    break;
+            }
+        } else {
+            switch (std::get<ExpKind>(n.kind)) {
+                case ExpKind::IdK:
+                    break;
+                case ExpKind::OpK: {
+                    auto t2 = n.children.size() > 1 ? n.children[1]->type : Type::Void;
+                    check_operator(std::get<TokenType>(n.attribute), n.children.at(0)->type, t2, n.type, n.lineNumber,
+                                   errors);
+                    break;
+                }
+                default:
+                    n.type = constant_type(std::get<ExpKind>(n.kind));
+                    break;
+            }
+        }
     }
 
-    // check_type 时已经确保符号表没有错误,即符号不会重定义,也不会在无定义的时候被使用.
-    void check_type(const TreeNode::ptr &n) {
-        post_traverse_parser_tree(n, [](TreeNode::ptr n) {
-            constexpr size_t first_child = 0;
-            constexpr size_t second_child = 1;
-            Type t1, t2, temp;
-            TreeNode::ptr ptr;
-            if (n != nullptr) {
-                switch (n->stmt_or_exp) {
-                    case StmtOrExp::StmtK:
-                        switch (std::get<StmtKind>(n->kind)) {
-                            case StmtKind::DeclarationK:
-                                // Declaration => Type variable_list;
-                                // variable_list => ID[:=expr]{,ID[:=expr]}*
-                                // 检查　variable_list 中 所有 ID:=expr 的 expr 是否与 Type 匹配.
-                                // 1. Type为String的, 则 type(expr)==Type::String
-                                // 2. Type为 Integer|Float|Double 的, 则 type(expr)==Type::Integer|Float|Double 都可以
-                                // 注意这里即使expr类型是double,ID的type是int也没有关系,可以 int ID = int_cast(double_expr);
-                                // 3. Type为Boolean 则 type(expr)==Type::Boolean.
-                                temp = TypeSystem::getTypeFromToken(std::get<TokenType>(n->attribute));
-                                ptr = n->children.at(first_child); // variable_list_node
-                                while (ptr != nullptr) {
-                                    if (!ptr->children.empty() && ptr->children.at(first_child) != nullptr) {
-                                        t1 = ptr->children.at(first_child)->type; // expr存在并获取其类型
-                                        if (temp == Type::String || temp == Type::Boolean) {
-                                            if (t1 != temp) {
-                                                report_analysis_error("variable_list statement", ptr->lineNumber);
-                                            }
-                                        } else if (temp == Type::Integer || temp == Type::Float ||
-                                                   temp == Type::Double) {
-                                            if (t1 != Type::Integer && t1 != Type::Float && t1 != Type::Double) {
-                                                report_analysis_error("variable_list statement", ptr->lineNumber);
-                                            }
-                                        }
-                                    }
-                                    ptr = ptr->sibling;
-                                }
-                                break;
-                            case StmtKind::AssignK:
-                                t1 = n->children.at(first_child)->type;
-                                temp = SymbolTable::globalTable().getSymbolType(std::get<string_ptr>(n->attribute));
-                                if (temp == Type::String || temp == Type::Boolean) {
-                                    if (t1 != temp) {
-                                        report_analysis_error("assign statement", n->lineNumber);
-                                    }
-                                } else if (temp == Type::Integer || temp == Type::Float || temp == Type::Double) {
-                                    if (t1 != Type::Integer && t1 != Type::Float && t1 != Type::Double) {
-                                        report_analysis_error("assign statement", n->lineNumber);
-                                    }
-                                }
-                                break;
-                            case StmtKind::IfK:
-                                if (n->children.at(first_child)->type != Type::Boolean) {
-                                    report_analysis_error("if statement", n->lineNumber);
-                                }
-                                break;
-                            case StmtKind::RepeatK:
-                            case StmtKind::WhileK:
-                                if (n->children.at(second_child)->type != Type::Boolean) {
-                                    report_analysis_error("loop statement", n->lineNumber);
-                                }
-                                break;
-                            case StmtKind::WriteK:
-                                // 不限制输出类型,除了void
-                                if (n->children.at(first_child)->type == Type::Void) {
-                                    report_analysis_error("write statement", n->lineNumber);
-                                }
-                                break;
-                            default:
-                                break;
-                        }
-                        break;
-                    case StmtOrExp::ExpK:
-                        switch (std::get<ExpKind>(n->kind)) {
-                            case ExpKind::ConstIntK :
-                                n->type = Type::Integer;
-                                break;
-                            case ExpKind::ConstBoolK :
-                                n->type = Type::Boolean;
-                                break;
-                            case ExpKind::ConstFloatK :
-                                n->type = Type::Float;
-                                break;
-                            case ExpKind::ConstDoubleK:
-                                n->type = Type::Double;
-                                break;
-                            case ExpKind::ConstStringK :
-                                n->type = Type::String;
-                                break;
-                            case ExpKind::IdK:
-                                // 从符号表获取ID的类型,如果符号表没有ID的信息(ID没有正确声明)会返回void(空类型,实际上是语义错误的标志)
-                                n->type = SymbolTable::globalTable().getSymbolType(std::get<string_ptr>(n->attribute));
-                                break;
-                            case ExpKind::OpK :
-                                switch (std::get<TokenType>(n->attribute)) {
-                                    case TokenType::NOT: //单目逻辑运算 NOT
-                                        if (n->children.at(first_child)->type == Type::Boolean) {
-                                            n->type = Type::Boolean;
-                                        } else {
-                                            n->type = Type::Void; // 设置类型为空,作为类型错标志
-                                            report_analysis_error("logical-not expression", n->lineNumber);
-                                        }
-                                        break;
+    /**
+     * 指针形式的语义分析, 一次遍历同时完成符号的声明, 使用的解析和类型推导(原来是先序建符号表, 再后序检查类型两次遍历):
+     * enter 是 resolve_symbols, leave 是 infer_type.
+     * 语言要求先声明后使用, 所以先序遇到ID时它的声明(如果有)已经登记, 查到的就是最终的类型.
+     * 语句序列是块作用域时, beginChild/endChild 进出符号表的一层作用域. 赋值语句的 type 记下目标变量的类型,
+     * leave 时不用再按名字查找(那时候名字可能已经指向别的作用域的变量).
+     * 符号表有错误时不做类型检查(和原来一样), 所以类型错误先缓存, 遍历完没有符号错误才提交.
+     * checkTypes 为 false 时只建符号表, 类型检查留给 TypeChecker 并行完成(--check-threads).
+     *
+     * 共享的表达式(--hash-cons)在每个出现的位置都要解析符号, 符号表才能记下每一次出现(--dump-symbols 和不共享时相同);
+     * 只有类型推导只做一次, 类型和类型错误都属于第一次出现的位置.
+     */
+    class SemanticChecker : public TreeVisitor<SemanticChecker> {
+    private:
+        bool checkTypes;
+        TypeErrors typeErrors;
+        const std::vector<uint32_t> *identifierLines = nullptr; // --hash-cons: 每个ID出现的行号
+        size_t nextIdentifier = 0;
+        const TreeNode *revisiting = nullptr; // 正在重新访问的共享子树的根
+
+    public:
+        explicit SemanticChecker(bool checkTypes = true) : checkTypes(checkTypes) {
+            if (options().shareExpressions) identifierLines = &Parser::identifierLines();
+        }
 
-                                        //双目数值运算 PLUS MINUS TIMES OVER MOD (输入两个NUM,输出一个NUM)
-                                    case TokenType::PLUS:
-                                    case TokenType::MINUS:
-                                    case TokenType::TIMES:
-                                    case TokenType::OVER:
-                                    case TokenType::MOD:
-                                        t1 = n->children.at(first_child)->type, t2 = n->children.at(second_child)->type;
-                                        if ((t1 == Type::Integer || t1 == Type::Float || t1 == Type::Double)
-                                            &&
-                                            (t2 == Type::Integer || t2 == Type::Float || t2 == Type::Double)) {
-                                            /* type cast (往大的类型cast)
-                                             *         int       float     double
-                                             * int      I          F          D
-                                             * float    F          F          D
-                                             * double   D          D          D
-                                             */
-                                            if (t1 == Type::Double || t2 == Type::Double) {
-                                                n->type = Type::Double;
-                                            } else if (t1 == Type::Float || t2 == Type::Float) {
-                                                n->type = Type::Float;
-                                            } else { // t1 and t2 are both int
-                                                n->type = Type::Integer;
-                                            }
-                                        } else {
-                                            n->type = Type::Void;
-                                            report_analysis_error("arithmetic expression", n->lineNumber);
-                                        }
-                                        break;
+        void enter(TreeNode &n) {
+            if (revisiting == nullptr && revisit(n)) revisiting = &n;
+            int idLine = n.lineNumber;
+            if (identifierLines != nullptr && n.stmt_or_exp == StmtOrExp::ExpK &&
+                std::get<ExpKind>(n.kind) == ExpKind::IdK) {
+                idLine = (int) (*identifierLines)[nextIdentifier++];
+            }
+            resolve_symbols(n, idLine);
+        }
 
-                                        // 双目逻辑运算 AND OR (输入两个bool,输出一个bool)
-                                    case TokenType::AND:
-                                    case TokenType::OR:
-                                        t1 = n->children.at(first_child)->type, t2 = n->children.at(second_child)->type;
-                                        if ((t1 == Type::Boolean) && (t2 == Type::Boolean)) {
-                                            n->type = Type::Boolean;
-                                        } else {
-                                            n->type = Type::Void;
-                                            report_analysis_error("logical-and-or expression", n->lineNumber);
-                                        }
-                                        break;
+        void beginChild(TreeNode &parent, size_t i) {
+            if (parent.stmt_or_exp == StmtOrExp::StmtK && opens_scope(std::get<StmtKind>(parent.kind), i)) {
+                SymbolTable::globalTable().enterScope();
+            }
+        }
+
+        void endChild(TreeNode &parent, size_t i) {
+            if (parent.stmt_or_exp == StmtOrExp::StmtK && closes_scope(std::get<StmtKind>(parent.kind), i)) {
+                SymbolTable::globalTable().exitScope();
+            }
+        }
 
-                                        // 双目比较运算 LT BT LE BE EQ NE (输入两个NUM,输出一个bool)
-                                    case TokenType::LT:
-                                    case TokenType::LE:
-                                    case TokenType::BT:
-                                    case TokenType::BE:
-                                    case TokenType::EQ:
-                                    case TokenType::NE:
-                                        t1 = n->children.at(first_child)->type, t2 = n->children.at(second_child)->type;
-                                        if ((t1 == Type::Integer || t1 == Type::Float || t1 == Type::Double)
-                                            &&
-                                            (t2 == Type::Integer || t2 == Type::Float || t2 == Type::Double)) {
-                                            n->type = Type::Boolean;
-                                        } else {
-                                            n->type = Type::Void;
-                                            report_analysis_error("comparison expression", n->lineNumber);
-                                        }
-                                        break;
-                                    default:
-                                        break;
-                                }
-                                break;
+        void leave(TreeNode &n) {
+            if (revisiting == nullptr) {
+                if (checkTypes) infer_type(n, typeErrors);
+            } else if (revisiting == &n) {
+                revisiting = nullptr;
+            }
+        }
+
+        // 遍历结束: 符号表没有错误时才提交类型错误
+        void commit() {
+            if (Exception::ExceptionHandle::getHandle().hasException()) return;
+            report_type_errors(typeErrors);
+        }
+    };
+
+    // 只做类型检查: 检查一段顶层语句 [head, end), 错误记到 errors
+    class TypeChecker : public TreeVisitor<TypeChecker> {
+    private:
+        TypeErrors *errors = nullptr;
+
+    public:
+        void leave(TreeNode &n) {
+            infer_type(n, *errors);
+        }
+
+        void check(TreeNode::ptr head, TreeNode::ptr end, TypeErrors &out) {
+            errors = &out;
+            traverse(head, end);
+        }
+    };
+
+    /**
+     * 扁平语法树的符号表: 和指针形式一样先序遍历(声明语句要先于它的初始化表达式登记变量).
+     * 用显式栈代替递归: 弹出一个节点处理后, 先压入它的兄弟节点, 再倒序压入子节点.
+     * 块作用域的子节点前后各压入一个标记, 弹出时进出符号表的一层作用域(退出标记在整条兄弟链之后才弹出).
+     * 作用域在这一趟结束后就不存在了, 所以ID和赋值语句解析到的类型直接记在节点上, 留给后面的类型检查.
+     * 共享的节点(--hash-cons)在每个出现的位置都处理一次, 每次出现的ID按 Parser::identifierLines 的行号记录.
+     * (类型检查按数组顺序, 每个节点本来就只检查一次)
+     */
+    void build_symbol_table(FlatTree &tree, uint32_t head) {
+        constexpr uint32_t ENTER_SCOPE = FlatTree::NONE - 1, EXIT_SCOPE = FlatTree::NONE - 2;
+        std::vector<uint32_t> stack;
+        auto identifierLines = options().shareExpressions ? &Parser::identifierLines() : nullptr;
+        size_t nextIdentifier = 0;
+        if (head != FlatTree::NONE) stack.push_back(head);
+        while (!stack.empty()) {
+            auto i = stack.back();
+            stack.pop_back();
+            if (i == ENTER_SCOPE) {
+                SymbolTable::globalTable().enterScope();
+                continue;
+            }
+            if (i == EXIT_SCOPE) {
+                SymbolTable::globalTable().exitScope();
+                continue;
+            }
+            auto &n = tree.nodes[i];
+            if (n.isStatement()) {
+                switch (n.stmtKind()) {
+                    case StmtKind::DeclarationK: {
+                        auto type = TypeSystem::getTypeFromToken(tree.token(n));
+                        for (auto p = tree.child(n, 0); p != FlatTree::NONE; p = tree.nodes[p].sibling) {
+                            auto &variable = tree.nodes[p];
+                            SymbolTable::globalTable().insert(tree.atom(variable), (int) variable.lineNumber, type);
+                        }
+                        break;
+                    }
+                    case StmtKind::AssignK:
+                        n.setType(SymbolTable::globalTable().update(tree.atom(n), (int) n.lineNumber));
+                        break;
+                    case StmtKind::ReadK:
+                        SymbolTable::globalTable().update(tree.atom(n), (int) n.lineNumber);
+                        break;
+                    default:
+                        break;
+                }
+            } else if (n.expKind() == ExpKind::IdK) {
+                auto line = identifierLines != nullptr ? (*identifierLines)[nextIdentifier++] : n.lineNumber;
+                n.setType(SymbolTable::globalTable().update(tree.atom(n), (int) line));
+            }
+            if (n.sibling != FlatTree::NONE) stack.push_back(n.sibling);
+            for (auto c = n.childCount; c-- > 0;) {
+                if (n.isStatement() && closes_scope(n.stmtKind(), c)) stack.push_back(EXIT_SCOPE);
+                auto child = tree.child(n, c);
+                if (child != FlatTree::NONE) stack.push_back(child);
+                if (n.isStatement() && opens_scope(n.stmtKind(), c)) stack.push_back(ENTER_SCOPE);
+            }
+        }
+    }
+
+    /**
+     * 扁平语法树按后序存放, 类型检查就是从头到尾扫一遍数组, 检查规则和指针形式完全相同.
+     * ID和赋值语句的类型在建符号表时已经记在节点上, 这里不再查符号表.
+     * 只检查下标在 [begin, end) 的节点, 错误记到 errors. 一条顶层语句连同它的子树在数组里是连续的一段.
+     */
+    void check_type(FlatTree &tree, size_t begin, size_t end, TypeErrors &errors) {
+        for (auto i = begin; i < end; i++) {
+            auto &n = tree.nodes[i];
+            auto childType = [&tree, &n](size_t i) {
+                return tree.nodes[tree.child(n, i)].getType();
+            };
+            if (n.isStatement()) {
+                switch (n.stmtKind()) {
+                    case StmtKind::DeclarationK: {
+                        auto type = TypeSystem::getTypeFromToken(tree.token(n));
+                        for (auto p = tree.child(n, 0); p != FlatTree::NONE; p = tree.nodes[p].sibling) {
+                            auto &variable = tree.nodes[p];
+                            auto expression = tree.child(variable, 0);
+                            if (expression != FlatTree::NONE && !assignable(type, tree.nodes[expression].getType())) {
+                                errors.emplace_back("variable_list statement", (int) variable.lineNumber);
+                            }
+                        }
+                        break;
+                    }
+                    case StmtKind::AssignK:
+                        if (!assignable(n.getType(), childType(0))) {
+                            errors.emplace_back("assign statement", (int) n.lineNumber);
+                        }
+                        break;
+                    case StmtKind::IfK:
+                        if (childType(0) != Type::Boolean) {
+                            errors.emplace_back("if statement", (int) n.lineNumber);
+                        }
+                        break;
+                    case StmtKind::RepeatK:
+                    case StmtKind::WhileK:
+                        if (childType(1) != Type::Boolean) {
+                            errors.emplace_back("loop statement", (int) n.lineNumber);
+                        }
+                        break;
+                    case StmtKind::WriteK:
+                        if (childType(0) == Type::Void) {
+                            errors.emplace_back("write statement", (int) n.lineNumber);
                         }
                         break;
+                    default:
+                        break;
+                }
+            } else {
+                switch (n.expKind()) {
+                    case ExpKind::IdK:
+                        break;
+                    case ExpKind::OpK: {
+                        Type result;
+                        check_operator(tree.token(n), childType(0), n.childCount > 1 ? childType(1) : Type::Void,
+                                       result, (int) n.lineNumber, errors);
+                        n.setType(result);
+                        break;
+                    }
+                    default:
+                        n.setType(constant_type(n.expKind()));
+                        break;
                 }
             }
+        }
+    }
+
+    /**
+     * --check-threads N: 建完符号表以后并行做类型检查.
+     * 第一趟(单线程)结束时符号表就冻结了: ID 和赋值语句查到的类型已经记在节点上, 类型检查不再访问符号表,
+     * 只写自己子树里节点的 type, 所以顶层语句之间互不相关. 顶层语句按顺序切成任务, 用 parallelFor 分给 N 个线程,
+     * 每个任务的类型错误单独缓存, 最后按任务的顺序(也就是源代码的顺序)提交, 输出和单线程完全相同.
+     * --hash-cons 的共享节点会跨越顶层语句, 所以两者不能同时使用.
+     */
+    constexpr size_t STATEMENTS_PER_TASK = 64; // 指针形式: 每个任务的顶层语句条数
+    constexpr size_t NODES_PER_TASK = 4096;    // 扁平形式: 每个任务至少检查的节点数
+
+    void check_type_parallel(TreeNode::ptr head) {
+        // 和 SemanticChecker::commit 一样, 有符号错误时不报告类型错误, 也就不用再检查
+        if (Exception::ExceptionHandle::getHandle().hasException()) return;
+        std::vector<TreeNode::ptr> starts; // 任务 i 是顶层语句 [starts[i], starts[i + 1])
+        size_t count = 0;
+        for (auto p = head; p != nullptr; p = p->sibling) {
+            if (count++ % STATEMENTS_PER_TASK == 0) starts.push_back(p);
+        }
+        starts.push_back(nullptr);
+        std::vector<TypeErrors> errors(starts.size() - 1);
+        std::vector<TypeChecker> checkers(options().checkThreads);
+        parallelFor(errors.size(), options().checkThreads, [&](unsigned worker, size_t i) {
+            checkers[worker].check(starts[i], starts[i + 1], errors[i]);
+        });
+        for (auto &taskErrors:errors) {
+            report_type_errors(taskErrors);
+        }
+    }
+
+    void check_type_parallel(FlatTree &tree) {
+        std::vector<size_t> bounds{0}; // 任务 i 是节点 [bounds[i], bounds[i + 1])
+        for (auto p = tree.root; p != FlatTree::NONE; p = tree.nodes[p].sibling) {
+            if (p + 1 - bounds.back() >= NODES_PER_TASK) bounds.push_back(p + 1);
+        }
+        if (bounds.back() < tree.nodes.size()) bounds.push_back(tree.nodes.size());
+        std::vector<TypeErrors> errors(bounds.size() - 1);
+        parallelFor(errors.size(), options().checkThreads, [&](unsigned, size_t i) {
+            check_type(tree, bounds[i], bounds[i + 1], errors[i]);
         });
+        for (auto &taskErrors:errors) {
+            report_type_errors(taskErrors);
+        }
     }
 
     void analyse(const TreeNode::ptr &n) {
-        build_symbol_table(n);
-        if (TRACE_ANALYSER) {
-            std::cout << SymbolTable::globalTable();
+        SymbolTable::globalTable().collectCrossReference(options().dumpSymbols);
+        bool parallel = options().checkThreads > 1;
+        SemanticChecker checker(!parallel);
+        checker.traverse(n);
+        if (options().dumpSymbols) {
+            SymbolTable::globalTable().dump();
+        }
+        if (parallel) check_type_parallel(n);
+        else checker.commit();
+    }
+
+    void analyse(FlatTree &tree) {
+        SymbolTable::globalTable().collectCrossReference(options().dumpSymbols);
+        build_symbol_table(tree, tree.root);
+        if (options().dumpSymbols) {
+            SymbolTable::globalTable().dump();
         }
-        if (!Exception::ExceptionHandle::getHandle().hasException()) {
-            check_type(n); // 如果建立符号表没有错误,才允许执行语义类型检查,否则就是浪费时间
+        if (Exception::ExceptionHandle::getHandle().hasException()) return;
+        if (options().checkThreads > 1) {
+            check_type_parallel(tree);
+        } else {
+            TypeErrors errors;
+            check_type(tree, 0, tree.nodes.size(), errors);
+            report_type_errors(errors);
         }
     }
 }
\ No newline at end of file
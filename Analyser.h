@@ -7,11 +7,17 @@
 
 #include "Compiler.h"
 #include "Parser.h"
+#include "FlatTree.h"
 #include "Util.h"
 
 namespace Compiler::Analyser {
     using namespace Compiler::Parser;
 
     void analyse(const TreeNode::ptr &n);
+
+    /**
+     * 分析扁平形式的语法树, 结果(符号表, 错误, 节点类型)和指针形式完全相同.
+     */
+    void analyse(FlatTree &tree);
 }
 #endif //COMPILER_ANALYSER_H
@@ -0,0 +1,22 @@
+//
+// Created by junior on 19-5-26.
+//
+
+#include "Arena.h"
+
+namespace Compiler {
+    void *Arena::grow(size_t size, size_t align) {
+        size_t chunkSize = std::max(CHUNK_SIZE, size + align);
+        chunks.emplace_back(new char[chunkSize]); // 不用 make_unique, 避免把整块清零
+        cursor = reinterpret_cast<uintptr_t>(chunks.back().get());
+        limit = cursor + chunkSize;
+        return allocate(size, align);
+    }
+
+    void Arena::release() {
+        if (chunks.size() > 1) chunks.resize(1);
+        cursor = chunks.empty() ? 0 : reinterpret_cast<uintptr_t>(chunks.front().get());
+        limit = chunks.empty() ? 0 : cursor + CHUNK_SIZE;
+        allocated = 0;
+    }
+}
@@ -0,0 +1,71 @@
+//
+// Created by junior on 19-5-26.
+//
+/**
+ * 按块分配的内存池(arena): 分配只是移动游标, 不能单独释放, release() 一次释放全部.
+ * 只用来存放平凡析构(trivially destructible)的对象, 释放时不调用析构函数.
+ *
+ * 语法树的节点都在这里分配, 每个源文件处理完以后整棵树一次释放,
+ * 取代原来每个节点一次 make_shared 和析构时逐层递归的 shared_ptr 释放.
+ */
+
+#ifndef COMPILER_ARENA_H
+#define COMPILER_ARENA_H
+
+#include "Compiler.h"
+
+namespace Compiler {
+    class Arena {
+    private:
+        static constexpr size_t CHUNK_SIZE = 1 << 20; // 每块的大小, 超过一块的对象单独分配
+
+        std::vector<std::unique_ptr<char[]>> chunks;
+        uintptr_t cursor = 0;
+        uintptr_t limit = 0;
+        size_t allocated = 0; // 已经分配出去的字节数(包括对齐浪费的部分)
+
+        void *grow(size_t size, size_t align);
+
+    public:
+        Arena() = default;
+
+        Arena(Arena const &) = delete;
+
+        void operator=(Arena const &) = delete;
+
+        void *allocate(size_t size, size_t align) {
+            uintptr_t begin = (cursor + align - 1) & ~(uintptr_t) (align - 1);
+            if (begin + size > limit) return grow(size, align);
+            allocated += begin + size - cursor;
+            cursor = begin + size;
+            return reinterpret_cast<void *>(begin);
+        }
+
+        template<typename T, typename... Args>
+        T *create(Args &&... args) {
+            static_assert(std::is_trivially_destructible_v<T>, "arena never runs destructors");
+            return new(allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        }
+
+        /**
+         * 收回最后一次分配的 size 个字节. p 不是最后一次分配的对象时什么也不做.
+         */
+        void reclaim(void *p, size_t size) {
+            auto begin = reinterpret_cast<uintptr_t>(p);
+            if (begin + size != cursor) return;
+            allocated -= size;
+            cursor = begin;
+        }
+
+        /**
+         * 释放所有对象. 保留第一块给下一次使用, 其他块还给系统.
+         */
+        void release();
+
+        size_t bytes() const {
+            return allocated;
+        }
+    };
+}
+
+#endif //COMPILER_ARENA_H
@@ -0,0 +1,63 @@
+//
+// Created by junior on 19-5-12.
+//
+
+#include "AtomTable.h"
+
+namespace Compiler {
+    std::string_view AtomTable::store(std::string_view string) {
+        if (string.empty()) return {};
+        if (string.size() > CHUNK_SIZE / 4) { // 很长的字符串常量单独占一块, 不浪费当前块剩下的空间
+            chunks.push_back(std::make_unique<char_t[]>(string.size()));
+            memcpy(chunks.back().get(), string.data(), string.size());
+            return {chunks.back().get(), string.size()};
+        }
+        if (string.size() > chunkLeft) {
+            chunks.push_back(std::make_unique<char_t[]>(CHUNK_SIZE));
+            chunkCursor = chunks.back().get();
+            chunkLeft = CHUNK_SIZE;
+        }
+        char_t *begin = chunkCursor;
+        memcpy(begin, string.data(), string.size());
+        chunkCursor += string.size();
+        chunkLeft -= string.size();
+        return {begin, string.size()};
+    }
+
+    // FNV-1a
+    uint32_t AtomTable::hash(std::string_view string) {
+        uint32_t h = 2166136261u;
+        for (char_t c:string) {
+            h = (h ^ (unsigned char) c) * 16777619u;
+        }
+        return h;
+    }
+
+    void AtomTable::grow() {
+        std::vector<Slot> old(slots.size() * 2, Slot{0, EMPTY});
+        old.swap(slots);
+        size_t mask = slots.size() - 1;
+        for (auto &slot:old) {
+            if (slot.id == EMPTY) continue;
+            size_t index = slot.hash & mask;
+            while (slots[index].id != EMPTY) index = (index + 1) & mask;
+            slots[index] = slot;
+        }
+    }
+
+    atom_t AtomTable::intern(std::string_view string) {
+        uint32_t h = hash(string);
+        size_t mask = slots.size() - 1;
+        size_t index = h & mask;
+        for (; slots[index].id != EMPTY; index = (index + 1) & mask) {
+            if (slots[index].hash == h && strings[slots[index].id] == string) {
+                return atom_t{slots[index].id};
+            }
+        }
+        auto id = (uint32_t) strings.size();
+        strings.push_back(store(string)); // 保存的是 arena 里的副本, 源文件和Token缓冲释放以后仍然有效
+        slots[index] = Slot{h, id};
+        if (strings.size() * 2 > slots.size()) grow();
+        return atom_t{id};
+    }
+}
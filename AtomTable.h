@@ -0,0 +1,79 @@
+//
+// Created by junior on 19-5-12.
+//
+/**
+ * 原子表(Atom Table): 标识符和字符串常量统一的驻留池, 取代原来只处理字符串常量的 StringLiteralPool.
+ *
+ * 原来每个ID节点都持有一个新的 shared_ptr<string>(一次堆分配加一个控制块),
+ * 字符串常量即使已经在池里,查找时也要先 make_string_ptr 一次.
+ * 现在同一个名字/常量只保存一份字节,存放在按块分配的 arena 里, 语法树和符号表只持有32位的 atom 编号:
+ * 1. 查找用 string_view 作为key, 命中时不分配任何内存;
+ * 2. 两个 atom 相等当且仅当字符串相等, 符号表的查找变成整数比较;
+ * 3. arena 里的字节在整个编译过程中不移动也不释放, getString() 返回的 string_view 一直有效.
+ *
+ * 和符号表一样每个 CompilerContext 一个(见 CompilerContext.h), getInstance() 返回当前线程正在编译的文件的原子表.
+ */
+
+#ifndef COMPILER_ATOMTABLE_H
+#define COMPILER_ATOMTABLE_H
+
+#include "Compiler.h"
+#include "Util.h"
+
+namespace Compiler {
+    class AtomTable {
+    private:
+        static constexpr size_t CHUNK_SIZE = 64 * 1024; // arena 每块的大小, 超过一块的字符串单独分配
+
+        std::vector<std::unique_ptr<char_t[]>> chunks;
+        char_t *chunkCursor = nullptr;
+        size_t chunkLeft = 0;
+
+        std::vector<std::string_view> strings; // atom.id => arena 里的字节
+
+        /**
+         * 字节 => atom.id 的哈希表. 开放寻址(线性探测), 容量为2的幂, 负载不超过1/2.
+         * 每个槽只有8个字节, 保存完整的32位哈希值, 只有哈希值相同时才去 arena 比较字符串,
+         * 比 std::unordered_map 每次查找都要跳到链表节点少很多次 cache miss.
+         */
+        struct Slot {
+            uint32_t hash;
+            uint32_t id; // EMPTY 表示空槽
+        };
+        static constexpr uint32_t EMPTY = std::numeric_limits<uint32_t>::max();
+        std::vector<Slot> slots;
+
+        AtomTable() : slots(1024, Slot{0, EMPTY}) {}
+
+        friend class CompilerContext;
+
+        static uint32_t hash(std::string_view string);
+
+        void grow();
+
+        // 把字节复制到 arena, 返回指向 arena 的视图
+        std::string_view store(std::string_view string);
+
+    public:
+        static AtomTable &getInstance();
+
+        AtomTable(AtomTable const &) = delete;
+
+        void operator=(AtomTable const &) = delete;
+
+        /**
+         * 返回字符串对应的 atom, 第一次出现时复制到 arena 并分配新的编号.
+         */
+        atom_t intern(std::string_view string);
+
+        std::string_view getString(atom_t atom) const {
+            return strings[atom.id];
+        }
+
+        size_t size() const {
+            return strings.size();
+        }
+    };
+}
+
+#endif //COMPILER_ATOMTABLE_H
@@ -3,10 +3,9 @@
 //
 #include "CodeGen.h"
 #include "Code.h"
+#include "CompilerContext.h"
 
 namespace Compiler::CodeGen {
-    FILE *code_file = nullptr;
-
 
     void cGenExpr(const TreeNode::ptr &node) {
 
@@ -22,8 +21,9 @@ namespace Compiler::CodeGen {
 
     }
 
-    void cGen(const TreeNode::ptr &node) {
-        if (node != nullptr) {
+    // 沿着兄弟链逐条生成代码(循环而不是每个兄弟节点递归一次)
+    void cGen(const TreeNode::ptr &head) {
+        for (auto node = head; node != nullptr; node = node->sibling) {
             switch (node->stmt_or_exp) {
                 case StmtOrExp::StmtK:
                     cGenStmt(node);
@@ -32,11 +32,41 @@ namespace Compiler::CodeGen {
                     cGenExpr(node);
                     break;
             }
-            cGen(node->sibling);
         }
     }
 
+    // 扁平语法树: 和指针形式一样沿着顶层语句的兄弟链生成代码
+    void cGenExpr(const FlatTree &/*tree*/, uint32_t /*node*/) {
+
+    }
+
+    void cGenStmt(const FlatTree &/*tree*/, uint32_t /*node*/) {
+
+    }
+
+    void cGen(const FlatTree &tree, uint32_t node) {
+        for (; node != FlatTree::NONE; node = tree.nodes[node].sibling) {
+            if (tree.nodes[node].isStatement()) {
+                cGenStmt(tree, node);
+            } else {
+                cGenExpr(tree, node);
+            }
+        }
+    }
+
+    void code_generation(const FlatTree &tree, const string_t &code_file_name) {
+        auto &code_file = CompilerContext::current().codeFile;
+        code_file = fopen(code_file_name.c_str(), "w");
+        if (code_file == nullptr) {
+            fprintf(stderr, "can't open file %s\n", code_file_name.c_str());
+            return;
+        }
+        cGen(tree, tree.root);
+        fclose(code_file);
+    }
+
     void code_generation(const TreeNode::ptr &root, const string_t &code_file_name) {
+        auto &code_file = CompilerContext::current().codeFile;
         code_file = fopen(code_file_name.c_str(), "w");
         if (code_file == nullptr) {
             fprintf(stderr, "can't open file %s\n", code_file_name.c_str());
@@ -7,10 +7,13 @@
 
 #include "Compiler.h"
 #include "Parser.h"
+#include "FlatTree.h"
 
 namespace Compiler::CodeGen {
     using namespace Compiler::Parser;
 
     void code_generation(const TreeNode::ptr &root, const string_t &code_file_name);
+
+    void code_generation(const FlatTree &tree, const string_t &code_file_name);
 }
 #endif //COMPILER_CODEGEN_H
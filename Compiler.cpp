@@ -3,52 +3,191 @@
 //
 
 #include "Compiler.h"
-#include "FileUtil.h"
-#include "Exception.h"
-#include "SymbolTable.h"
-#include "Scanner.h"
-#include "Parser.h"
-#include "Analyser.h"
-#include "CodeGen.h"
+#include "CompilerContext.h"
+#include <atomic>
+#include <mutex>
+#include <sstream>
 
 namespace Compiler {
-    FILE *file = nullptr;
+    void usage(const char *program) {
+        fprintf(stderr, "usage: %s [options] <filename> <filename> ... <filename> (use - to read stdin)\n"
+                        "options:\n"
+                        "  --batch-lex       tokenize the whole file before parsing\n"
+                        "  --lex-threads N   tokenize each file with N threads (implies --batch-lex)\n"
+                        "  --pipeline        tokenize on a separate thread while parsing\n"
+                        "  --flat-ast        analyse and generate code from a flat post-order AST\n"
+                        "  --ll1             parse with the table-driven LL(1) parser instead of recursive descent\n"
+                        "  --hash-cons       share one node between identical expressions\n"
+                        "  --check-threads N type check top-level statements with N threads\n"
+                        "  --dump-tokens     print every token\n"
+                        "  --dump-ast        print the syntax tree\n"
+                        "  --dump-symbols    print the symbol table\n"
+                        "  --dump-format F   dump format: text (default), json or binary\n"
+                        "  --no-fold         do not fold constant expressions\n"
+                        "  --no-dce          do not eliminate dead branches and dead stores\n"
+                        "  --opt-stats       print how many syntax tree nodes the optimizer removed\n"
+                        "  -j N              compile N files at a time, output stays in command-line order\n"
+                        "exit status is 0 if every file compiled without errors, 1 otherwise\n", program);
+        exit(1);
+    }
+
+    // 解析命令行选项, 返回源文件名列表("-"表示标准输入,不当作选项)
+    std::vector<char *> parseOptions(int n, char *argv[], Options &options) {
+        std::vector<char *> fileNames;
+        for (int i = 1; i < n; i++) {
+            string_t arg = argv[i];
+            if (arg.size() < 2 || arg[0] != '-') {
+                fileNames.push_back(argv[i]);
+            } else if (arg == "--batch-lex") {
+                options.batchLex = true;
+            } else if (arg == "--lex-threads" && i + 1 < n) {
+                int threads = atoi(argv[++i]);
+                if (threads < 1) usage(argv[0]);
+                options.lexThreads = (unsigned) threads;
+                options.batchLex = true;
+            } else if (arg == "--pipeline") {
+                options.pipelineLex = true;
+            } else if (arg == "--flat-ast") {
+                options.flatAst = true;
+            } else if (arg == "--ll1") {
+                options.tableParser = true;
+            } else if (arg == "--hash-cons") {
+                options.shareExpressions = true;
+            } else if (arg == "--check-threads" && i + 1 < n) {
+                int threads = atoi(argv[++i]);
+                if (threads < 1) usage(argv[0]);
+                options.checkThreads = (unsigned) threads;
+            } else if (arg == "--dump-tokens") {
+                options.dumpTokens = true;
+            } else if (arg == "--dump-ast") {
+                options.dumpAst = true;
+            } else if (arg == "--dump-symbols") {
+                options.dumpSymbols = true;
+            } else if (arg == "--dump-format" && i + 1 < n) {
+                string_t format = argv[++i];
+                if (format == "text") options.dumpFormat = DumpFormat::Text;
+                else if (format == "json") options.dumpFormat = DumpFormat::Json;
+                else if (format == "binary") options.dumpFormat = DumpFormat::Binary;
+                else usage(argv[0]);
+            } else if (arg == "--no-fold") {
+                options.foldConstants = false;
+            } else if (arg == "--no-dce") {
+                options.eliminateDeadCode = false;
+            } else if (arg == "--opt-stats") {
+                options.optimizerStatistics = true;
+            } else if (arg == "-j" && i + 1 < n) {
+                int jobs = atoi(argv[++i]);
+                if (jobs < 1) usage(argv[0]);
+                options.jobs = (unsigned) jobs;
+            } else {
+                fprintf(stderr, "unknown option %s\n", argv[i]);
+                usage(argv[0]);
+            }
+        }
+        if (fileNames.empty()) usage(argv[0]);
+        if (options.batchLex && options.pipelineLex) {
+            fprintf(stderr, "--pipeline cannot be combined with --batch-lex/--lex-threads\n");
+            usage(argv[0]);
+        }
+        if (options.shareExpressions && options.tableParser) {
+            fprintf(stderr, "--hash-cons cannot be combined with --ll1\n");
+            usage(argv[0]);
+        }
+        if (options.shareExpressions && options.checkThreads > 1) {
+            fprintf(stderr, "--hash-cons cannot be combined with --check-threads\n");
+            usage(argv[0]);
+        }
+        return fileNames;
+    }
 
-    void compile(int n, char *argv[]) {
-        using namespace Compiler::Exception;
+    // -j 模式下一个文件的输出, 编译完以后按命令行的顺序输出
+    struct FileOutput {
+        string_t out, err;
+        bool done = false;
+    };
+
+    /**
+     * 编译一个文件, 返回是否成功(打不开也算失败). buffer 为 nullptr 时直接输出,
+     * 否则标准输出和标准错误的内容都先追加到 buffer 里, 包括 --dump-* 和 --opt-stats 的输出.
+     */
+    bool compileFile(const char *fileName, const Options &options, FileOutput *buffer) {
         using namespace Compiler::FileUtil;
-        using namespace Compiler::Scanner;
-        using namespace Compiler::Parser;
-        using namespace Compiler::Analyser;
-        using namespace Compiler::CodeGen;
-        if (n < 2) {
-            fprintf(stderr, "usage: %s <filename> <filename> ... <filename>\n", argv[0]);
-            exit(1);
-        }
-        readFromFile(n - 1, argv + 1);
-        for (auto &pair:files) {
-            file = pair.second;
-            auto root = parse();
-            if (!ExceptionHandle::getHandle().hasException()) { // 词法/语法没有错误才能继续语义分析
-                analyse(root);
-                if (ExceptionHandle::getHandle().hasException()) { // 语义错误输出
-                    std::cout << "Process File " << pair.first << " has exceptions:\n" <<
-                              ExceptionHandle::getHandle();
-                    return;
-                } else { // 词法,语法,语义都正确才能执行中间代码生成
-                    code_generation(root, pair.first + ".code");
-                    fprintf(stdout, "Process File %s success..\n", pair.first.c_str());
-                }
-            } else { // 词法和语法错误输出
-                std::cout << "Process File " << pair.first << " has exceptions:\n" <<
-                          ExceptionHandle::getHandle();
+        auto print = [buffer](FILE *stream, const string_t &text) {
+            if (buffer != nullptr) {
+                (stream == stdout ? buffer->out : buffer->err) += text;
                 return;
             }
-            clearAll(); // Scanner clearAll
-            if (fclose(file)) {
-                fprintf(stderr, "Close File %s fail.\n", pair.first.c_str());
-                exit(1);
+            if (stream == stderr) fflush(stdout); // 和 -j 一样, 先输出前面的标准输出
+            fwrite(text.data(), 1, text.size(), stream);
+        };
+        SourceFile source;
+        if (!openFile(fileName, source)) {
+            print(stderr, "File " + string_t(fileName) + " not found!\n");
+            return false;
+        }
+        bool success;
+        {
+            CompilerContext context(options); // 每个文件独立的符号表和诊断信息
+            if (buffer != nullptr) context.writer.captureTo(&buffer->out);
+            success = context.compile(source);
+            context.writer.flush();
+            std::ostringstream message;
+            if (success) message << "Process File " << source.name << " success..\n";
+            else message << "Process File " << source.name << " has exceptions:\n" << context.diagnostics;
+            print(stdout, message.str());
+        }
+        if (!closeFile(source)) {
+            print(stderr, "Close File " + source.name + " fail.\n");
+            success = false;
+        }
+        return success;
+    }
+
+    /**
+     * -j N: N个线程(包括调用者)同时编译不同的文件, 每个文件从扫描到代码生成都在同一个线程里完成.
+     * 线程按命令行的顺序取下一个文件(共享的计数器), 而不是像 parallelFor 那样每个线程一段:
+     * 输出必须按顺序, 前面的文件先编译完才能尽早输出, 等待输出的缓冲也少.
+     * 一个文件编译完以后, 如果它前面的文件都已经输出, 就输出它和它后面已经编译完的文件.
+     */
+    void compileParallel(const std::vector<char *> &fileNames, const Options &options, std::vector<char> &success) {
+        std::vector<FileOutput> outputs(fileNames.size());
+        std::atomic<size_t> next{0};
+        std::mutex printing;
+        size_t printed = 0;
+        auto work = [&]() {
+            for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < fileNames.size();) {
+                success[i] = compileFile(fileNames[i], options, &outputs[i]);
+                std::lock_guard<std::mutex> lock(printing);
+                outputs[i].done = true;
+                for (; printed < outputs.size() && outputs[printed].done; printed++) {
+                    auto &output = outputs[printed];
+                    fwrite(output.out.data(), 1, output.out.size(), stdout);
+                    fflush(stdout);
+                    fwrite(output.err.data(), 1, output.err.size(), stderr);
+                    output.out = output.err = string_t(); // 输出以后马上释放
+                }
+            }
+        };
+        auto threads = (unsigned) std::min<size_t>(options.jobs, fileNames.size());
+        std::vector<std::future<void>> futures;
+        for (unsigned w = 1; w < threads; w++) {
+            futures.push_back(std::async(std::launch::async, work));
+        }
+        work();
+        for (auto &future:futures) future.get();
+    }
+
+    int compile(int n, char *argv[]) {
+        Options options;
+        auto fileNames = parseOptions(n, argv, options);
+        std::vector<char> success(fileNames.size());
+        if (options.jobs > 1) {
+            compileParallel(fileNames, options, success);
+        } else {
+            for (size_t i = 0; i < fileNames.size(); i++) {
+                success[i] = compileFile(fileNames[i], options, nullptr);
             }
         }
+        return std::all_of(success.begin(), success.end(), [](char ok) { return ok; }) ? 0 : 1;
     }
 }
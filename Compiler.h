@@ -7,6 +7,7 @@
 
 // standard library include
 #include <algorithm>
+#include <array>
 #include <cinttypes>
 #include <cstdint>
 #include <variant>
@@ -17,6 +18,7 @@
 #include <limits>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <list>
 #include <stack>
@@ -25,11 +27,13 @@
 #include <set>
 #include <unordered_set>
 #include <map>
+#include <optional>
 #include <unordered_map>
 #include <cstdlib>
 #include <cstdio>
 #include <cstring>
 #include <cassert>
+#include <future>
 
 // boost include
 #include <boost/format.hpp>
@@ -38,8 +42,40 @@
 #include "config.h"
 
 namespace Compiler {
-    extern FILE *file; // 当前处理的文件. 注意用extern强制声明,不定义.
+    /**
+     * 命令行选项
+     */
+    enum class DumpFormat : uint8_t {
+        Text, Json, Binary
+    };
 
-    void compile(int n, char *argv[]);
+    struct Options {
+        bool batchLex = false; // --batch-lex: 先把整个文件切成Token(TokenBuffer),再进行语法分析
+        unsigned lexThreads = 1; // --lex-threads N: 用N个线程并行扫描一个文件(隐含 --batch-lex)
+        bool pipelineLex = false; // --pipeline: 独立的扫描线程和语法分析同时进行(TokenPipeline)
+        bool flatAst = false; // --flat-ast: 语法分析后转换成扁平语法树(FlatTree), 语义分析和代码生成使用扁平形式
+        bool tableParser = false; // --ll1: 用表驱动的 LL(1) 分析器(ParserTable.h)代替递归下降
+        bool shareExpressions = false; // --hash-cons: 相同的表达式共享一个节点(见 ExpressionTable.h)
+        unsigned checkThreads = 1; // --check-threads N: 建完符号表以后用N个线程并行做类型检查(见 Analyser.cpp)
+        bool dumpTokens = false; // --dump-tokens: 输出扫描得到的Token
+        bool dumpAst = false; // --dump-ast: 输出语法树
+        bool dumpSymbols = false; // --dump-symbols: 输出符号表
+        DumpFormat dumpFormat = DumpFormat::Text; // --dump-format text|json|binary (见 Dump.h)
+        bool foldConstants = true; // --no-fold: 关闭常量折叠(见 Optimizer.h)
+        bool eliminateDeadCode = true; // --no-dce: 关闭死代码消除(见 Optimizer.h)
+        bool optimizerStatistics = false; // --opt-stats: 输出每个文件优化删掉的节点数和字节数
+        unsigned jobs = 1; // -j N: 用N个线程同时编译不同的文件, 每个文件的输出先缓冲起来, 按命令行的顺序输出
+    };
+
+    class CompilerContext;
+
+    // 当前线程正在编译的 CompilerContext 的选项(见 CompilerContext.h)
+    const Options &options();
+
+    /**
+     * 命令行入口: 解析选项, 编译每个文件(一个文件有错误不影响其他文件).
+     * 返回进程的退出码: 所有文件都没有错误时为0, 否则为1.
+     */
+    int compile(int n, char *argv[]);
 }
 #endif //SCANNER_COMPILER_H
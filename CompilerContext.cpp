@@ -0,0 +1,91 @@
+//
+// Created by junior on 19-6-12.
+//
+
+#include "CompilerContext.h"
+#include "TokenPipeline.h"
+#include "FlatTree.h"
+#include "Analyser.h"
+#include "CodeGen.h"
+
+namespace Compiler {
+    // 当前线程绑定的 context. 整个编译器里唯一的全局变量, 每个线程一份
+    thread_local CompilerContext *bound = nullptr;
+
+    CompilerContext::CompilerContext(const Options &options) : options(options) {}
+
+    CompilerContext &CompilerContext::current() {
+        assert(bound != nullptr && "no CompilerContext is bound to this thread");
+        return *bound;
+    }
+
+    CompilerContext::Bind::Bind(CompilerContext &context) : previous(bound) {
+        bound = &context;
+    }
+
+    CompilerContext::Bind::~Bind() {
+        bound = previous;
+    }
+
+    const Options &options() {
+        return CompilerContext::current().options;
+    }
+
+    Exception::ExceptionHandle &Exception::ExceptionHandle::getHandle() {
+        return CompilerContext::current().diagnostics;
+    }
+
+    AtomTable &AtomTable::getInstance() {
+        return CompilerContext::current().atoms;
+    }
+
+    SymbolTable &SymbolTable::globalTable() {
+        return CompilerContext::current().symbols;
+    }
+
+    Dump::Writer &Dump::Writer::getInstance() {
+        return CompilerContext::current().writer;
+    }
+
+    bool CompilerContext::compile(FileUtil::SourceFile &source) {
+        using namespace Compiler::Scanner;
+        using namespace Compiler::Parser;
+        using namespace Compiler::Analyser;
+        using namespace Compiler::CodeGen;
+        using namespace Compiler::Optimizer;
+        Bind bind(*this);
+        file = &source;
+        TokenBuffer tokenBuffer;
+        TreeNode::ptr root = nullptr;
+        if (options.batchLex) {
+            tokenize(tokenBuffer, options.lexThreads);
+            root = parse(tokenBuffer);
+        } else if (options.pipelineLex) {
+            TokenPipeline pipeline; // 语法分析结束时等待扫描线程退出
+            root = parse(pipeline);
+        } else {
+            root = parse();
+        }
+        if (diagnostics.hasException()) return false; // 词法/语法没有错误才能继续语义分析
+
+        FlatTree flat;
+        if (options.flatAst) {
+            flat = flatten(root);
+            Parser::clearAll(); // 之后只使用扁平形式, 原来的树可以马上释放
+            root = nullptr;
+            analyse(flat);
+            if (!diagnostics.hasException()) optimize(flat);
+        } else {
+            analyse(root);
+            if (!diagnostics.hasException()) optimize(root);
+        }
+        if (diagnostics.hasException()) return false;
+
+        // 词法,语法,语义都正确才能执行中间代码生成
+        if (options.flatAst) code_generation(flat, source.name + ".code");
+        else code_generation(root, source.name + ".code");
+        Scanner::clearAll();
+        Parser::clearAll(); // 整棵语法树一次释放
+        return true;
+    }
+}
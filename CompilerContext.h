@@ -0,0 +1,78 @@
+//
+// Created by junior on 19-6-12.
+//
+/**
+ * 编译一个源文件需要的全部状态: 选项, 诊断信息(ExceptionHandle), 符号表, 原子表, 调试输出缓冲,
+ * 扫描器和语法分析器的游标, 语法树的 arena, 优化统计. 原来这些都是全局变量或者单例, 现在都放在这里,
+ * 同一个进程里可以同时有多个 CompilerContext, 每个线程编译自己的文件, 互不影响(libcompiler 可以嵌入到别的程序里).
+ *
+ * 各模块仍然通过原来的入口访问这些状态(ExceptionHandle::getHandle(), SymbolTable::globalTable(),
+ * AtomTable::getInstance(), Dump::Writer::getInstance(), options()), 它们返回当前线程绑定的 CompilerContext 里的成员.
+ * compile() 在开始时绑定自己, 结束时恢复原来的绑定; 编译过程中自己启动的线程(--pipeline 的扫描线程)也要绑定同一个 context.
+ * 没有绑定任何 context 的线程调用这些入口是错误的(assert).
+ */
+
+#ifndef COMPILER_COMPILERCONTEXT_H
+#define COMPILER_COMPILERCONTEXT_H
+
+#include "Compiler.h"
+#include "FileUtil.h"
+#include "Exception.h"
+#include "AtomTable.h"
+#include "SymbolTable.h"
+#include "Dump.h"
+#include "Scanner.h"
+#include "Parser.h"
+#include "Optimizer.h"
+
+namespace Compiler {
+    class CompilerContext {
+    public:
+        Options options;
+        FileUtil::SourceFile *file = nullptr; // 正在编译的源文件
+
+        Exception::ExceptionHandle diagnostics;
+        AtomTable atoms;
+        SymbolTable symbols;
+        Dump::Writer writer;
+
+        Scanner::ScannerState scanner;
+        Parser::ParserState parser;
+        Optimizer::Statistics folded, eliminated;
+        FILE *codeFile = nullptr;
+
+        explicit CompilerContext(const Options &options = Options());
+
+        CompilerContext(CompilerContext const &) = delete;
+
+        void operator=(CompilerContext const &) = delete;
+
+        /**
+         * 编译一个源文件: 词法, 语法, 语义分析, 优化, 都没有错误时生成 <name>.code. 返回是否没有错误,
+         * 错误留在 diagnostics 里由调用者输出. 一个 context 只编译一个文件(符号表和诊断信息不会清空).
+         */
+        bool compile(FileUtil::SourceFile &source);
+
+        // 当前线程绑定的 context
+        static CompilerContext &current();
+
+        /**
+         * 在作用域内把当前线程绑定到 context, 析构时恢复原来的绑定.
+         */
+        class Bind {
+        public:
+            explicit Bind(CompilerContext &context);
+
+            ~Bind();
+
+            Bind(Bind const &) = delete;
+
+            void operator=(Bind const &) = delete;
+
+        private:
+            CompilerContext *previous;
+        };
+    };
+}
+
+#endif //COMPILER_COMPILERCONTEXT_H
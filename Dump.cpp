@@ -0,0 +1,70 @@
+//
+// Created by junior on 19-6-5.
+//
+
+#include "Dump.h"
+#include <cstdarg>
+
+namespace Compiler::Dump {
+    void Writer::printf(const char *format, ...) {
+        va_list args;
+        va_start(args, format);
+        va_list retry;
+        va_copy(retry, args);
+        auto length = vsnprintf(buffer.get() + used, DUMP_BUFFER_SIZE - used, format, args);
+        va_end(args);
+        if (length >= 0 && used + (size_t) length < DUMP_BUFFER_SIZE) { // vsnprintf 还要写一个 '\0'
+            used += (size_t) length;
+        } else if (length >= 0) { // 剩下的空间不够: 输出缓冲后重新格式化, 还不够就直接输出
+            flush();
+            if ((size_t) length < DUMP_BUFFER_SIZE) {
+                used = (size_t) vsnprintf(buffer.get(), DUMP_BUFFER_SIZE, format, retry);
+            } else {
+                std::unique_ptr<char[]> text(new char[(size_t) length + 1]);
+                vsnprintf(text.get(), (size_t) length + 1, format, retry);
+                emit(text.get(), (size_t) length);
+            }
+        }
+        va_end(retry);
+    }
+
+    void Writer::jsonString(std::string_view text) {
+        put('"');
+        for (auto c:text) {
+            switch (c) {
+                case '"':
+                    write("\\\"");
+                    break;
+                case '\\':
+                    write("\\\\");
+                    break;
+                case '\n':
+                    write("\\n");
+                    break;
+                case '\t':
+                    write("\\t");
+                    break;
+                default:
+                    if ((unsigned char) c < 0x20) printf("\\u%04x", (unsigned) c);
+                    else put(c);
+                    break;
+            }
+        }
+        put('"');
+    }
+
+    void Writer::emit(const char *data, size_t size) {
+        if (capture != nullptr) {
+            capture->append(data, size);
+        } else {
+            fwrite(data, 1, size, OUTPUT_STREAM);
+        }
+    }
+
+    void Writer::flush() {
+        if (used == 0) return;
+        emit(buffer.get(), used);
+        if (capture == nullptr) fflush(OUTPUT_STREAM);
+        used = 0;
+    }
+}
@@ -0,0 +1,97 @@
+//
+// Created by junior on 19-6-5.
+//
+/**
+ * 调试输出(--dump-tokens / --dump-ast / --dump-symbols)共用的输出缓冲.
+ * 所有输出先追加到一块 DUMP_BUFFER_SIZE 大小的缓冲里, 满了或者一次输出结束时才 fwrite 一次,
+ * 取代原来每个Token/节点一次 fprintf. 没有打开任何 --dump-* 选项时不会用到这里.
+ *
+ * 输出格式由 --dump-format 选择:
+ *  text:   和原来的 TRACE_* 输出完全相同;
+ *  json:   每行一个 JSON 对象(Token, 顶层语句, 符号表项各占一行), 方便管道给其他工具逐行处理;
+ *  binary: 紧凑的二进制记录, 整数都是本机字节序(小端), 每条记录以一个字节的标记开头:
+ *          Token  'T' u32 行号, u8 TokenType, u32 长度, 文本
+ *          节点   'N' u8 StmtOrExp, u8 Kind, u32 行号, u32 长度, 属性文本, u8 子节点数, 然后是每个子节点的兄弟链
+ *          兄弟链是若干个节点后跟 'E', 整棵树就是顶层语句的兄弟链
+ *          符号   'S' u32 长度, 名字, u64 地址, u8 Type, u32 行数, u32 行号...
+ *
+ * 同一时刻只能有一个线程输出(流水线模式下扫描线程输出Token, 语法分析在读到 END_FILE 以后才输出语法树).
+ * -j 同时编译多个文件时每个文件的输出先追加到自己的缓冲(captureTo), 由驱动程序按命令行的顺序输出.
+ */
+
+#ifndef COMPILER_DUMP_H
+#define COMPILER_DUMP_H
+
+#include "Compiler.h"
+
+namespace Compiler::Dump {
+    class Writer {
+    private:
+        std::unique_ptr<char[]> buffer;
+        size_t used = 0;
+        std::string *capture = nullptr; // 不为空时输出追加到这里, 不写 OUTPUT_STREAM
+
+        void emit(const char *data, size_t size);
+
+        Writer() : buffer(new char[DUMP_BUFFER_SIZE]) {}
+
+        friend class Compiler::CompilerContext;
+
+    public:
+        // 当前线程正在编译的文件的输出缓冲(每个 CompilerContext 一个)
+        static Writer &getInstance();
+
+        Writer(Writer const &) = delete;
+
+        void operator=(Writer const &) = delete;
+
+        ~Writer() { flush(); }
+
+        void write(const char *data, size_t size) {
+            if (used + size > DUMP_BUFFER_SIZE) {
+                flush();
+                if (size > DUMP_BUFFER_SIZE) { // 比整个缓冲还大, 直接输出
+                    emit(data, size);
+                    return;
+                }
+            }
+            memcpy(buffer.get() + used, data, size);
+            used += size;
+        }
+
+        void write(std::string_view text) { write(text.data(), text.size()); }
+
+        void put(char c) {
+            if (used == DUMP_BUFFER_SIZE) flush();
+            buffer[used++] = c;
+        }
+
+        // 二进制格式的定长整数
+        template<typename T>
+        void value(T v) {
+            static_assert(std::is_integral_v<T>, "binary dump only writes integers");
+            write(reinterpret_cast<const char *>(&v), sizeof(v));
+        }
+
+        // 二进制格式的字符串: u32 长度 + 内容
+        void bytes(std::string_view text) {
+            value((uint32_t) text.size());
+            write(text);
+        }
+
+        void printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+        // 带引号和转义的 JSON 字符串
+        void jsonString(std::string_view text);
+
+        void flush();
+
+        // 之后的输出都追加到 output 里(output 为 nullptr 时恢复输出到 OUTPUT_STREAM)
+        void captureTo(std::string *output) {
+            flush();
+            capture = output;
+        }
+    };
+}
+
+#endif //COMPILER_DUMP_H
@@ -9,6 +9,10 @@ namespace Compiler::Exception {
         errors.push_back(ExceptionEntry{message, type});
     }
 
+    void ExceptionHandle::add_exception(const ExceptionEntry &entry) {
+        errors.push_back(entry);
+    }
+
     std::map<ExceptionType, string_t> getExceptionTypeStrings() {
         static auto map = std::map<ExceptionType, string_t>
                 {{ExceptionType::LEXICAL_ERROR,  "LEXICAL_ERROR"},
@@ -38,9 +42,4 @@ namespace Compiler::Exception {
     bool ExceptionHandle::hasException() const {
         return !errors.empty();
     }
-
-    ExceptionHandle &ExceptionHandle::getHandle() {
-        static ExceptionHandle handle;
-        return handle;
-    }
 }
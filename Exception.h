@@ -33,13 +33,15 @@ namespace Compiler::Exception {
         ExceptionType type;
     };
 
-    // 使用单例模式
+    // 每个 CompilerContext 一个, getHandle() 返回当前线程正在编译的文件的诊断信息(见 CompilerContext.h)
     class ExceptionHandle {
     private:
         std::vector<ExceptionEntry> errors;
 
         ExceptionHandle() = default;
 
+        friend class Compiler::CompilerContext;
+
     public:
         static ExceptionHandle &getHandle();
 
@@ -50,6 +52,8 @@ namespace Compiler::Exception {
 
         void add_exception(ExceptionType type, const string_t &message);
 
+        void add_exception(const ExceptionEntry &entry);
+
         friend std::ostream &operator<<(std::ostream &out, const ExceptionHandle &handle);
 
         bool hasException() const;
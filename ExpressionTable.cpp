@@ -0,0 +1,160 @@
+//
+// Created by junior on 19-6-10.
+//
+
+#include "ExpressionTable.h"
+
+namespace Compiler::Parser {
+    // 属性的位模式. 浮点数按位比较: 0.0 和 -0.0 是不同的常量
+    uint64_t attribute_bits(const TreeNode &n) {
+        switch (n.attribute.index()) {
+            case 1:
+                return (uint64_t) std::get<TokenType>(n.attribute);
+            case 2:
+                return (uint32_t) std::get<int_t>(n.attribute);
+            case 3: {
+                uint32_t bits;
+                auto value = std::get<float_t>(n.attribute);
+                memcpy(&bits, &value, sizeof(bits));
+                return bits;
+            }
+            case 4: {
+                uint64_t bits;
+                auto value = std::get<double_t>(n.attribute);
+                memcpy(&bits, &value, sizeof(bits));
+                return bits;
+            }
+            case 5:
+                return (uint64_t) std::get<bool_t>(n.attribute);
+            case 6:
+                return std::get<atom_t>(n.attribute).id;
+            default:
+                return 0;
+        }
+    }
+
+    uint64_t mix(uint64_t h, uint64_t value) {
+        h = (h ^ value) * 0x9E3779B97F4A7C15ull;
+        return h ^ (h >> 29);
+    }
+
+    uint64_t node_hash(const TreeNode &n, uint32_t version) {
+        auto h = mix((uint64_t) std::get<ExpKind>(n.kind) << 8 | n.attribute.index(), attribute_bits(n));
+        for (auto child:n.children) h = mix(h, reinterpret_cast<uintptr_t>(child));
+        return mix(h, version);
+    }
+
+    bool same_node(const TreeNode &a, const TreeNode &b) {
+        if (a.kind != b.kind || a.attribute.index() != b.attribute.index() ||
+            attribute_bits(a) != attribute_bits(b) || a.children.size() != b.children.size()) {
+            return false;
+        }
+        return std::equal(a.children.begin(), a.children.end(), b.children.begin());
+    }
+
+    bool is_constant(const TreeNode &n) {
+        auto kind = std::get<ExpKind>(n.kind);
+        return kind != ExpKind::OpK && kind != ExpKind::IdK;
+    }
+
+    uint32_t &ExpressionTable::version(atom_t name) {
+        if (name.id >= versions.size()) versions.resize(name.id + 1, 0);
+        return versions[name.id];
+    }
+
+    bool ExpressionTable::visible(const Entry &entry) const {
+        if (is_constant(*entry.node)) return true;
+        auto barrier = loops.empty() ? 0 : loops.back();
+        return entry.depth < regions.size() && regions[entry.depth] == entry.serial && entry.depth >= barrier;
+    }
+
+    void ExpressionTable::grow() {
+        std::vector<Entry> old;
+        old.swap(slots);
+        size_t live = 0;
+        for (auto &entry:old) {
+            if (entry.node == nullptr) continue;
+            bool ended = !is_constant(*entry.node) &&
+                         (entry.depth >= regions.size() || regions[entry.depth] != entry.serial);
+            if (ended) entry.node = nullptr;
+            else live++;
+        }
+        slots.assign(live * 4 > old.size() ? old.size() * 2 : old.size(), Entry());
+        size_t mask = slots.size() - 1;
+        for (auto &entry:old) {
+            if (entry.node == nullptr) continue;
+            size_t index = entry.hash & mask;
+            while (slots[index].node != nullptr) index = (index + 1) & mask;
+            slots[index] = entry;
+        }
+        usedSlots = live;
+    }
+
+    TreeNode::ptr ExpressionTable::share(TreeNode::ptr n) {
+        uint32_t idVersion = 0;
+        if (std::get<ExpKind>(n->kind) == ExpKind::IdK && !is_attribute_null(n)) {
+            auto name = std::get<atom_t>(n->attribute);
+            idVersion = version(name);
+            if (declaration != 0) {
+                if (name.id >= fetched.size()) fetched.resize(name.id + 1, 0);
+                fetched[name.id] = declaration;
+            }
+        }
+        auto h = node_hash(*n, idVersion);
+        size_t mask = slots.size() - 1;
+        size_t index = h & mask;
+        for (; slots[index].node != nullptr; index = (index + 1) & mask) {
+            auto &entry = slots[index];
+            if (entry.hash == h && entry.version == idVersion && same_node(*entry.node, *n)) {
+                if (visible(entry)) {
+                    entry.node->shared = true;
+                    return entry.node;
+                }
+                break; // 键相同但是不可见: 用 n 覆盖
+            }
+        }
+        bool empty = slots[index].node == nullptr;
+        slots[index] = Entry{n, h, idVersion, (uint32_t) (regions.size() - 1), regions.back()};
+        if (empty && ++usedSlots * 2 > slots.size()) grow();
+        return n;
+    }
+
+    bool ExpressionTable::declare(atom_t name) {
+        version(name)++;
+        declared.push_back(name);
+        if (declaration == 0 || name.id >= fetched.size() || fetched[name.id] != declaration) return false;
+        // 之前的初始化表达式要换成副本, 表里它们的节点不再出现在树上: 换一个区域编号, 当前区域里已有的节点都不再共享
+        regions.back() = nextSerial++;
+        return true;
+    }
+
+    void ExpressionTable::enterBlock(bool loop) {
+        regions.push_back(nextSerial++);
+        if (loop) loops.push_back(regions.size() - 1);
+        scopes.push_back(declared.size());
+    }
+
+    void ExpressionTable::exitScope() {
+        for (auto i = scopes.back(); i < declared.size(); i++) version(declared[i])++;
+        declared.resize(scopes.back());
+        scopes.pop_back();
+    }
+
+    void ExpressionTable::exitRegion() {
+        if (!loops.empty() && loops.back() == regions.size() - 1) loops.pop_back();
+        regions.pop_back();
+    }
+
+    void ExpressionTable::clear() {
+        slots.assign(INITIAL_SLOTS, Entry());
+        usedSlots = 0;
+        versions.clear();
+        regions.assign(1, 0);
+        loops.clear();
+        nextSerial = 1;
+        declared.clear();
+        scopes.clear();
+        fetched.clear();
+        declaration = declarationCount = 0;
+    }
+}
@@ -0,0 +1,100 @@
+//
+// Created by junior on 19-6-10.
+//
+/**
+ * --hash-cons: 语法分析时对表达式做 hash-consing, 相同的纯表达式只建一个节点, 表达式树变成 DAG.
+ * 相同指的是 (种类, 属性, 子节点) 都相同, 子节点本身已经共享过, 所以只需要比较子节点的指针.
+ *
+ * 共享的节点只做一次类型检查(只有一个 type), 而且在每个出现的位置值都相同:
+ * 代码生成可以在一个出现的位置算出它的值, 在它支配的后面的出现位置直接使用. 为了保证这一点:
+ * 1. ID 的键里还有名字的版本号. 赋值, read, 声明都让版本号加一, 离开块作用域时在里面声明的名字也加一
+ *    (外层的同名变量重新可见), 所以版本号相同的两个 ID 是同一个变量的同一个值;
+ * 2. 节点只在建它的区域里可见: if 的分支里建的节点离开分支以后不再共享; 循环体和循环条件每一轮都重新执行,
+ *    所以循环里也看不到循环之前建的节点;
+ * 3. 常量在任何地方都可以共享.
+ *
+ * 声明语句先登记整个变量表再计算初始化表达式(见 Analyser), 如果初始化表达式用到了同一个变量表里后面才声明的名字,
+ * declare() 返回 true, 语法分析器要把之前的初始化表达式换成不共享的副本. 表里原来的节点已经不在树上了,
+ * 所以这时当前区域重新编号, 之后不再和区域里已有的节点共享.
+ *
+ * 被共享的节点 TreeNode::shared 为 true, 只想访问一次的访问者在 skip() 里调用 TreeVisitor::revisit().
+ * 只有递归下降分析器支持, 不能和 --ll1 一起使用.
+ */
+
+#ifndef COMPILER_EXPRESSIONTABLE_H
+#define COMPILER_EXPRESSIONTABLE_H
+
+#include "Compiler.h"
+#include "Parser.h"
+
+namespace Compiler::Parser {
+    class ExpressionTable {
+    private:
+        /**
+         * 开放寻址(线性探测)的哈希表, 容量为2的幂, 负载不超过1/2. 键相同的节点在表里最多只有一项,
+         * 不可见的旧节点被同样的键的新节点覆盖. 所在区域已经结束的项在扩容时丢掉.
+         */
+        struct Entry {
+            TreeNode::ptr node = nullptr; // nullptr 表示空槽
+            uint64_t hash = 0;
+            uint32_t version = 0;         // ID 的版本号, 其他节点为0
+            uint32_t depth = 0;           // 建节点时所在的区域: regions 的层次和那一层的编号
+            uint32_t serial = 0;
+        };
+        static constexpr size_t INITIAL_SLOTS = 1024;
+
+        std::vector<Entry> slots;
+        size_t usedSlots = 0;
+
+        std::vector<uint32_t> versions;    // atom.id => 版本号
+        std::vector<uint32_t> regions{0};  // 区域栈, 每层是区域的编号, 第0层是整个程序
+        std::vector<size_t> loops;         // 循环区域在 regions 里的层次
+        uint32_t nextSerial = 1;
+
+        std::vector<atom_t> declared;      // 块作用域里声明的名字, 离开作用域时版本号加一
+        std::vector<size_t> scopes;        // 每层块作用域在 declared 里的起点
+
+        std::vector<uint32_t> fetched;     // atom.id => 最后一次在哪条声明语句里作为 ID 出现
+        uint32_t declaration = 0;          // 正在分析的声明语句的编号, 0 表示不在声明语句里
+        uint32_t declarationCount = 0;
+
+        uint32_t &version(atom_t name);
+
+        bool visible(const Entry &entry) const;
+
+        void grow();
+
+    public:
+        ExpressionTable() : slots(INITIAL_SLOTS) {}
+
+        /**
+         * 刚建好的表达式节点 n(子节点都已经共享过): 有可见的相同节点时返回那个节点, 否则登记 n 并返回 n.
+         */
+        TreeNode::ptr share(TreeNode::ptr n);
+
+        void beginDeclaration() { declaration = ++declarationCount; }
+
+        void endDeclaration() { declaration = 0; }
+
+        /**
+         * 声明变量 name. 返回 true 表示这条声明语句在声明 name 之前已经读取过 name.
+         */
+        bool declare(atom_t name);
+
+        // 赋值或者 read: name 的值改变了
+        void assign(atom_t name) { version(name)++; }
+
+        // 进入 if 的分支或者循环(循环体和条件), 同时也是一层块作用域
+        void enterBlock(bool loop);
+
+        // 块作用域结束(循环体的作用域到循环条件之后才结束, 循环条件可以读取循环体里声明的变量)
+        void exitScope();
+
+        void exitRegion();
+
+        // 开始分析一个新文件, 之前的节点都已经释放
+        void clear();
+    };
+}
+
+#endif //COMPILER_EXPRESSIONTABLE_H
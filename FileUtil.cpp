@@ -3,19 +3,105 @@
 //
 
 #include "FileUtil.h"
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace Compiler::FileUtil {
-    std::vector<std::pair<string_t, FILE *>> files;
-
-    void readFromFile(int fileCount, char *fileName[]) {
-        for (int i = 0; i < fileCount; i++) {
-            FILE *file = fopen(fileName[i], "r");
-            if (file == nullptr) {
-                fprintf(stderr, "File %s not found!\n", fileName[i]);
-                exit(1);
+    BlockReader::BlockReader(int fd) : fd(fd) {
+        buffers[0] = std::make_unique<char_t[]>(STREAM_BLOCK_SIZE);
+        buffers[1] = std::make_unique<char_t[]>(STREAM_BLOCK_SIZE);
+    }
+
+    BlockReader::~BlockReader() {
+        if (pending.valid()) pending.wait(); // 等后台的 read() 结束再释放缓冲块
+    }
+
+    // 尽量把一块填满(管道每次 read 只能读到一部分), 返回值小于块大小就说明已经读到文件尾
+    size_t BlockReader::fill(int index) {
+        size_t count = 0;
+        while (count < STREAM_BLOCK_SIZE) {
+            ssize_t n = read(fd, buffers[index].get() + count, STREAM_BLOCK_SIZE - count);
+            if (n > 0) {
+                count += (size_t) n;
+            } else if (n == 0) {
+                break;
+            } else if (errno != EINTR) {
+                fprintf(stderr, "Read fail: %s\n", strerror(errno));
+                break;
+            }
+        }
+        return count;
+    }
+
+    bool BlockReader::next(const char_t *&begin, const char_t *&end) {
+        if (finished) return false;
+        if (!pending.valid()) { // 第一次读取
+            pending = std::async(std::launch::async, &BlockReader::fill, this, 1 - current);
+        }
+        size_t count = pending.get();
+        current = 1 - current;
+        if (count == STREAM_BLOCK_SIZE) {
+            // 后台开始填充另一块(上一次扫描的那块), 同时 Scanner 扫描当前块
+            pending = std::async(std::launch::async, &BlockReader::fill, this, 1 - current);
+        } else {
+            finished = true; // 这一块没有填满, 后面已经没有内容了
+        }
+        if (count == 0) return false;
+        begin = buffers[current].get();
+        end = begin + count;
+        return true;
+    }
+
+    bool openFile(const char *fileName, SourceFile &source) {
+        if (strcmp(fileName, "-") == 0) {
+            source.name = "stdin";
+            source.fd = dup(STDIN_FILENO);
+        } else {
+            source.name = fileName;
+            source.fd = open(fileName, O_RDONLY);
+        }
+        if (source.fd < 0) return false;
+        struct stat st{};
+        if (fstat(source.fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+            void *addr = mmap(nullptr, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, source.fd, 0);
+            if (addr != MAP_FAILED) {
+                // 只会顺序扫描一遍,提示内核积极预读
+                madvise(addr, (size_t) st.st_size, MADV_SEQUENTIAL);
+                source.mapping = static_cast<const char_t *>(addr);
+                source.size = (size_t) st.st_size;
             }
-            files.emplace_back(string_t(fileName[i]), file);
         }
+        if (source.mapping == nullptr) {
+            source.reader = std::make_unique<BlockReader>(source.fd);
+        }
+        return true;
+    }
+
+    bool nextBlock(SourceFile &file, const char_t *&begin, const char_t *&end) {
+        if (file.reader != nullptr) {
+            return file.reader->next(begin, end);
+        }
+        if (file.delivered || file.mapping == nullptr) return false;
+        file.delivered = true;
+        begin = file.mapping;
+        end = file.mapping + file.size;
+        return true;
     }
 
-}
\ No newline at end of file
+    bool closeFile(SourceFile &file) {
+        bool success = true;
+        file.reader = nullptr;
+        if (file.mapping != nullptr) {
+            success = munmap(const_cast<char_t *>(file.mapping), file.size) == 0;
+            file.mapping = nullptr;
+        }
+        if (file.fd >= 0) {
+            success = close(file.fd) == 0 && success;
+            file.fd = -1;
+        }
+        return success;
+    }
+}
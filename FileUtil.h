@@ -19,8 +19,66 @@ namespace Compiler::FileUtil {
     // https://blog.csdn.net/u014357799/article/details/79121340.
     // https://blog.csdn.net/supervictim/article/details/50458259.
 
-    extern std::vector<std::pair<string_t, FILE *>> files;
+    /**
+     * 双缓冲的流式读取器, 用于管道和标准输入这类无法 mmap 的输入.
+     * 两个 STREAM_BLOCK_SIZE 大小的缓冲块交替使用: Scanner 扫描其中一块的同时,
+     * 后台线程用 read() 填充另一块. 单行长度同样没有限制.
+     */
+    class BlockReader {
+    public:
+        explicit BlockReader(int fd);
 
-    void readFromFile(int fileCount, char *fileName[]);
+        ~BlockReader();
+
+        BlockReader(BlockReader const &) = delete;
+
+        void operator=(BlockReader const &) = delete;
+
+        /**
+         * 切换到下一个已经填充好的缓冲块,并开始在后台填充刚刚扫描完的那一块.
+         * 调用之后上一块的内容就会被覆盖,调用者需要自己保存还没有扫描完的Token.
+         */
+        bool next(const char_t *&begin, const char_t *&end);
+
+    private:
+        size_t fill(int index);
+
+        int fd;
+        std::unique_ptr<char_t[]> buffers[2];
+        int current = 1;           // 正在被扫描的缓冲块
+        std::future<size_t> pending; // 后台正在填充的缓冲块(另一块)
+        bool finished = false;
+    };
+
+    /**
+     * 源文件.
+     * 普通文件直接用 mmap 整个映射到内存, Scanner 在映射区上逐字节扫描, Token 只持有指向映射区的视图,
+     * 这样既省掉了每行一次的 fgets 系统调用和每个 Token 一次的堆分配, 也不再有单行长度的限制.
+     * 无法映射的输入(空文件, 管道, 标准输入"-")通过 BlockReader 分块流式读取.
+     */
+    struct SourceFile {
+        string_t name;
+        int fd = -1;
+        const char_t *mapping = nullptr; // mmap 映射区首地址, 没有映射时为 nullptr
+        size_t size = 0;                 // 映射区长度
+        bool delivered = false;          // 映射区是否已经交给 Scanner
+        std::unique_ptr<BlockReader> reader; // 流式读取器, 映射成功时为 nullptr
+    };
+
+    /**
+     * 打开一个源文件, 文件名为"-"时读取标准输入. 打不开时返回false.
+     */
+    bool openFile(const char *fileName, SourceFile &source);
+
+    /**
+     * 取下一块可以扫描的内容 [begin, end), 保证非空. 映射的文件第一次调用就返回整个映射区,
+     * 流式读取的文件每次返回一个缓冲块. 没有更多内容时返回false.
+     */
+    bool nextBlock(SourceFile &file, const char_t *&begin, const char_t *&end);
+
+    /**
+     * 释放源文件的映射区和文件描述符. 成功返回true.
+     */
+    bool closeFile(SourceFile &file);
 }
 #endif //SCANNER_FILEUTIL_H
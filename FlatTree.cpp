@@ -0,0 +1,100 @@
+//
+// Created by junior on 19-5-26.
+//
+
+#include "FlatTree.h"
+
+namespace Compiler::Parser {
+    uint32_t encodeAttribute(const TreeNode &n, FlatTree &tree) {
+        switch (n.attribute.index()) {
+            case 1:
+                return (uint32_t) std::get<TokenType>(n.attribute);
+            case 2:
+                return (uint32_t) std::get<int_t>(n.attribute);
+            case 3: {
+                uint32_t bits;
+                auto value = std::get<float_t>(n.attribute);
+                memcpy(&bits, &value, sizeof(bits));
+                return bits;
+            }
+            case 4:
+                tree.doubles.push_back(std::get<double_t>(n.attribute));
+                return (uint32_t) (tree.doubles.size() - 1);
+            case 5:
+                return (uint32_t) std::get<bool_t>(n.attribute);
+            case 6:
+                return std::get<atom_t>(n.attribute).id;
+            default:
+                return 0;
+        }
+    }
+
+    /**
+     * 按后序输出从 n 开始的兄弟链, 返回 n 的下标.
+     * 用显式栈代替递归, 栈里每一项是一条正在输出的兄弟链: 当前节点, 它已经输出的子节点下标, 以及链的首尾.
+     * 当前节点的子节点都输出以后才输出它自己, 然后换成它的兄弟节点; 整条链输出完, 链首的下标交给上一层.
+     * 共享的节点(--hash-cons)只输出一次, 之后的父节点直接指向第一次输出的下标, 扁平形式仍然是 DAG.
+     */
+    uint32_t emit(TreeNode::ptr n, FlatTree &tree) {
+        struct Chain {
+            TreeNode::ptr node;
+            size_t next = 0;
+            std::array<uint32_t, 3> children{};
+            uint32_t first = FlatTree::NONE, previous = FlatTree::NONE;
+        };
+        std::vector<Chain> stack{Chain{n}};
+        std::unordered_map<const TreeNode *, uint32_t> emitted; // 已经输出的共享节点
+        for (;;) {
+            auto &chain = stack.back();
+            if (chain.node == nullptr) {
+                auto first = chain.first;
+                stack.pop_back();
+                if (stack.empty()) return first;
+                auto &parent = stack.back();
+                parent.children[parent.next++] = first;
+                continue;
+            }
+            if (chain.next < chain.node->children.size()) {
+                auto child = chain.node->children[chain.next];
+                if (child == nullptr) {
+                    chain.children[chain.next++] = FlatTree::NONE;
+                } else if (auto found = child->shared ? emitted.find(child) : emitted.end(); found != emitted.end()) {
+                    chain.children[chain.next++] = found->second;
+                } else {
+                    stack.push_back(Chain{child});
+                }
+                continue;
+            }
+
+            auto current = chain.node;
+            FlatNode node{};
+            node.stmtOrExp = (uint8_t) current->stmt_or_exp;
+            node.kind = current->stmt_or_exp == StmtOrExp::StmtK ? (uint8_t) std::get<StmtKind>(current->kind)
+                                                               : (uint8_t) std::get<ExpKind>(current->kind);
+            node.type = (uint8_t) current->type;
+            node.attributeKind = (uint8_t) current->attribute.index();
+            node.childCount = (uint8_t) current->children.size();
+            node.shared = (uint8_t) current->shared;
+            node.lineNumber = (uint32_t) current->lineNumber;
+            node.children = (uint32_t) tree.edges.size();
+            node.sibling = FlatTree::NONE;
+            node.attribute = encodeAttribute(*current, tree);
+            tree.edges.insert(tree.edges.end(), chain.children.begin(), chain.children.begin() + node.childCount);
+
+            auto index = (uint32_t) tree.nodes.size();
+            tree.nodes.push_back(node);
+            if (current->shared) emitted.emplace(current, index);
+            if (chain.previous != FlatTree::NONE) tree.nodes[chain.previous].sibling = index;
+            else chain.first = index;
+            chain.previous = index;
+            chain.node = current->sibling;
+            chain.next = 0;
+        }
+    }
+
+    FlatTree flatten(TreeNode::ptr root) {
+        FlatTree tree;
+        tree.root = emit(root, tree);
+        return tree;
+    }
+}
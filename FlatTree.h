@@ -0,0 +1,81 @@
+//
+// Created by junior on 19-5-26.
+//
+/**
+ * 扁平语法树: 所有节点按后序存放在一个连续数组里, 节点之间用32位下标连接.
+ *
+ * 后序指的是 先子节点, 再节点本身, 再兄弟节点(也就是 TreeVisitor 调用 leave 的顺序),
+ * 所以自底向上的遍历(比如类型检查)只需要从头到尾扫一遍数组, 处理一个节点时它的子节点一定已经处理过了.
+ *
+ * 每个节点只有24个字节, 属性统一是32位: 运算符/类型Token, int, float(按位保存), bool, atom 直接存放,
+ * double 放在单独的常量表 doubles 里, 节点只存下标. 子节点的下标连续存放在 edges 里.
+ */
+
+#ifndef COMPILER_FLATTREE_H
+#define COMPILER_FLATTREE_H
+
+#include "Compiler.h"
+#include "Parser.h"
+
+namespace Compiler::Parser {
+    struct FlatNode {
+        uint8_t stmtOrExp;
+        uint8_t kind;          // StmtKind 或者 ExpKind
+        uint8_t type;          // Type
+        uint8_t attributeKind; // 和 TreeNode::attribute.index() 相同, 0 表示空属性
+        uint8_t childCount;
+        uint8_t shared;        // --hash-cons 时被多个父节点共享, 只在第一次出现的位置存放一份
+        uint32_t lineNumber;
+        uint32_t children;     // 第一个子节点在 edges 里的位置
+        uint32_t sibling;      // 下一个兄弟节点, 没有则为 FlatTree::NONE
+        uint32_t attribute;
+
+        bool isStatement() const { return stmtOrExp == (uint8_t) StmtOrExp::StmtK; }
+
+        StmtKind stmtKind() const { return (StmtKind) kind; }
+
+        ExpKind expKind() const { return (ExpKind) kind; }
+
+        Type getType() const { return (Type) type; }
+
+        void setType(Type t) { type = (uint8_t) t; }
+    };
+
+    struct FlatTree {
+        static constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+        std::vector<FlatNode> nodes;
+        std::vector<uint32_t> edges;   // 子节点下标, 语法错误时可能是 NONE
+        std::vector<double_t> doubles; // ConstDouble 的值
+        uint32_t root = NONE;          // 第一条语句
+
+        uint32_t child(const FlatNode &n, size_t i) const {
+            return i < n.childCount ? edges[n.children + i] : NONE;
+        }
+
+        TokenType token(const FlatNode &n) const { return (TokenType) n.attribute; }
+
+        int_t integer(const FlatNode &n) const { return (int_t) n.attribute; }
+
+        float_t real(const FlatNode &n) const {
+            float_t value;
+            memcpy(&value, &n.attribute, sizeof(value));
+            return value;
+        }
+
+        double_t real64(const FlatNode &n) const { return doubles[n.attribute]; }
+
+        bool_t boolean(const FlatNode &n) const { return (bool_t) n.attribute; }
+
+        atom_t atom(const FlatNode &n) const { return atom_t{n.attribute}; }
+    };
+
+    static_assert(sizeof(FlatNode) == 24, "FlatNode should stay compact");
+
+    /**
+     * 把 parse() 得到的语法树转换成扁平形式(一次遍历). 转换完以后原来的树就可以用 clearAll() 释放了.
+     */
+    FlatTree flatten(TreeNode::ptr root);
+}
+
+#endif //COMPILER_FLATTREE_H
@@ -0,0 +1,794 @@
+//
+// Created by junior on 19-6-9.
+//
+
+#include "Optimizer.h"
+#include "Exception.h"
+#include "TreeVisitor.h"
+#include "CompilerContext.h"
+
+namespace Compiler::Optimizer {
+    size_t node_bytes(const TreeNode &n) {
+        return sizeof(TreeNode) + n.children.size() * sizeof(TreeNode::ptr);
+    }
+
+    size_t node_bytes(const FlatNode &n) {
+        return sizeof(FlatNode) + n.childCount * sizeof(uint32_t);
+    }
+
+    /**
+     * 编译期的常量值. type 为 Void 表示不是可以折叠的常量(ID, 字符串常量, 还没有折叠的运算).
+     */
+    struct Constant {
+        Type type = Type::Void;
+        union {
+            int_t integer = 0;
+            float_t real;
+            double_t real64;
+            bool boolean;
+        };
+    };
+
+    // 把数值常量转换成 T(int => float/double 的提升)
+    template<typename T>
+    T value_as(const Constant &c) {
+        switch (c.type) {
+            case Type::Integer:
+                return (T) c.integer;
+            case Type::Float:
+                return (T) c.real;
+            default:
+                return (T) c.real64;
+        }
+    }
+
+    bool is_zero(const Constant &c) {
+        return c.type != Type::Void && c.type != Type::Boolean && value_as<double_t>(c) == 0;
+    }
+
+    // 双目数值运算, 调用前已经排除了除数为 0
+    template<typename T>
+    T arithmetic(TokenType op, T a, T b) {
+        if constexpr (std::is_integral_v<T>) {
+            // 按32位补码回绕, 避免有符号溢出(INT_MIN / -1 也是溢出)
+            auto x = (uint32_t) a, y = (uint32_t) b;
+            switch (op) {
+                case TokenType::PLUS:
+                    return (T) (x + y);
+                case TokenType::MINUS:
+                    return (T) (x - y);
+                case TokenType::TIMES:
+                    return (T) (x * y);
+                case TokenType::OVER:
+                    return b == -1 ? (T) (0u - x) : a / b;
+                default:
+                    return b == -1 ? 0 : a % b;
+            }
+        } else {
+            switch (op) {
+                case TokenType::PLUS:
+                    return a + b;
+                case TokenType::MINUS:
+                    return a - b;
+                case TokenType::TIMES:
+                    return a * b;
+                case TokenType::OVER:
+                    return a / b;
+                default:
+                    return std::fmod(a, b);
+            }
+        }
+    }
+
+    template<typename T>
+    bool compare(TokenType op, T a, T b) {
+        switch (op) {
+            case TokenType::LT:
+                return a < b;
+            case TokenType::LE:
+                return a <= b;
+            case TokenType::BT:
+                return a > b;
+            case TokenType::BE:
+                return a >= b;
+            case TokenType::EQ:
+                return a == b;
+            default:
+                return a != b;
+        }
+    }
+
+    /**
+     * 计算 op 作用在常量 a, b(单目运算只用 a)上的结果, type 是类型检查得到的结果类型.
+     * 比较运算先把两个操作数转换成它们做算术运算时的类型再比较.
+     */
+    Constant evaluate(TokenType op, Type type, const Constant &a, const Constant &b) {
+        Constant result;
+        result.type = type;
+        switch (operatorClass(op)) {
+            case OperatorClass::Not:
+                result.boolean = !a.boolean;
+                break;
+            case OperatorClass::Logical:
+                result.boolean = op == TokenType::AND ? a.boolean && b.boolean : a.boolean || b.boolean;
+                break;
+            case OperatorClass::Arithmetic:
+                switch (type) {
+                    case Type::Integer:
+                        result.integer = arithmetic(op, a.integer, b.integer);
+                        break;
+                    case Type::Float:
+                        result.real = arithmetic(op, value_as<float_t>(a), value_as<float_t>(b));
+                        break;
+                    default:
+                        result.real64 = arithmetic(op, value_as<double_t>(a), value_as<double_t>(b));
+                        break;
+                }
+                break;
+            default:
+                switch (resultTypes[(size_t) OperatorClass::Arithmetic][(size_t) a.type][(size_t) b.type]) {
+                    case Type::Integer:
+                        result.boolean = compare(op, a.integer, b.integer);
+                        break;
+                    case Type::Float:
+                        result.boolean = compare(op, value_as<float_t>(a), value_as<float_t>(b));
+                        break;
+                    default:
+                        result.boolean = compare(op, value_as<double_t>(a), value_as<double_t>(b));
+                        break;
+                }
+                break;
+        }
+        return result;
+    }
+
+    void report_division_by_zero(int lineNumber) {
+        using namespace Compiler::Exception;
+        ExceptionHandle::getHandle().add_exception(ExceptionType::ANALYSIS_ERROR,
+                                                   "division by constant zero on line " + std::to_string(lineNumber));
+    }
+
+    /**
+     * 一个运算节点能不能折叠: 操作数都是常量, 而且不是除以常量 0(除以常量 0 时报错).
+     * a, b 是两个操作数的常量值(单目运算 b 为 Void).
+     */
+    bool foldable(TokenType op, unsigned operands, const Constant &a, const Constant &b, int lineNumber) {
+        if ((op == TokenType::OVER || op == TokenType::MOD) && is_zero(b)) {
+            report_division_by_zero(lineNumber);
+            return false;
+        }
+        return operatorClass(op) != OperatorClass::None && a.type != Type::Void &&
+               (operands == 1 || b.type != Type::Void);
+    }
+
+    ExpKind constant_kind(Type type) {
+        switch (type) {
+            case Type::Integer:
+                return ExpKind::ConstIntK;
+            case Type::Float:
+                return ExpKind::ConstFloatK;
+            case Type::Double:
+                return ExpKind::ConstDoubleK;
+            default:
+                return ExpKind::ConstBoolK;
+        }
+    }
+
+    Constant constant_of(const TreeNode &n) {
+        Constant c;
+        if (n.stmt_or_exp != StmtOrExp::ExpK) return c;
+        switch (std::get<ExpKind>(n.kind)) {
+            case ExpKind::ConstIntK:
+                c.type = Type::Integer;
+                c.integer = std::get<int_t>(n.attribute);
+                break;
+            case ExpKind::ConstFloatK:
+                c.type = Type::Float;
+                c.real = std::get<float_t>(n.attribute);
+                break;
+            case ExpKind::ConstDoubleK:
+                c.type = Type::Double;
+                c.real64 = std::get<double_t>(n.attribute);
+                break;
+            case ExpKind::ConstBoolK:
+                c.type = Type::Boolean;
+                c.boolean = std::get<bool_t>(n.attribute) == BOOL::TRUE;
+                break;
+            default:
+                break;
+        }
+        return c;
+    }
+
+    // 把运算节点就地改成常量节点, 父节点的指针不用改. 原来的子节点留在 arena 里, 随整棵树一起释放.
+    void set_constant(TreeNode &n, const Constant &c) {
+        n.kind = constant_kind(c.type);
+        switch (c.type) {
+            case Type::Integer:
+                n.attribute = c.integer;
+                break;
+            case Type::Float:
+                n.attribute = c.real;
+                break;
+            case Type::Double:
+                n.attribute = c.real64;
+                break;
+            default:
+                n.attribute = c.boolean ? BOOL::TRUE : BOOL::FALSE;
+                break;
+        }
+        n.children = ChildList();
+    }
+
+    // 后序遍历: 处理一个运算节点时, 它的常量子树已经折叠成常量节点
+    class ConstantFolder : public TreeVisitor<ConstantFolder> {
+    private:
+        Statistics &folded = CompilerContext::current().folded;
+
+    public:
+        bool skip(TreeNode &n) {
+            return revisit(n);
+        }
+
+        void leave(TreeNode &n) {
+            if (n.stmt_or_exp != StmtOrExp::ExpK || std::get<ExpKind>(n.kind) != ExpKind::OpK) return;
+            auto op = std::get<TokenType>(n.attribute);
+            auto a = constant_of(*n.children.at(0));
+            auto b = n.children.size() > 1 ? constant_of(*n.children[1]) : Constant();
+            if (foldable(op, (unsigned) n.children.size(), a, b, n.lineNumber)) {
+                for (auto child:n.children) { // 操作数都是常量叶子节点
+                    folded.nodes++;
+                    folded.bytes += node_bytes(*child);
+                }
+                folded.bytes += n.children.size() * sizeof(TreeNode::ptr);
+                set_constant(n, evaluate(op, n.type, a, b));
+            }
+        }
+    };
+
+    Constant constant_of(const FlatTree &tree, uint32_t index) {
+        Constant c;
+        if (index == FlatTree::NONE) return c;
+        auto &n = tree.nodes[index];
+        if (n.isStatement()) return c;
+        switch (n.expKind()) {
+            case ExpKind::ConstIntK:
+                c.type = Type::Integer;
+                c.integer = tree.integer(n);
+                break;
+            case ExpKind::ConstFloatK:
+                c.type = Type::Float;
+                c.real = tree.real(n);
+                break;
+            case ExpKind::ConstDoubleK:
+                c.type = Type::Double;
+                c.real64 = tree.real64(n);
+                break;
+            case ExpKind::ConstBoolK:
+                c.type = Type::Boolean;
+                c.boolean = tree.boolean(n) == BOOL::TRUE;
+                break;
+            default:
+                break;
+        }
+        return c;
+    }
+
+    // 属性的编码和 FlatTree.cpp 的 encodeAttribute 相同. 原来的子节点仍然在数组里, 只是不再有节点指向它们.
+    void set_constant(FlatTree &tree, FlatNode &n, const Constant &c) {
+        n.kind = (uint8_t) constant_kind(c.type);
+        n.childCount = 0;
+        switch (c.type) {
+            case Type::Integer:
+                n.attributeKind = 2;
+                n.attribute = (uint32_t) c.integer;
+                break;
+            case Type::Float:
+                n.attributeKind = 3;
+                memcpy(&n.attribute, &c.real, sizeof(n.attribute));
+                break;
+            case Type::Double:
+                n.attributeKind = 4;
+                tree.doubles.push_back(c.real64);
+                n.attribute = (uint32_t) (tree.doubles.size() - 1);
+                break;
+            default:
+                n.attributeKind = 5;
+                n.attribute = (uint32_t) (c.boolean ? BOOL::TRUE : BOOL::FALSE);
+                break;
+        }
+    }
+
+    // 扁平语法树按后序存放, 从头到尾扫一遍就是后序遍历
+    void fold_constants(FlatTree &tree) {
+        auto &folded = CompilerContext::current().folded;
+        for (auto &n:tree.nodes) {
+            if (n.isStatement() || n.expKind() != ExpKind::OpK) continue;
+            auto op = tree.token(n);
+            auto a = constant_of(tree, tree.child(n, 0));
+            auto b = constant_of(tree, tree.child(n, 1));
+            if (foldable(op, n.childCount, a, b, (int) n.lineNumber)) {
+                for (size_t i = 0; i < n.childCount; i++) {
+                    folded.nodes++;
+                    folded.bytes += node_bytes(tree.nodes[tree.child(n, i)]);
+                }
+                folded.bytes += n.childCount * sizeof(uint32_t);
+                set_constant(tree, n, evaluate(op, n.getType(), a, b));
+            }
+        }
+    }
+
+    // 常量条件: 条件表达式已经折叠成 bool 常量时返回 TRUE/FALSE, 否则返回 nullopt
+    std::optional<bool> constant_condition(TreeNode::ptr condition) {
+        if (condition == nullptr) return std::nullopt;
+        auto c = constant_of(*condition);
+        if (c.type != Type::Boolean) return std::nullopt;
+        return c.boolean;
+    }
+
+    std::optional<bool> constant_condition(const FlatTree &tree, uint32_t condition) {
+        auto c = constant_of(tree, condition);
+        if (c.type != Type::Boolean) return std::nullopt;
+        return c.boolean;
+    }
+
+    // 每个名字作为表达式(ID)被读取的次数, 以及作为 read 语句目标的次数
+    struct Uses {
+        std::vector<uint32_t> reads;
+        std::vector<uint32_t> inputs;
+        std::unordered_map<const TreeNode *, uint32_t> references; // 共享的节点(--hash-cons)在树里出现的次数
+
+        void reset() {
+            reads.assign(AtomTable::getInstance().size(), 0);
+            inputs.assign(AtomTable::getInstance().size(), 0);
+            references.clear();
+        }
+    };
+
+    // 共享的节点在每个出现的位置都算一次
+    class UseCounter : public TreeVisitor<UseCounter> {
+    private:
+        Uses &uses;
+
+    public:
+        explicit UseCounter(Uses &uses) : uses(uses) {}
+
+        void enter(TreeNode &n) {
+            if (n.shared) uses.references[&n]++;
+            if (n.stmt_or_exp == StmtOrExp::ExpK) {
+                if (std::get<ExpKind>(n.kind) == ExpKind::IdK) uses.reads[std::get<atom_t>(n.attribute).id]++;
+            } else if (std::get<StmtKind>(n.kind) == StmtKind::ReadK) {
+                uses.inputs[std::get<atom_t>(n.attribute).id]++;
+            }
+        }
+    };
+
+    /**
+     * 统计删掉的一条兄弟链以及所有子树的节点数和字节数, 同时从 uses 里减掉其中的 ID 和 read 语句.
+     * 共享的节点(--hash-cons)每删掉一次出现就减一次引用, 减到 0 才真的删掉; 别处还在用的共享节点连同它的子树都不统计,
+     * 但子树里的读取和共享节点的引用照样要减掉.
+     */
+    class TreeMeter : public TreeVisitor<TreeMeter> {
+    private:
+        Statistics &statistics;
+        Uses &uses;
+        const TreeNode *kept = nullptr; // 别处还在用的共享子树的根
+
+    public:
+        TreeMeter(Statistics &statistics, Uses &uses) : statistics(statistics), uses(uses) {}
+
+        void enter(TreeNode &n) {
+            if (n.shared && --uses.references[&n] != 0 && kept == nullptr) kept = &n;
+            if (kept == nullptr) {
+                statistics.nodes++;
+                statistics.bytes += node_bytes(n);
+            }
+            if (n.stmt_or_exp == StmtOrExp::ExpK) {
+                if (std::get<ExpKind>(n.kind) == ExpKind::IdK) uses.reads[std::get<atom_t>(n.attribute).id]--;
+            } else if (std::get<StmtKind>(n.kind) == StmtKind::ReadK) {
+                uses.inputs[std::get<atom_t>(n.attribute).id]--;
+            }
+        }
+
+        void leave(TreeNode &n) {
+            if (kept == &n) kept = nullptr;
+        }
+    };
+
+    // 语句链的顶层有没有声明语句(有的话它是一层独立的作用域, 不能直接接到外层的语句链里)
+    bool declares(TreeNode::ptr head) {
+        for (auto p = head; p != nullptr; p = p->sibling) {
+            if (p->stmt_or_exp == StmtOrExp::StmtK && std::get<StmtKind>(p->kind) == StmtKind::DeclarationK) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * 死代码消除(指针形式). 每一趟先统计每个名字的读取次数, 再逐条语句链检查:
+     *  if 条件是常量: 只留下会执行的分支; repeat ... until true 和 do ... while false 只执行一次, 只留下循环体;
+     *      留下的语句序列顶层没有声明时接到外层的语句链里, 否则保留原来的语句(和它的作用域), 只删掉不执行的分支.
+     *      两个分支都已经为空的 if 整个删掉. 循环即使循环体为空也要保留(可能是死循环).
+     *  赋值给从来不被读取的名字: 删掉整条赋值语句;
+     *  声明从来不被读取的名字: 删掉初始化表达式, 如果也不是 read 的目标, 把变量从声明里删掉, 变量都删掉了就删掉整条声明.
+     * 表达式没有副作用, 可以整棵删掉; read/write 语句是输入输出, 一律保留.
+     * 删掉赋值可能让别的名字也不再被读取, 所以重复到某一趟没有任何改变为止.
+     * 读取次数只在开始时统计一次, 删掉子树时随之减掉, 之后每一趟只走语句链, 不再遍历表达式.
+     * 名字按 atom 统计, 不区分同名的不同作用域的变量, 只会少删不会多删.
+     */
+    class DeadCodeEliminator {
+    private:
+        Uses uses;
+        TreeMeter meter{CompilerContext::current().eliminated, uses};
+        std::vector<TreeNode::ptr *> chains; // 待处理的语句链(指向链首指针的位置)
+        bool changed = false;
+
+        // 删掉一个已经从链上摘下来的节点(连同子树)
+        void discard(TreeNode::ptr n) {
+            n->sibling = nullptr;
+            meter.traverse(n);
+            changed = true;
+        }
+
+        // 用语句序列 block 代替 *link 处的语句 n, n 的其余部分删掉
+        void splice(TreeNode::ptr *link, TreeNode::ptr n, size_t child) {
+            auto next = n->sibling;
+            auto block = child < n->children.size() ? n->children[child] : nullptr;
+            if (block != nullptr) n->children[child] = nullptr;
+            discard(n);
+            if (block == nullptr) {
+                *link = next;
+                return;
+            }
+            *link = block;
+            auto tail = block;
+            while (tail->sibling != nullptr) tail = tail->sibling;
+            tail->sibling = next;
+        }
+
+        // 处理一条语句链, 返回时 *link 之后的语句都已经处理过, 子语句链放进 chains
+        void sweep(TreeNode::ptr *link) {
+            while (*link != nullptr) {
+                auto n = *link;
+                if (n->stmt_or_exp != StmtOrExp::StmtK) {
+                    link = &n->sibling;
+                    continue;
+                }
+                switch (std::get<StmtKind>(n->kind)) {
+                    case StmtKind::IfK: {
+                        auto condition = constant_condition(n->children.at(0));
+                        if (condition) {
+                            size_t live = *condition ? 1 : 2;
+                            if (live >= n->children.size() || !declares(n->children[live])) {
+                                splice(link, n, live);
+                                continue; // 接进来的语句还要处理
+                            }
+                            if (live == 1 && n->children.size() == 3) {
+                                auto otherwise = n->children[2];
+                                n->children.pop_back();
+                                meter.traverse(otherwise);
+                                changed = true;
+                            } else if (live == 2 && n->children[1] != nullptr) {
+                                auto then = n->children[1];
+                                n->children[1] = nullptr;
+                                meter.traverse(then);
+                                changed = true;
+                            }
+                        }
+                        if (n->children.at(1) == nullptr && (n->children.size() < 3 || n->children[2] == nullptr)) {
+                            *link = n->sibling;
+                            discard(n);
+                            continue;
+                        }
+                        for (size_t i = 1; i < n->children.size(); i++) chains.push_back(&n->children[i]);
+                        break;
+                    }
+                    case StmtKind::RepeatK:
+                    case StmtKind::WhileK: {
+                        auto condition = constant_condition(n->children.at(1));
+                        bool repeat = std::get<StmtKind>(n->kind) == StmtKind::RepeatK;
+                        if (condition && *condition == repeat && !declares(n->children[0])) { // 只执行一次
+                            splice(link, n, 0);
+                            continue;
+                        }
+                        chains.push_back(&n->children[0]);
+                        break;
+                    }
+                    case StmtKind::AssignK:
+                        if (uses.reads[std::get<atom_t>(n->attribute).id] == 0) {
+                            *link = n->sibling;
+                            discard(n);
+                            continue;
+                        }
+                        break;
+                    case StmtKind::DeclarationK: {
+                        for (auto variable = &n->children[0]; *variable != nullptr;) {
+                            auto v = *variable;
+                            auto name = std::get<atom_t>(v->attribute).id;
+                            if (uses.reads[name] != 0) {
+                                variable = &v->sibling;
+                            } else if (uses.inputs[name] == 0) {
+                                *variable = v->sibling;
+                                discard(v);
+                            } else {
+                                if (!v->children.empty() && v->children[0] != nullptr) {
+                                    auto initializer = v->children[0];
+                                    v->children.pop_back();
+                                    meter.traverse(initializer);
+                                    changed = true;
+                                }
+                                variable = &v->sibling;
+                            }
+                        }
+                        if (n->children[0] == nullptr) {
+                            *link = n->sibling;
+                            discard(n);
+                            continue;
+                        }
+                        break;
+                    }
+                    default:
+                        break;
+                }
+                link = &n->sibling;
+            }
+        }
+
+    public:
+        void run(TreeNode::ptr &root) {
+            uses.reset();
+            UseCounter(uses).traverse(root);
+            do {
+                changed = false;
+                chains.push_back(&root);
+                while (!chains.empty()) {
+                    auto link = chains.back();
+                    chains.pop_back();
+                    sweep(link);
+                }
+            } while (changed);
+        }
+    };
+
+    /**
+     * 扁平语法树上的死代码消除, 规则和指针形式完全相同. 链接都是下标: 子节点在 edges 里, 兄弟在 sibling 里,
+     * 删掉的节点仍然在数组里, 只是不再有下标指向它们, 所以这里的遍历都从 root 沿着链接走, 不能扫整个数组.
+     */
+    class FlatDeadCodeEliminator {
+    private:
+        FlatTree &tree;
+        Uses uses;
+        Statistics &eliminated = CompilerContext::current().eliminated;
+        std::vector<std::pair<uint32_t, bool>> stack;
+        std::vector<uint32_t *> chains;
+        std::vector<uint32_t> references; // 共享的节点(--hash-cons)在树里出现的次数, 没有共享的节点时为空
+        bool changed = false;
+
+        uint32_t *edge(FlatNode &n, size_t i) {
+            return &tree.edges[n.children + i];
+        }
+
+        size_t indexOf(const FlatNode &n) const {
+            return (size_t) (&n - tree.nodes.data());
+        }
+
+        // 从 head 开始先序访问, chain 为 false 时不访问 head 的兄弟.
+        // visit(n, flag) 的返回值作为 n 的子节点的 flag, n 的兄弟和 n 用同一个 flag, head 的 flag 是 true
+        template<typename Visit>
+        void walk(uint32_t head, bool chain, Visit &&visit) {
+            stack.clear();
+            if (head != FlatTree::NONE) stack.emplace_back(head, true);
+            while (!stack.empty()) {
+                auto[i, flag] = stack.back();
+                stack.pop_back();
+                auto &n = tree.nodes[i];
+                bool inner = visit(n, flag);
+                if ((chain || i != head) && n.sibling != FlatTree::NONE) stack.emplace_back(n.sibling, flag);
+                for (size_t c = 0; c < n.childCount; c++) {
+                    if (tree.child(n, c) != FlatTree::NONE) stack.emplace_back(tree.child(n, c), inner);
+                }
+            }
+        }
+
+        // 和指针形式的 TreeMeter 一样: 共享的节点(--hash-cons)减到没有引用时才算删掉, flag 为 false 表示在别处还在用的子树里
+        void measure(uint32_t head, bool chain) {
+            walk(head, chain, [this](FlatNode &n, bool removed) {
+                if (n.shared && --references[indexOf(n)] != 0) removed = false;
+                if (removed) {
+                    eliminated.nodes++;
+                    eliminated.bytes += node_bytes(n);
+                }
+                if (!n.isStatement()) {
+                    if (n.expKind() == ExpKind::IdK) uses.reads[tree.atom(n).id]--;
+                } else if (n.stmtKind() == StmtKind::ReadK) {
+                    uses.inputs[tree.atom(n).id]--;
+                }
+                return removed;
+            });
+            changed = true;
+        }
+
+        void count() {
+            uses.reset();
+            references.clear();
+            walk(tree.root, true, [this](FlatNode &n, bool) {
+                if (n.shared) {
+                    if (references.empty()) references.resize(tree.nodes.size());
+                    references[indexOf(n)]++;
+                }
+                if (!n.isStatement()) {
+                    if (n.expKind() == ExpKind::IdK) uses.reads[tree.atom(n).id]++;
+                } else if (n.stmtKind() == StmtKind::ReadK) {
+                    uses.inputs[tree.atom(n).id]++;
+                }
+                return true;
+            });
+        }
+
+        bool declares(uint32_t head) const {
+            for (auto p = head; p != FlatTree::NONE; p = tree.nodes[p].sibling) {
+                auto &n = tree.nodes[p];
+                if (n.isStatement() && n.stmtKind() == StmtKind::DeclarationK) return true;
+            }
+            return false;
+        }
+
+        void splice(uint32_t *link, uint32_t index, size_t child) {
+            auto &n = tree.nodes[index];
+            auto next = n.sibling;
+            auto block = tree.child(n, child);
+            if (block != FlatTree::NONE) *edge(n, child) = FlatTree::NONE;
+            measure(index, false);
+            if (block == FlatTree::NONE) {
+                *link = next;
+                return;
+            }
+            *link = block;
+            auto tail = block;
+            while (tree.nodes[tail].sibling != FlatTree::NONE) tail = tree.nodes[tail].sibling;
+            tree.nodes[tail].sibling = next;
+        }
+
+        void sweep(uint32_t *link) {
+            while (*link != FlatTree::NONE) {
+                auto index = *link;
+                auto &n = tree.nodes[index];
+                if (!n.isStatement()) {
+                    link = &n.sibling;
+                    continue;
+                }
+                switch (n.stmtKind()) {
+                    case StmtKind::IfK: {
+                        auto condition = constant_condition(tree, tree.child(n, 0));
+                        if (condition) {
+                            size_t live = *condition ? 1 : 2;
+                            if (live >= n.childCount || !declares(tree.child(n, live))) {
+                                splice(link, index, live);
+                                continue;
+                            }
+                            if (live == 1 && n.childCount == 3) {
+                                auto otherwise = tree.child(n, 2);
+                                n.childCount--;
+                                measure(otherwise, true);
+                            } else if (live == 2 && tree.child(n, 1) != FlatTree::NONE) {
+                                auto then = tree.child(n, 1);
+                                *edge(n, 1) = FlatTree::NONE;
+                                measure(then, true);
+                            }
+                        }
+                        if (tree.child(n, 1) == FlatTree::NONE && tree.child(n, 2) == FlatTree::NONE) {
+                            *link = n.sibling;
+                            measure(index, false);
+                            continue;
+                        }
+                        for (size_t i = 1; i < n.childCount; i++) chains.push_back(edge(n, i));
+                        break;
+                    }
+                    case StmtKind::RepeatK:
+                    case StmtKind::WhileK: {
+                        auto condition = constant_condition(tree, tree.child(n, 1));
+                        bool repeat = n.stmtKind() == StmtKind::RepeatK;
+                        if (condition && *condition == repeat && !declares(tree.child(n, 0))) {
+                            splice(link, index, 0);
+                            continue;
+                        }
+                        chains.push_back(edge(n, 0));
+                        break;
+                    }
+                    case StmtKind::AssignK:
+                        if (uses.reads[tree.atom(n).id] == 0) {
+                            *link = n.sibling;
+                            measure(index, false);
+                            continue;
+                        }
+                        break;
+                    case StmtKind::DeclarationK: {
+                        for (auto variable = edge(n, 0); *variable != FlatTree::NONE;) {
+                            auto &v = tree.nodes[*variable];
+                            auto name = tree.atom(v).id;
+                            if (uses.reads[name] != 0) {
+                                variable = &v.sibling;
+                            } else if (uses.inputs[name] == 0) {
+                                auto removed = *variable;
+                                *variable = v.sibling;
+                                measure(removed, false);
+                            } else {
+                                if (tree.child(v, 0) != FlatTree::NONE) {
+                                    auto initializer = tree.child(v, 0);
+                                    v.childCount--;
+                                    measure(initializer, false);
+                                }
+                                variable = &v.sibling;
+                            }
+                        }
+                        if (tree.child(n, 0) == FlatTree::NONE) {
+                            *link = n.sibling;
+                            measure(index, false);
+                            continue;
+                        }
+                        break;
+                    }
+                    default:
+                        break;
+                }
+                link = &n.sibling;
+            }
+        }
+
+    public:
+        explicit FlatDeadCodeEliminator(FlatTree &tree) : tree(tree) {}
+
+        void run() {
+            count();
+            do {
+                changed = false;
+                chains.push_back(&tree.root);
+                while (!chains.empty()) {
+                    auto link = chains.back();
+                    chains.pop_back();
+                    sweep(link);
+                }
+            } while (changed);
+        }
+    };
+
+    void report_statistics() {
+        auto &context = CompilerContext::current();
+        auto &folded = context.folded, &eliminated = context.eliminated;
+        context.writer.printf("constant folding removed %zu nodes (%zu bytes), "
+                              "dead code elimination removed %zu nodes (%zu bytes)\n",
+                              folded.nodes, folded.bytes, eliminated.nodes, eliminated.bytes);
+        context.writer.flush();
+    }
+
+    void optimize(TreeNode::ptr &root) {
+        auto &context = CompilerContext::current();
+        context.folded = context.eliminated = Statistics();
+        if (options().foldConstants) {
+            ConstantFolder folder;
+            folder.traverse(root);
+        }
+        // 常量折叠报了除零错误就不再继续优化, 反正也不会生成代码
+        if (Exception::ExceptionHandle::getHandle().hasException()) return;
+        if (options().eliminateDeadCode) {
+            DeadCodeEliminator eliminator;
+            eliminator.run(root);
+        }
+        if (options().optimizerStatistics) report_statistics();
+    }
+
+    void optimize(FlatTree &tree) {
+        auto &context = CompilerContext::current();
+        context.folded = context.eliminated = Statistics();
+        if (options().foldConstants) {
+            fold_constants(tree);
+        }
+        if (Exception::ExceptionHandle::getHandle().hasException()) return;
+        if (options().eliminateDeadCode) {
+            FlatDeadCodeEliminator eliminator(tree);
+            eliminator.run();
+        }
+        if (options().optimizerStatistics) report_statistics();
+    }
+}
@@ -0,0 +1,43 @@
+//
+// Created by junior on 19-6-9.
+//
+/**
+ * 语义分析之后, 代码生成之前对语法树做的优化. 只在词法/语法/语义都没有错误时执行,
+ * 指针形式和扁平形式(--flat-ast)的结果相同.
+ *
+ * 常量折叠(--no-fold 关闭): 运算符的操作数全部是数值/bool常量时, 在编译期算出结果,
+ * 把整棵常量子树换成一个常量节点. 结果的类型就是类型检查得到的类型(TypeSystem.h 的类型格),
+ * int 和 float/double 混合运算时先把操作数转换成结果类型. int 运算按32位补码回绕.
+ * 除数(包括模运算)是常量 0 时报语义错误, 不管被除数是不是常量.
+ *
+ * 死代码消除(--no-dce 关闭), 在常量折叠之后:
+ * 1. 条件是常量的 if 只留下会执行的分支, repeat ... until true 和 do ... while false 只留下循环体;
+ * 2. 删掉给从来不被读取的变量的赋值和初始化, 以及既不被读取也不是 read 目标的变量的声明.
+ * 表达式没有副作用, read/write 语句一律保留. 删掉语句可能让语句链的链首改变, 所以 optimize 可能修改 root,
+ * 整个程序都被删掉时 root 为空.
+ *
+ * --opt-stats 输出两种优化各删掉了多少节点, 以及这些节点在语法树里占用的字节数.
+ */
+
+#ifndef COMPILER_OPTIMIZER_H
+#define COMPILER_OPTIMIZER_H
+
+#include "Compiler.h"
+#include "Parser.h"
+#include "FlatTree.h"
+
+namespace Compiler::Optimizer {
+    using namespace Compiler::Parser;
+
+    // 每个文件各个优化删掉的节点数和字节数(语法树本身占用的内存: 节点加上子节点数组), --opt-stats 输出
+    struct Statistics {
+        size_t nodes = 0;
+        size_t bytes = 0;
+    };
+
+    void optimize(TreeNode::ptr &root);
+
+    void optimize(FlatTree &tree);
+}
+
+#endif //COMPILER_OPTIMIZER_H
@@ -3,25 +3,55 @@
 //
 
 #include "Parser.h"
+#include "ParserTable.h"
 #include "Scanner.h"
 #include "Exception.h"
-#include "StringLiteralPool.h"
+#include "AtomTable.h"
+#include "Dump.h"
+#include "ExpressionTable.h"
+#include "CompilerContext.h"
 
 namespace Compiler::Parser {
-    /* global token */
-    Scanner::TokenRet token;
+    // 当前线程正在编译的文件的语法分析器. 下面的函数开头取出要用的成员的引用, 函数体和原来使用全局变量时一样
+    ParserState &state() {
+        return CompilerContext::current().parser;
+    }
+
+    /**
+     * 读取下一个Token. 批量模式按下标读取 TokenBuffer, 同时提交扫描这个Token时产生的词法错误;
+     * 流水线模式由 TokenPipeline 完成同样的事情.
+     */
+    Scanner::TokenRet nextToken() {
+        auto &parser = state();
+        if (parser.pipeline != nullptr) return parser.pipeline->next();
+        if (parser.tokens == nullptr) return Scanner::getToken();
+        auto &tokens = *parser.tokens;
+        auto &tokenIndex = parser.tokenIndex, &diagnosticIndex = parser.diagnosticIndex;
+        while (diagnosticIndex < tokens.diagnostics.size() && tokens.diagnostics[diagnosticIndex].first <= tokenIndex) {
+            Exception::ExceptionHandle::getHandle().add_exception(tokens.diagnostics[diagnosticIndex++].second);
+        }
+        if (tokenIndex < tokens.size()) {
+            return tokens.get(tokenIndex++);
+        }
+        // 越过 END_FILE 继续读取时和 Scanner 一样返回 END_FILE (Scanner 每次读到EOF行号都会加一)
+        auto last = tokens.get(tokens.size() - 1);
+        last.lineNumber += (int) (++tokenIndex - tokens.size());
+        return last;
+    }
 
     /* parse tree node */
     TreeNode::ptr newStatementNode(StmtKind stmtKind);
 
     TreeNode::ptr newExpressionNode(ExpKind expKind);
 
-    /* statement  */
-    TreeNode::ptr statement_sequence();
+    TreeNode::ptr newLeafNode();
 
-    TreeNode::ptr statement();
+    TreeNode::ptr share(TreeNode::ptr n);
 
-    TreeNode::ptr if_else_statement();
+    TreeNode::ptr copyExpression(TreeNode::ptr source);
+
+    /* statement  */
+    TreeNode::ptr statement_sequence();
 
     TreeNode::ptr assign_statement();
 
@@ -29,10 +59,6 @@ namespace Compiler::Parser {
 
     TreeNode::ptr declaration_statement();
 
-    TreeNode::ptr do_while_statement();
-
-    TreeNode::ptr repeat_until_statement();
-
     TreeNode::ptr read_statement();
 
     TreeNode::ptr write_statement();
@@ -40,20 +66,6 @@ namespace Compiler::Parser {
     /* expression */
     TreeNode::ptr expression();
 
-    TreeNode::ptr logical_or_expression();
-
-    TreeNode::ptr logical_and_expression();
-
-    TreeNode::ptr equality_expression();
-
-    TreeNode::ptr relational_expression();
-
-    TreeNode::ptr arithmetic_additive_expression();
-
-    TreeNode::ptr arithmetic_multiplicative_expression();
-
-    TreeNode::ptr factor_expression();
-
     /**
      * 提交语法错误
      * @param func_string 函数名字符串
@@ -61,98 +73,60 @@ namespace Compiler::Parser {
      */
     inline void report_syntax_error(const std::string &func_string, const std::string &expected_token_string) {
         using namespace Compiler::Exception;
+        auto &token = state().token;
         std::string message = func_string
                               + " unexpected token ["
                               + getTokenRepresentation(token.tokenType, token.tokenString)
                               + "], expected token ["
                               + expected_token_string
-                              + "] on line:" + std::to_string(Scanner::lineNumber);
+                              + "] on line:" + std::to_string(token.lineNumber);
         ExceptionHandle::getHandle().add_exception(ExceptionType::SYNTAX_ERROR, message);
     }
 
     inline void match(TokenType target) {
-        if (token.tokenType == target) token = Scanner::getToken();
+        auto &token = state().token;
+        if (token.tokenType == target) token = nextToken();
         else {
-            report_syntax_error("match()", getTokenRepresentation(target, nullptr));
+            report_syntax_error("match()", getTokenRepresentation(target));
         }
     }
 
-    /**
-     * if-else statement:
-     * C语言的文法是:
-     *  statement => ... | selection-statement
-     *  selection-statement => ... | if ( expression ) statement | if ( expression ) statement else statement
-     *  这个是有歧义的,对于 if (expr) if (expr) else stat 会有:
-     *  if (expr) { if (expr) else stat } 和
-     *  if (expr) { if (expr) } else stat 两种树.
-     *  C语言的解决方案是只选择第一颗树,即选择靠近else的if进行解析;
-     *  另外一种方案是引入更多的变量将它变成非歧义的文法,比如JAVA语言(参考Java的EBNF).
-     *
-     *  这里使用的是C的方案,即:
-     *  statement_sequence => statement {; statement }*
-     *  statement => if_else_statement | .. | ..
-     *  if_else_statement => if expression then statement_sequence end
-     *                   | if expression then statement_sequence else statement_sequence end
-     *  解析如下语句:
-     *           if expr then
-     *               if expr then
-     *                   stat_sequence
-     *               else
-     *                   stat_sequence
-     *               end
-     *           end
-     *  过程: Start -> ... -> if [expr] then [stat_sequence] end ->
-     *                ... -> if [expr] then [ if [expr] then [stat_sequence] else [stat_sequence] end ] end
-     */
-    TreeNode::ptr if_else_statement() {
-        TreeNode::ptr n = nullptr;
-        switch (token.tokenType) {
-            case TokenType::IF:
-                n = newStatementNode(StmtKind::IfK);
-                if (n != nullptr) {
-                    match(TokenType::IF);
-                    n->children.push_back(expression());
-                    match(TokenType::THEN);
-                    n->children.push_back(statement_sequence());
-                    if (token.tokenType == TokenType::ELSE) {
-                        match(TokenType::ELSE);
-                        n->children.push_back(statement_sequence());
-                    }
-                    match(TokenType::END);
-                }
-                break;
-            default:
-                report_syntax_error("if_else_statement()", getTokenRepresentation(TokenType::IF, nullptr));
-                break;
-        }
-        return n;
-    }
-
     /**
      * variable_list_statement => ID [:= expression](可选) { , ID [:= expression]}*
+     * 变量之间用兄弟链连接. 用循环而不是每个逗号递归一次, 一个声明里有很多变量时也不会栈溢出.
      */
     TreeNode::ptr variable_list_statement() {
-        TreeNode::ptr n = nullptr;
-        switch (token.tokenType) {
-            case TokenType::ID:
-                n = newStatementNode(StmtKind::VariableListK);
-                if (n != nullptr) {
-                    n->attribute = token.tokenString;
-                    match(TokenType::ID);
-                    if (token.tokenType == TokenType::ASSIGN) { // 可选分支
-                        match(TokenType::ASSIGN);
-                        n->children.push_back(expression());
-                    }
-                    if (token.tokenType == TokenType::COMMA) {
-                        match(TokenType::COMMA);
-                        n->sibling = variable_list_statement();
-                    }
-                }
+        auto &parser = state();
+        auto &token = parser.token;
+        auto &expressions = *parser.expressions;
+        TreeNode::ptr head = nullptr, tail = nullptr;
+        for (;;) {
+            if (token.tokenType != TokenType::ID) {
+                report_syntax_error("variable_list_statement()", getTokenRepresentation(TokenType::ID));
                 break;
-            default:
-                report_syntax_error("variable_list_statement()", getTokenRepresentation(TokenType::ID, nullptr));
+            }
+            auto n = newStatementNode(StmtKind::VariableListK);
+            auto name = AtomTable::getInstance().intern(token.tokenString);
+            n->attribute = name;
+            if (options().shareExpressions && expressions.declare(name)) {
+                // 前面的初始化表达式读取的 name 其实是这里声明的变量, 不能和之前的同名 ID 共享
+                for (auto p = head; p != nullptr; p = p->sibling) {
+                    if (!p->children.empty()) p->children[0] = copyExpression(p->children[0]);
+                }
+            }
+            match(TokenType::ID);
+            if (token.tokenType == TokenType::ASSIGN) { // 可选分支
+                match(TokenType::ASSIGN);
+                n->children.push_back(expression());
+                if (options().shareExpressions) expressions.assign(name);
+            }
+            if (head == nullptr) head = n;
+            else tail->sibling = n;
+            tail = n;
+            if (token.tokenType != TokenType::COMMA) break;
+            match(TokenType::COMMA);
         }
-        return n;
+        return head;
     }
 
     /**
@@ -160,6 +134,9 @@ namespace Compiler::Parser {
      * 对变量进行声明
      */
     TreeNode::ptr declaration_statement() {
+        auto &parser = state();
+        auto &token = parser.token;
+        auto &expressions = *parser.expressions;
         TreeNode::ptr n = nullptr;
         switch (token.tokenType) {
             case TokenType::INT:
@@ -171,7 +148,9 @@ namespace Compiler::Parser {
                 if (n != nullptr) {
                     n->attribute = token.tokenType;
                     match(token.tokenType);
+                    if (options().shareExpressions) expressions.beginDeclaration();
                     n->children.push_back(variable_list_statement());
+                    if (options().shareExpressions) expressions.endDeclaration();
                 }
                 break;
             default:
@@ -185,63 +164,24 @@ namespace Compiler::Parser {
      * assign_statement => ID := expression (赋值语句. 注意对变量ID的任何赋值之前必须先存在声明)
      */
     TreeNode::ptr assign_statement() {
+        auto &parser = state();
+        auto &token = parser.token;
+        auto &expressions = *parser.expressions;
         TreeNode::ptr n = nullptr;
         switch (token.tokenType) {
             case TokenType::ID:
                 n = newStatementNode(StmtKind::AssignK);
                 if (n != nullptr) {
-                    n->attribute = token.tokenString;
+                    auto name = AtomTable::getInstance().intern(token.tokenString);
+                    n->attribute = name;
                     match(TokenType::ID);
                     match(TokenType::ASSIGN);
                     n->children.push_back(expression());
+                    if (options().shareExpressions) expressions.assign(name);
                 }
                 break;
             default:
-                report_syntax_error("assign_statement()", getTokenRepresentation(TokenType::ID, nullptr));
-                break;
-        }
-        return n;
-    }
-
-    /**
-     * do_while_statement => do statement_sequence while expression
-     */
-    TreeNode::ptr do_while_statement() {
-        TreeNode::ptr n = nullptr;
-        switch (token.tokenType) {
-            case TokenType::DO:
-                n = newStatementNode(StmtKind::WhileK);
-                if (n != nullptr) {
-                    match(TokenType::DO);
-                    n->children.push_back(statement_sequence());
-                    match(TokenType::WHILE);
-                    n->children.push_back(expression());
-                }
-                break;
-            default:
-                report_syntax_error("do_while_statement()", getTokenRepresentation(TokenType::DO, nullptr));
-                break;
-        }
-        return n;
-    }
-
-    /**
-     * repeat_until_statement => repeat statement_sequence until expression
-     */
-    TreeNode::ptr repeat_until_statement() {
-        TreeNode::ptr n = nullptr;
-        switch (token.tokenType) {
-            case TokenType::REPEAT:
-                n = newStatementNode(StmtKind::RepeatK);
-                if (n != nullptr) {
-                    match(TokenType::REPEAT);
-                    n->children.push_back(statement_sequence());
-                    match(TokenType::UNTIL);
-                    n->children.push_back(expression());
-                }
-                break;
-            default:
-                report_syntax_error("repeat_until_statement()", getTokenRepresentation(TokenType::REPEAT, nullptr));
+                report_syntax_error("assign_statement()", getTokenRepresentation(TokenType::ID));
                 break;
         }
         return n;
@@ -251,6 +191,9 @@ namespace Compiler::Parser {
      * read_statement => read ID
      */
     TreeNode::ptr read_statement() {
+        auto &parser = state();
+        auto &token = parser.token;
+        auto &expressions = *parser.expressions;
         TreeNode::ptr n = nullptr;
         switch (token.tokenType) {
             case TokenType::READ:
@@ -258,13 +201,15 @@ namespace Compiler::Parser {
                 if (n != nullptr) {
                     match(TokenType::READ);
                     if (token.tokenType == TokenType::ID) { // 没有语法错误的情况下,设置正确的属性
-                        n->attribute = token.tokenString;
+                        auto name = AtomTable::getInstance().intern(token.tokenString);
+                        n->attribute = name;
+                        if (options().shareExpressions) expressions.assign(name);
                     } // 如果存在语法错误,n->attribute没有被正确设置,则n->attribute.index()默认为0,即空属性.
                     match(TokenType::ID); // 如果没有语法错误match成功,否则match失败.
                 }
                 break;
             default:
-                report_syntax_error("read_statement()", getTokenRepresentation(TokenType::READ, nullptr));
+                report_syntax_error("read_statement()", getTokenRepresentation(TokenType::READ));
                 break;
         }
         return n;
@@ -274,6 +219,7 @@ namespace Compiler::Parser {
      * write_statement => write expression
      */
     TreeNode::ptr write_statement() {
+        auto &token = state().token;
         TreeNode::ptr n = nullptr;
         switch (token.tokenType) {
             case TokenType::WRITE:
@@ -284,321 +230,803 @@ namespace Compiler::Parser {
                 }
                 break;
             default:
-                report_syntax_error("write_statement()", getTokenRepresentation(TokenType::WRITE, nullptr));
+                report_syntax_error("write_statement()", getTokenRepresentation(TokenType::WRITE));
                 break;
         }
         return n;
     }
 
     /**
-     * 为了简化代码量,写了个通用的expression parser模板,适应如下文法:
-     *  Expression => next_expression { [tokenList] next_expression }*
-     *  解析后的parser tree 举例如下:
-     * eg: 其中 op is in [tokenList]
+     * 运算符表. 表达式文法原来是按优先级分层的:
+     *  expression => logical_or => logical_and => equality => relational => additive => multiplicative => factor
+     * 每一层都是 next_expression { op next_expression }*. 现在改成按绑定力(binding power)做优先级爬升(Pratt),
+     * 一个循环处理所有双目运算, 绑定力越大结合得越紧, 绑定力相同的运算符就是原来的同一层.
+     * 单目(前缀)运算只作用于紧跟的因子, 所以绑定力比所有双目运算都大.
+     * 新增运算符(比如 Token.h 里提到的位运算 & | ^ !)只需要在这里加一行(当然 Scanner 要先能识别对应的Token).
+     */
+    enum class Fixity : uint8_t {
+        None, Prefix, InfixLeft, InfixRight
+    };
+
+    struct OperatorEntry {
+        TokenType token;
+        Fixity fixity;
+        uint8_t power;
+    };
+
+    constexpr OperatorEntry operatorTable[] = {
+            {TokenType::OR,    Fixity::InfixLeft, 1},
+            {TokenType::AND,   Fixity::InfixLeft, 2},
+            {TokenType::EQ,    Fixity::InfixLeft, 3},
+            {TokenType::NE,    Fixity::InfixLeft, 3},
+            {TokenType::LT,    Fixity::InfixLeft, 4},
+            {TokenType::LE,    Fixity::InfixLeft, 4},
+            {TokenType::BT,    Fixity::InfixLeft, 4},
+            {TokenType::BE,    Fixity::InfixLeft, 4},
+            {TokenType::PLUS,  Fixity::InfixLeft, 5},
+            {TokenType::MINUS, Fixity::InfixLeft, 5},
+            {TokenType::TIMES, Fixity::InfixLeft, 6},
+            {TokenType::OVER,  Fixity::InfixLeft, 6},
+            {TokenType::MOD,   Fixity::InfixLeft, 6},
+            {TokenType::NOT,   Fixity::Prefix,    7},
+    };
+
+    // 按 TokenType 直接查表. 同一个Token可以既是前缀运算又是双目运算(比如以后的负号), 所以分成两张表
+    template<bool prefix>
+    constexpr std::array<OperatorEntry, TOKEN_TYPE_COUNT> operatorLookup() {
+        std::array<OperatorEntry, TOKEN_TYPE_COUNT> table{};
+        for (auto &entry:operatorTable) {
+            if ((entry.fixity == Fixity::Prefix) == prefix) table[entry.token] = entry;
+        }
+        return table;
+    }
+
+    constexpr auto infixOperators = operatorLookup<false>();
+    constexpr auto prefixOperators = operatorLookup<true>();
+
+    /**
+     * 表达式的一个栈帧, 对应递归形式里的一次调用:
+     *  Binary: binary_expression(power) => factor_expression { op binary_expression(p') }*,
+     *          只接受绑定力不小于 power 的双目运算符, 左结合时 p' = power(op) + 1, 右结合时 p' = power(op);
+     *          op 是等待右操作数的运算符节点;
+     *  Prefix: prefix_op factor_expression, op 是等待操作数的单目运算符节点;
+     *  Paren:  ( expression ), 表达式结束后匹配右括号.
+     */
+    struct ExpressionFrame {
+        enum Kind : uint8_t {
+            Binary, Prefix, Paren
+        } kind;
+        uint8_t power;
+        TreeNode::ptr op;
+    };
+
+    /**
+     * expression => binary_expression(1)
+     * factor_expression => prefix_op factor_expression | ID | NUM | STR | BOOL | ( expression )
+     * 注意到: STR 不能参与到 arithmetic 或者 logical 运算中,只能在 assignment/declaration/write expression 这些出现.
+     *
+     * 按绑定力做优先级爬升, 用显式栈代替递归: 括号和单目运算的嵌套深度只受堆内存限制.
+     * 建出的树和诊断信息都和递归形式相同, 左结合的运算:
      *                 op => return
      *           op         next_expr (后执行)
      * next_expr    next_expr (先执行)
      */
-    TreeNode::ptr expression_template(const std::function<TreeNode::ptr()> &nextExpression,
-                                      std::initializer_list<TokenType> tokenList) {
-        auto n = nextExpression();
-        while (std::find(tokenList.begin(), tokenList.end(), token.tokenType) != tokenList.end()) {
-            auto p = newExpressionNode(ExpKind::OpK);
-            if (p != nullptr) {
-                p->attribute = token.tokenType;
-                p->children.push_back(n);
-                n = p;
+    TreeNode::ptr expression() {
+        auto &parser = state();
+        auto &token = parser.token;
+        auto &frames = parser.expressionFrames;
+        frames.push_back({ExpressionFrame::Binary, 1, nullptr});
+        for (;;) {
+            // 读一个因子. 单目运算和括号开始新的栈帧, 其他因子直接得到值 n
+            TreeNode::ptr n = nullptr;
+            auto &prefix = prefixOperators[token.tokenType];
+            if (prefix.fixity == Fixity::Prefix) { // 单目运算(not): 绑定力比所有双目运算大, 操作数就是紧跟的因子
+                n = newExpressionNode(ExpKind::OpK);
+                n->attribute = token.tokenType;
                 match(token.tokenType);
-                n->children.push_back(nextExpression());
+                frames.push_back({ExpressionFrame::Prefix, 0, n});
+                frames.push_back({ExpressionFrame::Binary, prefix.power, nullptr});
+                continue;
+            }
+            switch (token.tokenType) {
+                case TokenType::NUM:
+                case TokenType::TRUE:
+                case TokenType::FALSE:
+                case TokenType::STR:
+                case TokenType::ID:
+                    n = newLeafNode();
+                    if (token.tokenType == TokenType::ID && options().shareExpressions) {
+                        parser.identifierLines.push_back((uint32_t) n->lineNumber);
+                    }
+                    n = share(n);
+                    match(token.tokenType);
+                    break;
+                case TokenType::LPAREN:
+                    match(TokenType::LPAREN);
+                    frames.push_back({ExpressionFrame::Paren, 0, nullptr});
+                    frames.push_back({ExpressionFrame::Binary, 1, nullptr});
+                    continue;
+                default:
+                    report_syntax_error("factor_expression()", "......");
+                    // token = Scanner::getToken(); // 这里应该不需要前进一个token.
+                    break;
+            }
+            // 把值 n 交给栈顶的帧, 直到某个 Binary 帧遇到下一个双目运算符, 再去读它的右操作数
+            for (;;) {
+                auto &frame = frames.back();
+                if (frame.kind == ExpressionFrame::Binary) {
+                    if (frame.op != nullptr) {
+                        frame.op->children.push_back(n);
+                        n = share(frame.op);
+                    }
+                    auto &entry = infixOperators[token.tokenType];
+                    if (entry.fixity != Fixity::None && entry.power >= frame.power) {
+                        frame.op = newExpressionNode(ExpKind::OpK);
+                        frame.op->attribute = token.tokenType;
+                        frame.op->children.push_back(n);
+                        match(token.tokenType);
+                        frames.push_back({ExpressionFrame::Binary,
+                                          (uint8_t) (entry.fixity == Fixity::InfixLeft ? entry.power + 1
+                                                                                       : entry.power), nullptr});
+                        break;
+                    }
+                } else if (frame.kind == ExpressionFrame::Prefix) {
+                    frame.op->children.push_back(n);
+                    n = share(frame.op);
+                } else {
+                    match(TokenType::RPAREN);
+                }
+                frames.pop_back();
+                if (frames.empty()) return n;
+            }
+        }
+    }
+
+    /**
+     * if-else statement:
+     * C语言的文法是:
+     *  statement => ... | selection-statement
+     *  selection-statement => ... | if ( expression ) statement | if ( expression ) statement else statement
+     *  这个是有歧义的,对于 if (expr) if (expr) else stat 会有:
+     *  if (expr) { if (expr) else stat } 和
+     *  if (expr) { if (expr) } else stat 两种树.
+     *  C语言的解决方案是只选择第一颗树,即选择靠近else的if进行解析;
+     *  另外一种方案是引入更多的变量将它变成非歧义的文法,比如JAVA语言(参考Java的EBNF).
+     *
+     *  这里使用的是C的方案,即:
+     *  statement_sequence => statement {; statement }*
+     *  statement => if_else_statement | .. | ..
+     *  if_else_statement => if expression then statement_sequence end
+     *                   | if expression then statement_sequence else statement_sequence end
+     *  解析如下语句:
+     *           if expr then
+     *               if expr then
+     *                   stat_sequence
+     *               else
+     *                   stat_sequence
+     *               end
+     *           end
+     *  过程: Start -> ... -> if [expr] then [stat_sequence] end ->
+     *                ... -> if [expr] then [ if [expr] then [stat_sequence] else [stat_sequence] end ] end
+     *
+     * statement_sequence -> statement { ; statement }*
+     * statement => if_else_stat | repeat_until_stat | do_while_stat | assign_stat | read_stat | write_stat | declaration_stat
+     * repeat_until_statement => repeat statement_sequence until expression
+     * do_while_statement => do statement_sequence while expression
+     * 解析时
+     *                statement_sequence
+     *                       |
+     *        stat ; stat ; stat; stat; ... ; stat (statement_sequence最后一个stat不需要分号)
+     *
+     * 复合语句(if/repeat/do)里嵌套的语句序列用显式栈代替递归: 每个栈帧是一个正在解析的语句序列和它所属的复合语句,
+     * 复合语句读完开头部分就开始一个新的语句序列, 序列结束后再回到复合语句读剩下的部分. 嵌套深度只受堆内存限制.
+     */
+    TreeNode::ptr statement_sequence() {
+        auto &parser = state();
+        auto &token = parser.token;
+        auto &expressions = *parser.expressions;
+        struct Frame {
+            TreeNode::ptr block; // 所属的复合语句, 最外层为nullptr
+            TreeNode::ptr head, tail;
+        };
+        std::vector<Frame> frames{{nullptr, nullptr, nullptr}};
+        for (;;) {
+            TreeNode::ptr n = nullptr;
+            switch (token.tokenType) {
+                case TokenType::IF:
+                    n = newStatementNode(StmtKind::IfK);
+                    match(TokenType::IF);
+                    n->children.push_back(expression());
+                    match(TokenType::THEN);
+                    if (options().shareExpressions) expressions.enterBlock(false);
+                    frames.push_back({n, nullptr, nullptr});
+                    continue;
+                case TokenType::REPEAT:
+                    n = newStatementNode(StmtKind::RepeatK);
+                    match(TokenType::REPEAT);
+                    if (options().shareExpressions) expressions.enterBlock(true);
+                    frames.push_back({n, nullptr, nullptr});
+                    continue;
+                case TokenType::DO:
+                    n = newStatementNode(StmtKind::WhileK);
+                    match(TokenType::DO);
+                    if (options().shareExpressions) expressions.enterBlock(true);
+                    frames.push_back({n, nullptr, nullptr});
+                    continue;
+                case TokenType::ID:
+                    n = assign_statement();
+                    break;
+                case TokenType::READ:
+                    n = read_statement();
+                    break;
+                case TokenType::WRITE:
+                    n = write_statement();
+                    break;
+                case TokenType::INT:
+                case TokenType::FLOAT:
+                case TokenType::DOUBLE:
+                case TokenType::BOOL:
+                case TokenType::STRING:
+                    n = declaration_statement();
+                    break;
+                default:
+                    report_syntax_error("statement()", "......");
+                    /**
+                     * 注意下面这一步很重要,如果在statement()语句一开始没有匹配到任何一个token,必须往下前进一个token.
+                     * 否则下一轮又从同一个token开始解析语句,又是一轮不匹配,就会陷入死循环.
+                     * 当测试源文件开头是一个运算比较符号比如 ">" 的时候这种情况就出现了.
+                     */
+                    token = nextToken();
+                    break;
+            }
+            // 语句 n 结束: 接到当前序列的末尾. 序列结束时回到所属的复合语句, 复合语句结束又是外层序列的一条语句
+            for (;;) {
+                auto &frame = frames.back();
+                if (n != nullptr) {
+                    if (frame.head == nullptr) frame.head = n;
+                    else frame.tail->sibling = n;
+                    frame.tail = n;
+                }
+                if (token.tokenType != TokenType::END_FILE &&
+                    token.tokenType != TokenType::ELSE &&
+                    token.tokenType != TokenType::END &&
+                    token.tokenType != TokenType::UNTIL &&
+                    token.tokenType != TokenType::WHILE) {
+                    match(TokenType::SEMI);
+                    break;
+                }
+                auto block = frame.block, sequence = frame.head;
+                frames.pop_back();
+                if (block == nullptr) return sequence;
+                block->children.push_back(sequence);
+                switch (std::get<StmtKind>(block->kind)) {
+                    case StmtKind::IfK:
+                        if (options().shareExpressions) {
+                            expressions.exitScope();
+                            expressions.exitRegion();
+                        }
+                        if (block->children.size() == 2 && token.tokenType == TokenType::ELSE) {
+                            match(TokenType::ELSE);
+                            if (options().shareExpressions) expressions.enterBlock(false);
+                            frames.push_back({block, nullptr, nullptr});
+                            break;
+                        }
+                        match(TokenType::END);
+                        break;
+                    case StmtKind::RepeatK:
+                        match(TokenType::UNTIL);
+                        block->children.push_back(expression());
+                        if (options().shareExpressions) { // 循环体的作用域到循环条件之后才结束(和 Analyser 一致)
+                            expressions.exitScope();
+                            expressions.exitRegion();
+                        }
+                        break;
+                    default: // do ... while
+                        match(TokenType::WHILE);
+                        block->children.push_back(expression());
+                        if (options().shareExpressions) { // 循环体的作用域到循环条件之后才结束(和 Analyser 一致)
+                            expressions.exitScope();
+                            expressions.exitRegion();
+                        }
+                        break;
+                }
+                if (frames.back().block == block) break; // 开始解析 else 部分
+                n = block;
             }
         }
-        return n;
     }
 
+    /**
+     * 表驱动的 LL(1) 语法分析(文法和预测分析表见 ParserTable.h): 用显式的语法分析栈代替递归,
+     * 另有一个值栈存放已经建好的子树(兄弟链的首尾). 建树动作和递归下降一一对应, 得到的语法树相同.
+     *
+     * 错误处理比递归下降简单: 报告第一个语法错误后停止分析, 把剩下的Token读完(提交其中的词法错误).
+     */
+    TreeNode::ptr table_statement_sequence() {
+        auto &token = state().token;
+        struct Value {
+            TreeNode::ptr head, tail;
+        };
+        std::vector<GrammarSymbol> symbols{n(N_STMT_SEQ)};
+        std::vector<Value> values;
+        auto pop = [&values]() {
+            auto v = values.back();
+            values.pop_back();
+            return v;
+        };
+        auto push = [&values](TreeNode::ptr node) { values.push_back({node, node}); };
+        bool error = false;
+        while (!symbols.empty() && !error) {
+            auto symbol = symbols.back();
+            symbols.pop_back();
+            switch (symbol.kind) {
+                case S_TERMINAL:
+                    if (token.tokenType == symbol.value) token = nextToken();
+                    else {
+                        report_syntax_error("match()", getTokenRepresentation((TokenType) symbol.value));
+                        error = true;
+                    }
+                    break;
+                case S_NONTERMINAL: {
+                    auto production = predict.table[symbol.value][token.tokenType];
+                    if (production == NO_PRODUCTION) {
+                        std::string expected;
+                        for (size_t i = 0; i < TOKEN_TYPE_COUNT; i++) {
+                            if (predict.table[symbol.value][i] == NO_PRODUCTION) continue;
+                            if (!expected.empty()) expected += " | ";
+                            expected += getTokenRepresentation((TokenType) i);
+                        }
+                        report_syntax_error(nonTerminalNames[symbol.value], expected);
+                        error = true;
+                        break;
+                    }
+                    auto &p = grammar[production];
+                    for (size_t i = p.length; i-- > 0;) symbols.push_back(p.rhs[i]);
+                    break;
+                }
+                case S_ACTION:
+                    switch ((BuildAction) symbol.value) {
+                        case B_NEW_IF:
+                            push(newStatementNode(StmtKind::IfK));
+                            break;
+                        case B_NEW_REPEAT:
+                            push(newStatementNode(StmtKind::RepeatK));
+                            break;
+                        case B_NEW_DO:
+                            push(newStatementNode(StmtKind::WhileK));
+                            break;
+                        case B_NEW_WRITE:
+                            push(newStatementNode(StmtKind::WriteK));
+                            break;
+                        case B_NEW_READ:
+                            push(newStatementNode(StmtKind::ReadK));
+                            break;
+                        case B_READ_ID:
+                            if (token.tokenType == TokenType::ID) {
+                                values.back().head->attribute = AtomTable::getInstance().intern(token.tokenString);
+                            }
+                            break;
+                        case B_NEW_ASSIGN:
+                        case B_NEW_VARIABLE: {
+                            auto node = newStatementNode(
+                                    symbol.value == B_NEW_ASSIGN ? StmtKind::AssignK : StmtKind::VariableListK);
+                            node->attribute = AtomTable::getInstance().intern(token.tokenString);
+                            push(node);
+                            break;
+                        }
+                        case B_NEW_DECLARATION: {
+                            auto node = newStatementNode(StmtKind::DeclarationK);
+                            node->attribute = token.tokenType;
+                            push(node);
+                            break;
+                        }
+                        case B_NEW_UNARY:
+                        case B_NEW_BINARY: {
+                            auto node = newExpressionNode(ExpKind::OpK);
+                            node->attribute = token.tokenType;
+                            if (symbol.value == B_NEW_BINARY) node->children.push_back(pop().head);
+                            push(node);
+                            break;
+                        }
+                        case B_NEW_LEAF:
+                            push(newLeafNode());
+                            break;
+                        case B_ADD_CHILD: {
+                            auto child = pop();
+                            values.back().head->children.push_back(child.head);
+                            break;
+                        }
+                        case B_APPEND: {
+                            auto rest = pop();
+                            values.back().tail->sibling = rest.head;
+                            values.back().tail = rest.tail;
+                            break;
+                        }
+                    }
+                    break;
+            }
+        }
+        if (error) {
+            while (token.tokenType != END_FILE) token = nextToken();
+        }
+        return values.empty() ? nullptr : values.front().head;
+    }
 
-    // expression => logical_or_expression
-    TreeNode::ptr expression() { return logical_or_expression(); }
+    /**
+     * program -> statement_sequence [END_FILE]
+     */
+    TreeNode::ptr parse() {
+        using namespace Compiler::Exception;
+        auto &parser = state();
+        auto &token = parser.token;
+        auto &expressions = *parser.expressions;
+        if (options().shareExpressions) {
+            expressions.clear();
+            parser.identifierLines.clear();
+        }
+        token = nextToken();
+        auto root = options().tableParser ? table_statement_sequence() : statement_sequence();
+        if (token.tokenType != END_FILE) {
+            ExceptionHandle::getHandle().add_exception(
+                    ExceptionType::SYNTAX_ERROR, "Parser don't reach END_FILE finally");
+        }
+        if (options().dumpAst) {
+            dumpTree(root);
+        }
+        return root;
+    }
 
-    // logical_or_expression => logical_and_expression { or logical_and_expression }*
-    TreeNode::ptr logical_or_expression() {
-        return expression_template(logical_and_expression, {TokenType::OR});
+    TreeNode::ptr parse(const Scanner::TokenBuffer &buffer) {
+        auto &parser = state();
+        parser.tokens = &buffer;
+        parser.tokenIndex = parser.diagnosticIndex = 0;
+        auto root = parse();
+        parser.tokens = nullptr;
+        return root;
     }
 
-    //logical_and_expression => equality_expression { and equality_expression }*
-    TreeNode::ptr logical_and_expression() {
-        return expression_template(equality_expression, {TokenType::AND});
+    TreeNode::ptr parse(Scanner::TokenPipeline &source) {
+        auto &parser = state();
+        parser.pipeline = &source;
+        auto root = parse();
+        parser.pipeline = nullptr;
+        return root;
     }
 
-    // equality_expression => relational_expression { = | !=  relational_expression}*
-    TreeNode::ptr equality_expression() {
-        return expression_template(relational_expression, {TokenType::EQ, TokenType::NE});
+    // 每种节点最多有几个子节点
+    constexpr uint32_t childCapacity(StmtKind kind) {
+        switch (kind) {
+            case StmtKind::IfK:
+                return 3; // expression, then, else
+            case StmtKind::RepeatK:
+            case StmtKind::WhileK:
+                return 2;
+            case StmtKind::ReadK:
+                return 0;
+            default:
+                return 1;
+        }
+    }
+
+    constexpr uint32_t childCapacity(ExpKind kind) {
+        return kind == ExpKind::OpK ? 2 : 0;
     }
 
-    // relational_expression => additive_expression { > | < | >= | <=  additive_expression } *
-    TreeNode::ptr relational_expression() {
-        return expression_template(arithmetic_additive_expression,
-                                   {TokenType::LT, TokenType::LE, TokenType::BT, TokenType::BE});
+    constexpr size_t nodeSize(uint32_t capacity) {
+        return sizeof(TreeNode) + capacity * sizeof(TreeNode::ptr);
     }
 
-    // additive_expression => multiplicative_expression { +|- multiplicative_expression }*
-    TreeNode::ptr arithmetic_additive_expression() {
-        return expression_template
-                (arithmetic_multiplicative_expression, {TokenType::PLUS, TokenType::MINUS});
+    /**
+     * 在 arena 里分配一个节点, 子节点数组紧跟在节点后面, 一次分配.
+     */
+    TreeNode::ptr newNode(uint32_t capacity) {
+        auto &parser = state();
+        void *memory = parser.arena.allocate(nodeSize(capacity), alignof(TreeNode));
+        auto n = new(memory) TreeNode();
+        n->children = ChildList(reinterpret_cast<TreeNode::ptr *>(n + 1), capacity);
+        n->lineNumber = parser.token.lineNumber;
+        return n;
     }
 
-    //multiplicative_expression => factor_expression { * | / | % factor_expression }*
-    TreeNode::ptr arithmetic_multiplicative_expression() {
-        return expression_template(factor_expression, {TokenType::TIMES, TokenType::OVER, TokenType::MOD});
+    TreeNode::ptr newStatementNode(StmtKind stmtKind) {
+        auto n = newNode(childCapacity(stmtKind));
+        n->stmt_or_exp = StmtOrExp::StmtK;
+        n->kind = stmtKind;
+        return n;
+    }
+
+    TreeNode::ptr newExpressionNode(ExpKind expKind) {
+        auto n = newNode(childCapacity(expKind));
+        n->stmt_or_exp = StmtOrExp::ExpK;
+        n->kind = expKind;
+        return n;
     }
 
     /**
-     * factor_expression => not factor_expression | ID | NUM | STR | BOOL | ( expression )
-     * 注意到: STR 不能参与到 arithmetic 或者 logical 运算中,只能在 assignment/declaration/write expression 这些出现.
+     * 当前Token(NUM, TRUE/FALSE, STR, ID)对应的叶子节点
      */
-    TreeNode::ptr factor_expression() {
+    TreeNode::ptr newLeafNode() {
+        auto &token = state().token;
         TreeNode::ptr n = nullptr;
         switch (token.tokenType) {
-            case TokenType::NOT:
-                n = newExpressionNode(ExpKind::OpK);
-                if (n != nullptr) {
-                    n->attribute = token.tokenType;
-                    match(TokenType::NOT);
-                    n->children.push_back(factor_expression());
-                }
-                break;
             case TokenType::NUM:
-                try {
-                    switch (getNumType(*token.tokenString)) {
-                        case NUM_TYPE::DECIMAL:
-                        case NUM_TYPE::OCT:
-                        case NUM_TYPE::HEX:
-                            n = newExpressionNode(ExpKind::ConstIntK);
-                            if (n != nullptr)
-                                n->attribute = (int_t) (std::stoi(*token.tokenString));// 16/10/8 进制字符串转换为整数
-                            break;
-                        case NUM_TYPE::FLOAT:
-                            n = newExpressionNode(ExpKind::ConstFloatK);
-                            if (n != nullptr) n->attribute = (float_t) (std::stof(*token.tokenString));
-                            break;
-                        case NUM_TYPE::DOUBLE:
-                            n = newExpressionNode(ExpKind::ConstDoubleK);
-                            if (n != nullptr) n->attribute = (double_t) (std::stod(*token.tokenString));
-                            break;
-                    }
-                } catch (std::invalid_argument &e) {
-                    std::cerr << "arithmetic_factor() convert number "
-                              << *token.tokenString << " error:" << e.what() << "\n";
+                // 数值已经在扫描时按进制转换好(超出范围的常量由Scanner报告词法错误)
+                switch (token.number.index()) {
+                    case 0:
+                        n = newExpressionNode(ExpKind::ConstIntK);
+                        n->attribute = std::get<int_t>(token.number);
+                        break;
+                    case 1:
+                        n = newExpressionNode(ExpKind::ConstFloatK);
+                        n->attribute = std::get<float_t>(token.number);
+                        break;
+                    default:
+                        n = newExpressionNode(ExpKind::ConstDoubleK);
+                        n->attribute = std::get<double_t>(token.number);
+                        break;
                 }
-                match(TokenType::NUM);
                 break;
             case TokenType::TRUE:
             case TokenType::FALSE:
                 n = newExpressionNode(ExpKind::ConstBoolK);
-                if (n != nullptr) {
-                    n->attribute = (token.tokenType == TokenType::TRUE) ? BOOL::TRUE : BOOL::FALSE;
-                }
-                match(token.tokenType);
+                n->attribute = (token.tokenType == TokenType::TRUE) ? BOOL::TRUE : BOOL::FALSE;
                 break;
             case TokenType::STR:
                 n = newExpressionNode(ExpKind::ConstStringK);
-                if (n != nullptr) {
-                    n->attribute = token.tokenString;
-                }
-                match(TokenType::STR);
-                break;
-            case TokenType::ID:
-                n = newExpressionNode(ExpKind::IdK);
-                if (n != nullptr) {
-                    n->attribute = token.tokenString;
-                }
-                match(TokenType::ID);
-                break;
-            case TokenType::LPAREN:
-                match(TokenType::LPAREN);
-                n = expression();
-                match(TokenType::RPAREN);
+                n->attribute = AtomTable::getInstance().intern(token.tokenString);
                 break;
             default:
-                report_syntax_error("factor_expression()", "......");
-                // token = Scanner::getToken(); // 这里应该不需要前进一个token.
+                n = newExpressionNode(ExpKind::IdK);
+                n->attribute = AtomTable::getInstance().intern(token.tokenString);
                 break;
         }
         return n;
     }
 
     /**
-     * statement => if_else_stat | repeat_until_stat | do_while_stat | assign_stat | read_stat | write_stat | declaration_stat
+     * --hash-cons: 刚建好的表达式节点换成表里相同的节点.
+     * 有相同的节点时 n 的子节点也都是已有的节点, 所以 n 是 arena 里最后分配的, 可以直接收回.
      */
-    TreeNode::ptr statement() {
-        using namespace Compiler::Exception;
-        TreeNode::ptr n = nullptr;
-        switch (token.tokenType) {
-            case TokenType::IF:
-                n = if_else_statement();
-                break;
-            case TokenType::REPEAT:
-                n = repeat_until_statement();
-                break;
-            case TokenType::DO:
-                n = do_while_statement();
-                break;
-            case TokenType::ID:
-                n = assign_statement();
-                break;
-            case TokenType::READ:
-                n = read_statement();
-                break;
-            case TokenType::WRITE:
-                n = write_statement();
-                break;
-            case TokenType::INT:
-            case TokenType::FLOAT:
-            case TokenType::DOUBLE:
-            case TokenType::BOOL:
-            case TokenType::STRING:
-                n = declaration_statement();
-                break;
-            default:
-                report_syntax_error("statement()", "......");
-                /**
-                 　* 注意下面这一步很重要,如果在statement()语句一开始没有匹配到任何一个token,必须往下前进一个token.
-                   * 如果token不改变,statement()结束回到statement_sequence(), statement_sequence()又进一步调用statement(),
-                   * 然后又是一轮不匹配,就会陷入 statement() ---不匹配---> statement_sequence ---调用---> statement() ---不匹配---> ...
-                   * 的死循环. 当测试源文件开头是一个运算比较符号比如 ">" 的时候这种情况就出现了.
-                 　*/
-                token = Scanner::getToken();
-                break;
-        }
-        return n;
+    TreeNode::ptr share(TreeNode::ptr n) {
+        if (!options().shareExpressions) return n;
+        auto &parser = state();
+        auto found = parser.expressions->share(n);
+        if (found != n) parser.arena.reclaim(n, nodeSize(childCapacity(std::get<ExpKind>(n->kind))));
+        return found;
     }
 
     /**
-     * statement_sequence -> statement { ; statement }*
-     * 解析时
-     *                statement_sequence
-     *                       |
-     *        stat ; stat ; stat; stat; ... ; stat (statement_sequence最后一个stat不需要分号)
+     * 把一个表达式(可能有共享的节点)复制成一棵新的树, 副本不共享, 也不放进表里.
      */
-    TreeNode::ptr statement_sequence() {
-        auto n = statement();
-        auto p = n;
-        while (token.tokenType != TokenType::END_FILE &&
-               token.tokenType != TokenType::ELSE &&
-               token.tokenType != TokenType::END &&
-               token.tokenType != TokenType::UNTIL &&
-               token.tokenType != TokenType::WHILE) {
-            match(TokenType::SEMI);
-            auto q = statement();
-            if (q != nullptr) {
-                if (n == nullptr) {
-                    n = q;
-                    p = q;
-                } else {
-                    p->sibling = q;
-                    p = q;
-                }
+    TreeNode::ptr copyExpression(TreeNode::ptr source) {
+        if (source == nullptr) return nullptr;
+        auto copy = [](TreeNode::ptr n) {
+            auto c = newExpressionNode(std::get<ExpKind>(n->kind));
+            c->lineNumber = n->lineNumber;
+            c->attribute = n->attribute;
+            for (auto child:n->children) c->children.push_back(child);
+            return c;
+        };
+        auto root = copy(source);
+        std::vector<TreeNode::ptr> stack{root};
+        while (!stack.empty()) {
+            auto n = stack.back();
+            stack.pop_back();
+            for (size_t i = 0; i < n->children.size(); i++) {
+                if (n->children[i] == nullptr) continue;
+                n->children[i] = copy(n->children[i]);
+                stack.push_back(n->children[i]);
             }
         }
-        return n;
+        return root;
     }
 
-    /**
-     * program -> statement_sequence [END_FILE]
-     */
-    TreeNode::ptr parse() {
-        using namespace Compiler::Exception;
-        token = Scanner::getToken();
-        auto root = statement_sequence();
-        if (token.tokenType != END_FILE) {
-            ExceptionHandle::getHandle().add_exception(
-                    ExceptionType::SYNTAX_ERROR, "Parser don't reach END_FILE finally");
+    ParserState::ParserState() : expressions(std::make_unique<ExpressionTable>()) {}
+
+    ParserState::~ParserState() = default;
+
+    const std::vector<uint32_t> &identifierLines() {
+        return state().identifierLines;
+    }
+
+    void clearAll() {
+        state().arena.release();
+    }
+
+    // 打印一个节点(不包括子节点和兄弟节点)
+    void printNode(TreeNode::ptr n, size_t tab_count) {
+        auto &writer = Dump::Writer::getInstance();
+        for (size_t i = 0; i < tab_count; i++) {
+            writer.put('\t');
         }
-        if (TRACE_PARSER) {
-            printTree(root);
+        if (n->stmt_or_exp == StmtOrExp::StmtK) {
+            switch (std::get<StmtKind>(n->kind)) {
+                case StmtKind::IfK:
+                    writer.printf("If\n");
+                    break;
+                case StmtKind::RepeatK:
+                    writer.printf("Repeat\n");
+                    break;
+                case StmtKind::AssignK:
+                    writer.printf("Assign to ID : %s\n", get_attribute_string(n).c_str());
+                    break;
+                case StmtKind::DeclarationK:
+                    writer.printf("Declaration Type : %s\n", get_attribute_string(n).c_str());
+                    break;
+                case StmtKind::VariableListK:
+                    writer.printf("ID : %s\n", get_attribute_string(n).c_str());
+                    break;
+                case StmtKind::ReadK:
+                    writer.printf("Read : %s\n", get_attribute_string(n).c_str());
+                    break;
+                case StmtKind::WriteK:
+                    writer.printf("Write\n");
+                    break;
+                case StmtKind::WhileK:
+                    writer.printf("Do\n");
+                    break;
+            }
+        } else if (n->stmt_or_exp == StmtOrExp::ExpK) {
+            switch (std::get<ExpKind>(n->kind)) {
+                case ExpKind::OpK:
+                    writer.printf("Op: %s\n", get_attribute_string(n).c_str());
+                    break;
+                case ExpKind::ConstIntK:
+                    writer.printf("ConstInt: %s\n", get_attribute_string(n).c_str());
+                    break;
+                case ExpKind::ConstFloatK:
+                    writer.printf("ConstFloat: %s\n", get_attribute_string(n).c_str());
+                    break;
+                case ExpKind::ConstDoubleK:
+                    writer.printf("ConstDouble: %s\n", get_attribute_string(n).c_str());
+                    break;
+                case ExpKind::ConstBoolK:
+                    writer.printf("ConstBool: %s\n", get_attribute_string(n).c_str());
+                    break;
+                case ExpKind::ConstStringK:
+                    writer.printf("ConstString: %s\n", get_attribute_string(n).c_str());
+                    break;
+                case ExpKind::IdK:
+                    writer.printf("Id: %s\n", get_attribute_string(n).c_str());
+                    break;
+            }
+        } else {
+            writer.printf("Unknown kind of tree node.\n");
         }
-        return root;
     }
 
-    TreeNode::ptr newStatementNode(StmtKind stmtKind) {
-        auto n = std::make_shared<TreeNode>();
-        n->lineNumber = Scanner::lineNumber;
-        n->stmt_or_exp = StmtOrExp::StmtK;
-        n->kind = stmtKind;
-        return n;
+    /**
+     * 先序打印从 n 开始的兄弟链, 子节点多缩进一层. 用显式栈代替递归, 栈里每一项是一条兄弟链上当前的节点
+     * 和它下一个要打印的子节点, 栈的深度就是缩进层数.
+     * 注意printTree的第一个参数不要用node&n,否则调用printTree(root)后root也被修改了.
+     */
+    void printTree(TreeNode::ptr n, int tab_count) {
+        std::vector<std::pair<TreeNode::ptr, size_t>> stack;
+        if (n != nullptr) {
+            printNode(n, (size_t) tab_count);
+            stack.emplace_back(n, 0);
+        }
+        while (!stack.empty()) {
+            auto &[node, next] = stack.back();
+            TreeNode::ptr p;
+            if (next < node->children.size()) {
+                p = node->children[next++];
+            } else {
+                p = node->sibling;
+                stack.pop_back();
+            }
+            if (p != nullptr) {
+                printNode(p, (size_t) tab_count + stack.size());
+                stack.emplace_back(p, 0);
+            }
+        }
     }
 
-    TreeNode::ptr newExpressionNode(ExpKind expKind) {
-        auto n = std::make_shared<TreeNode>();
-        n->lineNumber = Scanner::lineNumber;
-        n->stmt_or_exp = StmtOrExp::ExpK;
-        n->kind = expKind;
-        return n;
+    // json/binary 格式里的节点名
+    const char *nodeName(TreeNode::ptr n) {
+        if (n->stmt_or_exp == StmtOrExp::StmtK) {
+            switch (std::get<StmtKind>(n->kind)) {
+                case StmtKind::IfK:
+                    return "If";
+                case StmtKind::RepeatK:
+                    return "Repeat";
+                case StmtKind::AssignK:
+                    return "Assign";
+                case StmtKind::DeclarationK:
+                    return "Declaration";
+                case StmtKind::VariableListK:
+                    return "Variable";
+                case StmtKind::ReadK:
+                    return "Read";
+                case StmtKind::WriteK:
+                    return "Write";
+                case StmtKind::WhileK:
+                    return "Do";
+            }
+        } else {
+            switch (std::get<ExpKind>(n->kind)) {
+                case ExpKind::OpK:
+                    return "Op";
+                case ExpKind::ConstIntK:
+                    return "ConstInt";
+                case ExpKind::ConstFloatK:
+                    return "ConstFloat";
+                case ExpKind::ConstDoubleK:
+                    return "ConstDouble";
+                case ExpKind::ConstBoolK:
+                    return "ConstBool";
+                case ExpKind::ConstStringK:
+                    return "ConstString";
+                case ExpKind::IdK:
+                    return "Id";
+            }
+        }
+        return "Unknown";
     }
 
-    // 注意printTree的第一个参数不要用node&n,否则调用printTree(root)后root也被修改了.
-    void printTree(TreeNode::ptr n, int tab_count) {
-        while (n != nullptr) {
-            for (int i = 0; i < tab_count; i++) {
-                fprintf(OUTPUT_STREAM, "\t");
+    /**
+     * --dump-ast: 按 --dump-format 输出语法树(格式见 Dump.h). text 格式就是 printTree.
+     * json 格式每条顶层语句一行: {"line":行号,"node":节点名,"attribute":属性,"children":[[兄弟链],...]}.
+     * 和 printTree 一样用显式栈, 栈里每一项是一个节点和它下一个要输出的子节点.
+     */
+    void dumpTree(TreeNode::ptr root) {
+        auto &writer = Dump::Writer::getInstance();
+        auto format = options().dumpFormat;
+        if (format == DumpFormat::Text) {
+            printTree(root);
+            writer.flush();
+            return;
+        }
+        std::vector<std::pair<TreeNode::ptr, size_t>> stack;
+        auto open = [&](TreeNode::ptr n) {
+            if (format == DumpFormat::Json) {
+                writer.printf("{\"line\":%d,\"node\":\"%s\",\"attribute\":", n->lineNumber, nodeName(n));
+                writer.jsonString(is_attribute_null(n) ? "" : get_attribute_string(n));
+                writer.write(",\"children\":[");
+            } else {
+                writer.put('N');
+                writer.value((uint8_t) n->stmt_or_exp);
+                writer.value(n->stmt_or_exp == StmtOrExp::StmtK ? (uint8_t) std::get<StmtKind>(n->kind)
+                                                                : (uint8_t) std::get<ExpKind>(n->kind));
+                writer.value((uint32_t) n->lineNumber);
+                writer.bytes(is_attribute_null(n) ? "" : get_attribute_string(n));
+                writer.value((uint8_t) n->children.size());
             }
-            if (n->stmt_or_exp == StmtOrExp::StmtK) {
-                switch (std::get<StmtKind>(n->kind)) {
-                    case StmtKind::IfK:
-                        fprintf(OUTPUT_STREAM, "If\n");
-                        break;
-                    case StmtKind::RepeatK:
-                        fprintf(OUTPUT_STREAM, "Repeat\n");
-                        break;
-                    case StmtKind::AssignK:
-                        fprintf(OUTPUT_STREAM, "Assign to ID : %s\n", get_attribute_string(n).c_str());
-                        break;
-                    case StmtKind::DeclarationK:
-                        fprintf(OUTPUT_STREAM, "Declaration Type : %s\n", get_attribute_string(n).c_str());
-                        break;
-                    case StmtKind::VariableListK:
-                        fprintf(OUTPUT_STREAM, "ID : %s\n", get_attribute_string(n).c_str());
-                        break;
-                    case StmtKind::ReadK:
-                        fprintf(OUTPUT_STREAM, "Read : %s\n", get_attribute_string(n).c_str());
-                        break;
-                    case StmtKind::WriteK:
-                        fprintf(OUTPUT_STREAM, "Write\n");
-                        break;
-                    case StmtKind::WhileK:
-                        fprintf(OUTPUT_STREAM, "Do\n");
-                        break;
+            stack.emplace_back(n, 0);
+        };
+        auto closeChain = [&]() {
+            if (format == DumpFormat::Json) writer.put(']');
+            else writer.put('E');
+        };
+        for (auto top = root; top != nullptr; top = top->sibling) {
+            open(top);
+            while (!stack.empty()) {
+                auto &[node, next] = stack.back();
+                if (next < node->children.size()) {
+                    auto child = node->children[next++];
+                    if (format == DumpFormat::Json) {
+                        if (next > 1) writer.put(',');
+                        writer.put('[');
+                    }
+                    if (child != nullptr) open(child);
+                    else closeChain();
+                    continue;
                 }
-            } else if (n->stmt_or_exp == StmtOrExp::ExpK) {
-                switch (std::get<ExpKind>(n->kind)) {
-                    case ExpKind::OpK:
-                        fprintf(OUTPUT_STREAM, "Op: %s\n", get_attribute_string(n).c_str());
-                        break;
-                    case ExpKind::ConstIntK:
-                        fprintf(OUTPUT_STREAM, "ConstInt: %s\n", get_attribute_string(n).c_str());
-                        break;
-                    case ExpKind::ConstFloatK:
-                        fprintf(OUTPUT_STREAM, "ConstFloat: %s\n", get_attribute_string(n).c_str());
-                        break;
-                    case ExpKind::ConstDoubleK:
-                        fprintf(OUTPUT_STREAM, "ConstDouble: %s\n", get_attribute_string(n).c_str());
-                        break;
-                    case ExpKind::ConstBoolK:
-                        fprintf(OUTPUT_STREAM, "ConstBool: %s\n", get_attribute_string(n).c_str());
-                        break;
-                    case ExpKind::ConstStringK:
-                        fprintf(OUTPUT_STREAM, "ConstString: %s\n", get_attribute_string(n).c_str());
-                        break;
-                    case ExpKind::IdK:
-                        fprintf(OUTPUT_STREAM, "Id: %s\n", get_attribute_string(n).c_str());
-                        break;
+                if (format == DumpFormat::Json) writer.write("]}");
+                auto sibling = node->sibling;
+                bool isTop = stack.size() == 1;
+                stack.pop_back();
+                if (isTop) break; // 顶层语句的兄弟由外层循环处理
+                if (sibling != nullptr) {
+                    if (format == DumpFormat::Json) writer.put(',');
+                    open(sibling);
+                } else {
+                    closeChain();
                 }
-            } else {
-                fprintf(OUTPUT_STREAM, "Unknown kind of tree node.\n");
-            }
-            for (auto &child:n->children) {
-                printTree(child, tab_count + 1);
             }
-            n = n->sibling;
+            if (format == DumpFormat::Json) writer.put('\n');
         }
+        if (format == DumpFormat::Binary) closeChain();
+        writer.flush();
     }
 }
@@ -9,6 +9,10 @@
 #include "Token.h"
 #include "Util.h"
 #include "TypeSystem.h"
+#include "Scanner.h"
+#include "TokenPipeline.h"
+#include "AtomTable.h"
+#include "Arena.h"
 
 /**
  * 基于 LL(1) 文法的手写递归下降语法分析器. LL(1)文法也就是 backtracking-free 文法(无需递归后回溯搜索)
@@ -36,11 +40,60 @@ namespace Compiler::Parser {
         OpK, ConstIntK, ConstFloatK, ConstDoubleK, ConstStringK, ConstBoolK, IdK
     };
 
+    struct TreeNode;
+
+    /**
+     * 子节点数组. 数组在 arena 里紧跟在节点自己后面分配, 容量由节点种类决定(最多3个: if-then-else),
+     * 接口和原来的 std::vector 一样, 但是不单独分配内存, 也不需要析构.
+     */
+    class ChildList {
+    private:
+        TreeNode **items = nullptr;
+        uint32_t count = 0;
+        uint32_t capacity = 0;
+
+    public:
+        ChildList() = default;
+
+        ChildList(TreeNode **items, uint32_t capacity) : items(items), capacity(capacity) {}
+
+        void push_back(TreeNode *child) {
+            assert(count < capacity);
+            items[count++] = child;
+        }
+
+        TreeNode *const &at(size_t i) const {
+            if (i >= count) throw std::out_of_range("ChildList::at");
+            return items[i];
+        }
+
+        TreeNode *const &operator[](size_t i) const { return items[i]; }
+
+        TreeNode *&operator[](size_t i) { return items[i]; }
+
+        void pop_back() {
+            assert(count > 0);
+            count--;
+        }
+
+        size_t size() const { return count; }
+
+        bool empty() const { return count == 0; }
+
+        TreeNode *const *begin() const { return items; }
+
+        TreeNode *const *end() const { return items + count; }
+    };
+
+    /**
+     * 语法树节点. 节点和子节点数组都在当前文件的 arena 里分配, 节点之间用普通指针连接,
+     * 整棵树在 clearAll() 时一次释放.
+     */
     struct TreeNode {
     public:
-        using ptr = std::shared_ptr<struct TreeNode>;
+        using ptr = TreeNode *;
     public:
-        std::vector<ptr> children;
+        ChildList children;
         ptr sibling = nullptr;
         int lineNumber = 0;
 
@@ -52,6 +105,9 @@ namespace Compiler::Parser {
         // 对于statement来说  => 只有Declaration-statement需要持有类型信息.
         Type type = Type::Void; // 默认空类型
 
+        // --hash-cons 时表达式节点可能被多个父节点共享(见 ExpressionTable.h)
+        bool shared = false;
+
     public:
         std::variant<
                 /* null_t: variant.index()为0的占位空属性.
@@ -65,10 +121,12 @@ namespace Compiler::Parser {
                 float_t,     /* 解析单精度浮点常量(f/F结尾)的字符串为float类型的值,储存在节点属性值里 */
                 double_t,    /* 解析双精度浮点常量的字符串为double类型的值,储存在节点属性值里 */
                 bool_t,      /* 解析bool类型的值,只有true,false两种取值 */
-                string_ptr   /* ID型Token的名称 或者 字符串常量 => 通过ExpKind区分 */
+                atom_t       /* ID型Token的名称 或者 字符串常量在 AtomTable 里的编号 => 通过ExpKind区分 */
         > attribute; // 节点属性
     };
 
+    static_assert(std::is_trivially_destructible_v<TreeNode>, "TreeNode is released with its arena");
+
     /**
      * 判断一个节点的属性值是否为空(即没有被正确设置)
      */
@@ -81,7 +139,7 @@ namespace Compiler::Parser {
         try {
             switch (n->attribute.index()) {
                 case 1:
-                    return getTokenRepresentation(std::get<TokenType>(n->attribute), nullptr);
+                    return getTokenRepresentation(std::get<TokenType>(n->attribute));
                 case 2:
                     return std::to_string(std::get<int_t>(n->attribute));
                 case 3:
@@ -98,7 +156,7 @@ namespace Compiler::Parser {
                             return "";
                     }
                 case 6:
-                    return *std::get<string_ptr>(n->attribute);
+                    return string_t(AtomTable::getInstance().getString(std::get<atom_t>(n->attribute)));
             }
         } catch (std::bad_variant_access &error) {
             std::cerr << "get_attribute_string() exception: " << error.what();
@@ -106,8 +164,70 @@ namespace Compiler::Parser {
         return "";
     }
 
+    class ExpressionTable;
+
+    struct ExpressionFrame;
+
+    /**
+     * 语法分析器的全部状态, 每个 CompilerContext 一个.
+     */
+    struct ParserState {
+        Scanner::TokenRet token; // 当前Token
+
+        /* 批量模式下预先切好的Token, 为nullptr时逐个调用 Scanner::getToken() */
+        const Scanner::TokenBuffer *tokens = nullptr;
+        size_t tokenIndex = 0;
+        size_t diagnosticIndex = 0;
+
+        /* 流水线模式下扫描线程的输出 */
+        Scanner::TokenPipeline *pipeline = nullptr;
+
+        /* 当前文件的语法树节点 */
+        Arena arena;
+
+        /* --hash-cons: 当前文件已经建好的表达式节点 */
+        std::unique_ptr<ExpressionTable> expressions;
+
+        /* --hash-cons: 每个 ID 表达式按源码顺序出现的行号(共享的 ID 节点只记得第一次出现的行号) */
+        std::vector<uint32_t> identifierLines;
+
+        /* 表达式的显式栈(见 expression()), 每次调用 expression() 结束时都是空的, 保留下来避免重复分配 */
+        std::vector<ExpressionFrame> expressionFrames;
+
+        ParserState();
+
+        ~ParserState();
+    };
+
     TreeNode::ptr parse();
 
+    /**
+     * 批量模式: 从预先切好的 TokenBuffer 按下标读取Token进行语法分析.
+     */
+    TreeNode::ptr parse(const Scanner::TokenBuffer &buffer);
+
+    /**
+     * 流水线模式: 从扫描线程的环形缓冲读取Token进行语法分析.
+     */
+    TreeNode::ptr parse(Scanner::TokenPipeline &pipeline);
+
     void printTree(TreeNode::ptr n, int tab_count = 0);
+
+    /**
+     * --dump-ast: 按 --dump-format 输出语法树(见 Dump.h).
+     */
+    void dumpTree(TreeNode::ptr root);
+
+    /**
+     * --hash-cons: 当前文件每个 ID 表达式出现的行号, 按源码顺序, 也就是先序遍历遇到它们的顺序.
+     * 共享的 ID 节点在每个出现的位置都会被访问, 语义分析用这里的行号记录每一次出现.
+     * clearAll() 之后仍然有效(扁平形式在释放语法树以后才做语义分析), 下一次 parse() 时清空.
+     */
+    const std::vector<uint32_t> &identifierLines();
+
+    /**
+     * 释放当前文件的整棵语法树. 之前 parse() 返回的所有节点都不能再使用.
+     */
+    void clearAll();
 }
 #endif //SCANNER_PARSER_H
@@ -0,0 +1,290 @@
+//
+// Created by junior on 19-6-2.
+//
+
+#ifndef COMPILER_PARSERTABLE_H
+#define COMPILER_PARSERTABLE_H
+
+#include "Compiler.h"
+#include "Token.h"
+
+/**
+ * 表驱动 LL(1) 语法分析器用到的常量表, 全部在编译期(constexpr)由下面的文法生成:
+ * 1. 文法: 和递归下降的各个函数一一对应的产生式, 产生式里穿插建树动作(B_*), 动作不影响 FIRST/FOLLOW;
+ * 2. FIRST/FOLLOW 集: 不动点迭代求出每个非终结符的 nullable, FIRST 和 FOLLOW;
+ * 3. 预测分析表: predict.table[非终结符][Token] 给出要展开的产生式. 文法不是 LL(1)(有冲突)时编译失败.
+ *
+ * 递归下降里的循环 { op next }* 在这里改写成右递归的 rest 非终结符, 左结合由建树动作保证.
+ */
+namespace Compiler::Parser {
+    constexpr size_t TOKEN_TYPE_COUNT = TokenType::COMMA + 1;
+
+    // 非终结符, 名字(报告语法错误时使用)对应递归下降里的函数, 各层表达式都对应 expression()
+    enum NonTerminal : uint8_t {
+        N_STMT_SEQ,         // statement_sequence => statement stmt_seq_rest
+        N_STMT_SEQ_REST,    // stmt_seq_rest => ; statement stmt_seq_rest | ε
+        N_STATEMENT,
+        N_IF,
+        N_ELSE,             // else_part => else statement_sequence | ε
+        N_REPEAT,
+        N_DO,
+        N_ASSIGN,
+        N_READ,
+        N_WRITE,
+        N_DECLARATION,
+        N_TYPE,
+        N_VAR_LIST,         // variable_list => ID init var_list_rest
+        N_INIT,             // init => := expression | ε
+        N_VAR_LIST_REST,    // var_list_rest => , variable_list | ε
+        N_EXPRESSION,       // logical_or
+        N_OR_REST,
+        N_AND_EXP,
+        N_AND_REST,
+        N_EQUALITY_EXP,
+        N_EQUALITY_REST,
+        N_RELATIONAL_EXP,
+        N_RELATIONAL_REST,
+        N_ADDITIVE_EXP,
+        N_ADDITIVE_REST,
+        N_MULTIPLICATIVE_EXP,
+        N_MULTIPLICATIVE_REST,
+        N_FACTOR,
+        NONTERMINAL_COUNT
+    };
+
+    constexpr const char *nonTerminalNames[NONTERMINAL_COUNT] = {
+            "statement_sequence()", "statement_sequence()", "statement()", "if_else_statement()", "if_else_statement()",
+            "repeat_until_statement()", "do_while_statement()", "assign_statement()", "read_statement()",
+            "write_statement()", "declaration_statement()", "declaration_statement()", "variable_list_statement()",
+            "variable_list_statement()", "variable_list_statement()", "expression()", "expression()", "expression()",
+            "expression()", "expression()", "expression()", "expression()", "expression()", "expression()",
+            "expression()", "expression()", "expression()", "factor_expression()"
+    };
+
+    /**
+     * 建树动作. 语法分析栈弹出动作时对值栈(已经建好的子树)操作, 执行时的当前Token和递归下降建立对应节点时相同,
+     * 所以节点的行号和属性都一样.
+     */
+    enum BuildAction : uint8_t {
+        B_NEW_IF,          // 压入 If 节点
+        B_NEW_REPEAT,
+        B_NEW_DO,          // 压入 While 节点(do ... while)
+        B_NEW_WRITE,
+        B_NEW_READ,
+        B_READ_ID,         // 当前Token是ID时设置栈顶 Read 节点的属性
+        B_NEW_ASSIGN,      // 当前Token(ID)作为属性
+        B_NEW_DECLARATION, // 当前Token(类型)作为属性
+        B_NEW_VARIABLE,    // 当前Token(ID)作为属性
+        B_NEW_UNARY,       // 压入运算符节点
+        B_NEW_BINARY,      // 弹出左操作数, 压入以它为第一个子节点的运算符节点
+        B_NEW_LEAF,        // 压入常量或者ID节点
+        B_ADD_CHILD,       // 弹出栈顶, 作为新栈顶的子节点
+        B_APPEND           // 弹出栈顶, 接在新栈顶的兄弟链末尾
+    };
+
+    enum SymbolKind : uint8_t {
+        S_TERMINAL, S_NONTERMINAL, S_ACTION
+    };
+
+    struct GrammarSymbol {
+        SymbolKind kind = S_TERMINAL;
+        uint8_t value = 0;
+    };
+
+    constexpr GrammarSymbol t(TokenType token) { return {S_TERMINAL, (uint8_t) token}; }
+
+    constexpr GrammarSymbol n(NonTerminal symbol) { return {S_NONTERMINAL, symbol}; }
+
+    constexpr GrammarSymbol a(BuildAction action) { return {S_ACTION, action}; }
+
+    struct Production {
+        static constexpr size_t MAX_LENGTH = 8;
+
+        NonTerminal lhs = N_STMT_SEQ;
+        uint8_t length = 0;
+        std::array<GrammarSymbol, MAX_LENGTH> rhs{};
+
+        constexpr Production(NonTerminal lhs, std::initializer_list<GrammarSymbol> symbols) : lhs(lhs) {
+            for (auto symbol:symbols) rhs[length++] = symbol;
+        }
+    };
+
+    /**
+     * 文法. 第一个产生式的左部 statement_sequence 是开始符号, 它的后面是 END_FILE.
+     */
+    constexpr Production grammar[] = {
+            {N_STMT_SEQ,            {n(N_STATEMENT), n(N_STMT_SEQ_REST)}},
+            {N_STMT_SEQ_REST,       {t(SEMI), n(N_STATEMENT), a(B_APPEND), n(N_STMT_SEQ_REST)}},
+            {N_STMT_SEQ_REST,       {}},
+
+            {N_STATEMENT,           {n(N_IF)}},
+            {N_STATEMENT,           {n(N_REPEAT)}},
+            {N_STATEMENT,           {n(N_DO)}},
+            {N_STATEMENT,           {n(N_ASSIGN)}},
+            {N_STATEMENT,           {n(N_READ)}},
+            {N_STATEMENT,           {n(N_WRITE)}},
+            {N_STATEMENT,           {n(N_DECLARATION)}},
+
+            {N_IF,                  {a(B_NEW_IF), t(IF), n(N_EXPRESSION), a(B_ADD_CHILD),
+                                            t(THEN), n(N_STMT_SEQ), a(B_ADD_CHILD), n(N_ELSE)}},
+            {N_ELSE,                {t(ELSE), n(N_STMT_SEQ), a(B_ADD_CHILD), t(END)}},
+            {N_ELSE,                {t(END)}},
+            {N_REPEAT,              {a(B_NEW_REPEAT), t(REPEAT), n(N_STMT_SEQ), a(B_ADD_CHILD),
+                                            t(UNTIL), n(N_EXPRESSION), a(B_ADD_CHILD)}},
+            {N_DO,                  {a(B_NEW_DO), t(DO), n(N_STMT_SEQ), a(B_ADD_CHILD),
+                                            t(WHILE), n(N_EXPRESSION), a(B_ADD_CHILD)}},
+            {N_ASSIGN,              {a(B_NEW_ASSIGN), t(ID), t(ASSIGN), n(N_EXPRESSION), a(B_ADD_CHILD)}},
+            {N_READ,                {a(B_NEW_READ), t(READ), a(B_READ_ID), t(ID)}},
+            {N_WRITE,               {a(B_NEW_WRITE), t(WRITE), n(N_EXPRESSION), a(B_ADD_CHILD)}},
+
+            {N_DECLARATION,         {a(B_NEW_DECLARATION), n(N_TYPE), n(N_VAR_LIST), a(B_ADD_CHILD)}},
+            {N_TYPE,                {t(INT)}},
+            {N_TYPE,                {t(FLOAT)}},
+            {N_TYPE,                {t(DOUBLE)}},
+            {N_TYPE,                {t(BOOL)}},
+            {N_TYPE,                {t(STRING)}},
+            {N_VAR_LIST,            {a(B_NEW_VARIABLE), t(ID), n(N_INIT), n(N_VAR_LIST_REST)}},
+            {N_INIT,                {t(ASSIGN), n(N_EXPRESSION), a(B_ADD_CHILD)}},
+            {N_INIT,                {}},
+            {N_VAR_LIST_REST,       {t(COMMA), n(N_VAR_LIST), a(B_APPEND)}},
+            {N_VAR_LIST_REST,       {}},
+
+            {N_EXPRESSION,          {n(N_AND_EXP), n(N_OR_REST)}},
+            {N_OR_REST,             {a(B_NEW_BINARY), t(OR), n(N_AND_EXP), a(B_ADD_CHILD), n(N_OR_REST)}},
+            {N_OR_REST,             {}},
+            {N_AND_EXP,             {n(N_EQUALITY_EXP), n(N_AND_REST)}},
+            {N_AND_REST,            {a(B_NEW_BINARY), t(AND), n(N_EQUALITY_EXP), a(B_ADD_CHILD), n(N_AND_REST)}},
+            {N_AND_REST,            {}},
+            {N_EQUALITY_EXP,        {n(N_RELATIONAL_EXP), n(N_EQUALITY_REST)}},
+            {N_EQUALITY_REST,       {a(B_NEW_BINARY), t(EQ), n(N_RELATIONAL_EXP), a(B_ADD_CHILD), n(N_EQUALITY_REST)}},
+            {N_EQUALITY_REST,       {a(B_NEW_BINARY), t(NE), n(N_RELATIONAL_EXP), a(B_ADD_CHILD), n(N_EQUALITY_REST)}},
+            {N_EQUALITY_REST,       {}},
+            {N_RELATIONAL_EXP,      {n(N_ADDITIVE_EXP), n(N_RELATIONAL_REST)}},
+            {N_RELATIONAL_REST,     {a(B_NEW_BINARY), t(LT), n(N_ADDITIVE_EXP), a(B_ADD_CHILD), n(N_RELATIONAL_REST)}},
+            {N_RELATIONAL_REST,     {a(B_NEW_BINARY), t(LE), n(N_ADDITIVE_EXP), a(B_ADD_CHILD), n(N_RELATIONAL_REST)}},
+            {N_RELATIONAL_REST,     {a(B_NEW_BINARY), t(BT), n(N_ADDITIVE_EXP), a(B_ADD_CHILD), n(N_RELATIONAL_REST)}},
+            {N_RELATIONAL_REST,     {a(B_NEW_BINARY), t(BE), n(N_ADDITIVE_EXP), a(B_ADD_CHILD), n(N_RELATIONAL_REST)}},
+            {N_RELATIONAL_REST,     {}},
+            {N_ADDITIVE_EXP,        {n(N_MULTIPLICATIVE_EXP), n(N_ADDITIVE_REST)}},
+            {N_ADDITIVE_REST,       {a(B_NEW_BINARY), t(PLUS), n(N_MULTIPLICATIVE_EXP), a(B_ADD_CHILD), n(N_ADDITIVE_REST)}},
+            {N_ADDITIVE_REST,       {a(B_NEW_BINARY), t(MINUS), n(N_MULTIPLICATIVE_EXP), a(B_ADD_CHILD), n(N_ADDITIVE_REST)}},
+            {N_ADDITIVE_REST,       {}},
+            {N_MULTIPLICATIVE_EXP,  {n(N_FACTOR), n(N_MULTIPLICATIVE_REST)}},
+            {N_MULTIPLICATIVE_REST, {a(B_NEW_BINARY), t(TIMES), n(N_FACTOR), a(B_ADD_CHILD), n(N_MULTIPLICATIVE_REST)}},
+            {N_MULTIPLICATIVE_REST, {a(B_NEW_BINARY), t(OVER), n(N_FACTOR), a(B_ADD_CHILD), n(N_MULTIPLICATIVE_REST)}},
+            {N_MULTIPLICATIVE_REST, {a(B_NEW_BINARY), t(MOD), n(N_FACTOR), a(B_ADD_CHILD), n(N_MULTIPLICATIVE_REST)}},
+            {N_MULTIPLICATIVE_REST, {}},
+            {N_FACTOR,              {a(B_NEW_UNARY), t(NOT), n(N_FACTOR), a(B_ADD_CHILD)}},
+            {N_FACTOR,              {a(B_NEW_LEAF), t(NUM)}},
+            {N_FACTOR,              {a(B_NEW_LEAF), t(TRUE)}},
+            {N_FACTOR,              {a(B_NEW_LEAF), t(FALSE)}},
+            {N_FACTOR,              {a(B_NEW_LEAF), t(STR)}},
+            {N_FACTOR,              {a(B_NEW_LEAF), t(ID)}},
+            {N_FACTOR,              {t(LPAREN), n(N_EXPRESSION), t(RPAREN)}},
+    };
+
+    constexpr size_t PRODUCTION_COUNT = sizeof(grammar) / sizeof(grammar[0]);
+
+    using TokenSet = uint64_t; // 按 TokenType 的位集合
+    static_assert(TOKEN_TYPE_COUNT <= 64, "TokenSet is a 64-bit mask");
+
+    constexpr TokenSet bit(TokenType token) { return TokenSet(1) << token; }
+
+    struct GrammarSets {
+        std::array<bool, NONTERMINAL_COUNT> nullable{};
+        std::array<TokenSet, NONTERMINAL_COUNT> first{};
+        std::array<TokenSet, NONTERMINAL_COUNT> follow{};
+
+        // 符号串 rhs[begin, length) 的 FIRST 集, 符号串可以推出空串时 nullable 为 true
+        constexpr TokenSet firstOf(const Production &p, size_t begin, bool &isNullable) const {
+            TokenSet set = 0;
+            for (size_t i = begin; i < p.length; i++) {
+                auto symbol = p.rhs[i];
+                if (symbol.kind == S_ACTION) continue;
+                if (symbol.kind == S_TERMINAL) {
+                    isNullable = false;
+                    return set | bit((TokenType) symbol.value);
+                }
+                set |= first[symbol.value];
+                if (!nullable[symbol.value]) {
+                    isNullable = false;
+                    return set;
+                }
+            }
+            isNullable = true;
+            return set;
+        }
+    };
+
+    constexpr GrammarSets makeGrammarSets() {
+        GrammarSets sets{};
+        for (bool changed = true; changed;) { // nullable 和 FIRST
+            changed = false;
+            for (auto &p:grammar) {
+                bool isNullable = false;
+                auto first = sets.first[p.lhs] | sets.firstOf(p, 0, isNullable);
+                if (first != sets.first[p.lhs] || (isNullable && !sets.nullable[p.lhs])) {
+                    sets.first[p.lhs] = first;
+                    sets.nullable[p.lhs] = sets.nullable[p.lhs] || isNullable;
+                    changed = true;
+                }
+            }
+        }
+        sets.follow[N_STMT_SEQ] = bit(END_FILE);
+        for (bool changed = true; changed;) { // FOLLOW
+            changed = false;
+            for (auto &p:grammar) {
+                for (size_t i = 0; i < p.length; i++) {
+                    if (p.rhs[i].kind != S_NONTERMINAL) continue;
+                    bool restNullable = false;
+                    auto follow = sets.follow[p.rhs[i].value] | sets.firstOf(p, i + 1, restNullable);
+                    if (restNullable) follow |= sets.follow[p.lhs];
+                    if (follow != sets.follow[p.rhs[i].value]) {
+                        sets.follow[p.rhs[i].value] = follow;
+                        changed = true;
+                    }
+                }
+            }
+        }
+        return sets;
+    }
+
+    constexpr GrammarSets grammarSets = makeGrammarSets();
+
+    constexpr uint8_t NO_PRODUCTION = std::numeric_limits<uint8_t>::max();
+    static_assert(PRODUCTION_COUNT < NO_PRODUCTION, "production index must fit in uint8_t");
+
+    struct PredictTable {
+        std::array<std::array<uint8_t, TOKEN_TYPE_COUNT>, NONTERMINAL_COUNT> table{};
+        bool conflict = false;
+    };
+
+    /**
+     * 产生式 A => α 填在 FIRST(α) 的每个Token上; α 可以推出空串时还要填在 FOLLOW(A) 上.
+     * 同一格被填两次说明文法不是 LL(1).
+     */
+    constexpr PredictTable makePredictTable() {
+        PredictTable predict{};
+        for (auto &row:predict.table) {
+            for (auto &cell:row) cell = NO_PRODUCTION;
+        }
+        for (size_t i = 0; i < PRODUCTION_COUNT; i++) {
+            auto &p = grammar[i];
+            bool isNullable = false;
+            auto set = grammarSets.firstOf(p, 0, isNullable);
+            if (isNullable) set |= grammarSets.follow[p.lhs];
+            for (size_t token = 0; token < TOKEN_TYPE_COUNT; token++) {
+                if (!(set & (TokenSet(1) << token))) continue;
+                auto &cell = predict.table[p.lhs][token];
+                if (cell != NO_PRODUCTION && cell != i) predict.conflict = true;
+                cell = (uint8_t) i;
+            }
+        }
+        return predict;
+    }
+
+    constexpr PredictTable predict = makePredictTable();
+    static_assert(!predict.conflict, "grammar is not LL(1)");
+}
+
+#endif //COMPILER_PARSERTABLE_H
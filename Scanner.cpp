@@ -2,348 +2,760 @@
 // Created by junior on 19-4-7.
 //
 #include "Scanner.h"
-#include "StringLiteralPool.h"
+#include "FileUtil.h"
 #include "Exception.h"
+#include "ScannerTable.h"
+#include "SimdScan.h"
+#include "Dump.h"
+#include "CompilerContext.h"
+#include <charconv>
 
 namespace Compiler::Scanner {
-    // DFA 状态
-    typedef enum {
-        START,
-        INCOMMENT, // {comment}
-        INSTR,    // 'str'
-        INID,     // [a-z;A-z][0-9;A-Z;a-z]*
-        INASSIGN, // :=
-        INNE,     // !=
-        INBE,     // >=
-        INLE,     // <=
+    /**
+     * 按照接受时的DFA状态转换数值常量, 不需要构造字符串:
+     * IN_DECIMAL/IN_ZERO 十进制, IN_OCT 八进制(0开头), IN_HEX 十六进制(去掉0x/0X), IN_FLOAT 浮点(f/F结尾为单精度).
+     * 整数常量不能超过 int 的范围(2^31-1), 浮点常量不能超过 float/double 的范围, 超出范围返回 false.
+     * (Token中间跳过的非法字符仍然在视图里, 转换会在那里停下; 非法字符已经报告过, 这里不再重复报错)
+     */
+    bool convertNumber(std::string_view text, State state, num_t &number) {
+        const char_t *first = text.data();
+        const char_t *last = first + text.size();
+        std::from_chars_result result{};
+        if (state == IN_FLOAT) {
+            if (text.back() == 'f' || text.back() == 'F') {
+                float_t value = 0;
+                result = std::from_chars(first, last - 1, value);
+                number = value;
+            } else {
+                double_t value = 0;
+                result = std::from_chars(first, last, value);
+                number = value;
+            }
+        } else {
+            int base = 10;
+            if (state == IN_OCT) {
+                base = 8;
+            } else if (state == IN_HEX) {
+                base = 16;
+                first += 2;
+            }
+            int_t value = 0;
+            result = std::from_chars(first, last, value, base);
+            number = value;
+        }
+        return result.ec != std::errc::result_out_of_range;
+    }
+
+    /**
+     * 把 validateUtf8 找到的非法序列换算成行号和列号(从1开始的字节位置), 依次调用 report(offset, line, column, byte).
+     * from 在整个输入里的偏移是 offset, 位于第 line 行, 这一行从偏移 lineBegin 开始.
+     */
+    template<typename Report>
+    void locateInvalid(const std::vector<const char_t *> &invalid, const char_t *from, size_t offset,
+                       int line, size_t lineBegin, Report &&report) {
+        for (auto p:invalid) {
+            const char_t *newline;
+            while ((newline = static_cast<const char_t *>(memchr(from, '\n', (size_t) (p - from)))) != nullptr) {
+                line++;
+                offset += (size_t) (newline + 1 - from);
+                lineBegin = offset;
+                from = newline + 1;
+            }
+            offset += (size_t) (p - from);
+            from = p;
+            report(offset, line, offset - lineBegin + 1, (unsigned char) *p);
+        }
+    }
+
+    string_t encodingError(int line, size_t column, unsigned char byte) {
+        char hex[8];
+        snprintf(hex, sizeof(hex), "0x%02X", byte);
+        return "LineNumber:" + std::to_string(line) + ",Pos:" + std::to_string(column) + ",invalid UTF-8 byte:" + hex;
+    }
+
+    /**
+     * 扫描器的全部状态. 逐个扫描时每个 CompilerContext 只有一个实例(ScannerState::serial), 在 FileUtil::nextBlock() 给出的内容块上扫描;
+     * 并行扫描时每个线程在自己的分块上使用独立的实例, 互不影响.
+     * 行号在读到每一行的第一个字符时加一, 和以前逐行 fgets 时的计数方式保持一致.
+     */
+    struct Lexer {
+        // 内容来源: source 不为空时从 FileUtil::nextBlock() 逐块读取, 否则只扫描一个固定的分块
+        FileUtil::SourceFile *source = nullptr;
+        // 分块扫描时, 不是文件最后一块的块尾不算EOF: getToken() 在块尾停下来, 记录停下时的状态
+        bool lastChunk = true;
+        State exitState = START;
+        // 不为空时词法错误记到 output->diagnostics (按Token下标), 否则直接提交给 ExceptionHandle
+        TokenBuffer *output = nullptr;
+        bool trace = false; // --dump-tokens
+
+        const char_t *cursor = nullptr;     // 下一个要读取的字符
+        const char_t *limit = nullptr;      // 当前块末尾
+        const char_t *blockBegin = nullptr; // 当前块开头
+        size_t blockOffset = 0;             // 当前块在整个输入里的偏移
+        size_t lineOffset = 0;              // 当前行首在整个输入里的偏移,用于计算列号
+        bool lineStart = true; // 下一个字符是否是新一行的开头
+        int lineNumber = 0; // 文件行数
+        bool EOF_flag = false;
+        bool pastEnd = false; // 已经返回过 END_FILE
+
+        /*
+         * 当前Token的文本是当前块上 [tokenBegin, tokenEnd) 的视图.
+         * 如果Token跨越了块的边界,切换块之前先把已经扫描的部分复制到 spill, 之后的字符直接追加到 spill 上
+         * (切换之后上一块会被后台重新填充,视图就失效了). 只有跨块的Token才需要复制.
+         */
+        const char_t *tokenBegin = nullptr;
+        const char_t *tokenEnd = nullptr;
+        string_t spill;
+        bool spilled = false;
+
         /*
-         * 下面的 DECIMAL,OCT,HEX,FLOAT 都会被解析为 NUM（数值常量型）Token.
-         * 而不会分成四种Token来处理,原因很简单,在没有语法语义分析之前尚不能确定它们所指变量的实际类型,
-         * 比如 int a = 1.23; 实际a的类型为int,只有后面语法语义分析的时候才能正确解析:
-         * 在语法分析的时候,解析常量 1.23 的属性为 double ,然后储存在语法树节点里;
-         * 在语义分析里,根据a的类型为int,选择将常量1.23转换为int型,再赋值给a,最后a的值是1.
-         * 因此,数值常量都当做NUM型,都用字符串储存数值才是最佳选择,用字符串储存不会丢失任何精度信息,
-         * 在后面语法分析设置语法树节点属性值(int/double/float)的时候也比较容易cast.
-         *
-         * TODO: 现在还有个负数常量没有解决,我之前考虑将所有的整型常量(16/10/8进制)都看成没有符号的(但是在语法树节点属性里依旧设置为int属性).
-         *   实际处理负号(-)或者正号(+)是通过解析为运算符解决,但是运算符只能处理 NUM (+/- NUM)* 的情况, 如果是单独一个 (+/-)NUM
-         *   就不行了. 这里考虑的解决方案是: 给正负运算规则加上 (+/-)NUM 的规则,在语义分析里,这个规则的语义是: 0 (+/-) NUM.
+         * UTF-8 校验: 每切换到新的一块先整块校验一次(mmap 的文件只有一块).
+         * 流式读取时一个字符可能被块的边界截断, 截断的部分保存在 carry 里, 下一块到来时再接着检查.
+         * 找到的错误(在整个输入里的偏移, 错误信息)先放在 encodingErrors 里, 每扫描完一个Token报告在它结束之前的那些:
+         * 编码错误和非法字符一样按所在的Token排序, 报告的顺序和文件是整个映射还是按块读取无关.
          */
-                IN_DECIMAL,  // 十进制
-        IN_OCT,     // 八进制
-        IN_HEX,     // 十六进制
-        IN_FLOAT,   // 浮点数值常量,包括双精度浮点常量和单精度浮点常量(最后带一个f或者F)
-        DONE
-    } State;
-
-    char_t buffer[LINE_BUFFER_SIZE]; // 用buffer储存文件读取的每一行
-    int bufSize = 0;    // 读取一行后实际的一行长度
-    int lineNumber = 0; // 文件行数
-    int pos = 0;        // 读取一行后,每一个字符的游标
-    bool EOF_flag = false;
-
-    int getNextChar() {
-        if (pos >= bufSize) { // 读取新的一行
-            lineNumber++;
-            /* fgets(char* buffer,int buffer_size,FILE*) 从文件读取一行,
-               这一行的数据包括换行符"\n"都会包括在缓存buffer里.*/
-            if (fgets(buffer, LINE_BUFFER_SIZE - 1, Compiler::file)) {
-                bufSize = (int) strlen(buffer);
-                pos = 0;
-                if (ECHO_SOURCE) { // 打印源码
-                    if (buffer[bufSize - 1] == '\n')
-                        fprintf(OUTPUT_STREAM, "%4d: %s", lineNumber, buffer);
-                    else
-                        fprintf(OUTPUT_STREAM, "%4d: %s\n", lineNumber, buffer);
+        std::vector<const char_t *> invalid;
+        string_t carry;
+        size_t carryOffset = 0;
+        int carryLine = 0;
+        size_t carryColumn = 0;
+        std::vector<std::pair<size_t, string_t>> encodingErrors;
+        size_t reportedEncoding = 0; // encodingErrors 里已经报告的个数
+        size_t firstReport = npos;   // 扫描完第一个Token时 output->diagnostics 的大小, 并行扫描拼接分块时使用
+
+        static constexpr size_t npos = std::numeric_limits<size_t>::max();
+
+        std::string_view lexeme() const {
+            if (spilled) return spill;
+            if (tokenBegin == nullptr) return {};
+            return std::string_view(tokenBegin, (size_t) (tokenEnd - tokenBegin));
+        }
+
+        // 打印当前行的源码(流式读取时只打印当前块里的部分)
+        void echoLine() const {
+            auto end = static_cast<const char_t *>(memchr(cursor, '\n', (size_t) (limit - cursor)));
+            auto length = (int) ((end != nullptr ? end : limit) - cursor);
+            Dump::Writer::getInstance().printf("%4d: %.*s\n", lineNumber, length, cursor);
+        }
+
+        int getNextChar() {
+            if (cursor >= limit) { // 当前块已经扫描完,切换到下一块
+                // 只有流式读取的块会被回收重新填充, 映射区一直有效, 不需要复制
+                if (tokenBegin != nullptr && !spilled && source != nullptr && source->mapping == nullptr) {
+                    spill.assign(tokenBegin, tokenEnd);
+                    spilled = true;
+                }
+                const char_t *begin, *end;
+                if (source == nullptr || !FileUtil::nextBlock(*source, begin, end)) { // 已经到文件尾(或者分块末尾)
+                    if (!lastChunk) return EOF;
+                    if (!carry.empty()) { // 文件末尾被截断的字符
+                        encodingErrors.emplace_back(carryOffset, encodingError(carryLine, carryColumn,
+                                                                               (unsigned char) carry[0]));
+                        carry.clear();
+                    }
+                    lineNumber++;
+                    if (ECHO_SOURCE) {
+                        Dump::Writer::getInstance().printf("%4d: EOF\n", lineNumber);
+                        Dump::Writer::getInstance().flush();
+                    }
+                    EOF_flag = true;
+                    return EOF;    // 返回EOF字符
                 }
-                return buffer[pos++];
-            } else { // 读取一行失败,说明已经到文件尾
-                if (ECHO_SOURCE)
-                    fprintf(OUTPUT_STREAM, "%4d: EOF\n", lineNumber);
-                EOF_flag = true;
-                return EOF;    // 返回EOF字符
+                blockOffset += (size_t) (limit - blockBegin);
+                blockBegin = cursor = begin;
+                limit = end;
+                checkEncoding(source->mapping != nullptr);
             }
-        } else return buffer[pos++];
-    }
+            if (lineStart) { // 进入新的一行
+                lineNumber++;
+                lineStart = false;
+                lineOffset = blockOffset + (size_t) (cursor - blockBegin);
+                if (ECHO_SOURCE) echoLine(); // 打印源码
+            }
+            // 按 unsigned char 返回,避免 0xFF 之类的字节被当成 EOF
+            auto c = (unsigned char) *cursor++;
+            if (c == '\n') lineStart = true;
+            return c;
+        }
 
-    // 字符回退
-    void undoGetNextChar() {
-        if (!EOF_flag) pos--;
-    }
+        /**
+         * 校验刚刚切换到的一块 [cursor, limit) 的编码, 在读取这一块的第一个字符之前调用.
+         * final 表示这是输入的最后一块(mmap 的文件), 末尾被截断的字符直接报错.
+         */
+        void checkEncoding(bool final) {
+            const char_t *from = cursor;
+            int line = lineStart ? lineNumber + 1 : lineNumber;
+            size_t lineBegin = lineStart ? blockOffset : lineOffset;
+            if (!carry.empty()) { // 上一块末尾被截断的字符, 用这一块开头的字节补全
+                auto needed = std::min<size_t>(4 - carry.size(), (size_t) (limit - cursor));
+                string_t joined = carry + string_t(cursor, needed);
+                int length = Simd::decodeUtf8(joined.data(), joined.data() + joined.size());
+                if (length == 0 && !final) { // 这一块太短还不够补全
+                    carry = joined;
+                    return;
+                }
+                if (length <= 0) {
+                    encodingErrors.emplace_back(carryOffset, encodingError(carryLine, carryColumn,
+                                                                           (unsigned char) carry[0]));
+                }
+                // 合法时跳过字符剩下的字节; 非法时跳过最大子部分在这一块里的字节
+                auto used = length > 0 ? (size_t) length : length < 0 ? (size_t) -length : joined.size();
+                from += used > carry.size() ? used - carry.size() : 0;
+                carry.clear();
+            }
+            invalid.clear();
+            auto tail = Simd::validateUtf8(from, limit, final, invalid);
+            locateInvalid(invalid, cursor, blockOffset, line, lineBegin,
+                          [this](size_t offset, int l, size_t column, unsigned char byte) {
+                              encodingErrors.emplace_back(offset, encodingError(l, column, byte));
+                          });
+            if (tail != limit) {
+                carry.assign(tail, limit);
+                carryOffset = blockOffset + (size_t) (tail - cursor);
+                auto newlines = std::count(cursor, tail, '\n');
+                carryLine = line + (int) newlines;
+                auto lastNewline = static_cast<const char_t *>(memrchr(cursor, '\n', (size_t) (tail - cursor)));
+                carryColumn = lastNewline != nullptr ? (size_t) (tail - lastNewline)
+                                                     : blockOffset + (size_t) (tail - cursor) - lineBegin + 1;
+            }
+        }
 
-    TokenRet getToken() {
-        using namespace Compiler::Exception;
-        string_t tokenString;
-        TokenType currentToken = END_FILE;
-        State state = START;
-        bool saveTokenString;
-        auto legalCharTable = getLegalCharTable();
-        auto keyWordTable = getKeyWordTable();
-
-        while (state != DONE) {
-            int c = getNextChar();
-            if (legalCharTable.find((char_t) c) == legalCharTable.end()) {
-                if (state == INCOMMENT || state == INSTR) {
-                    // pass,不处理
+        // 字符回退(只会回退刚刚读取的一个字符,所以不会退回到上一块)
+        void undoGetNextChar() {
+            if (!EOF_flag) {
+                cursor--;
+                lineStart = false; // 回退的字符(即使是换行符)还属于当前行
+            }
+        }
+
+        // 扫描完一个Token: 报告在游标之前的编码错误
+        void reportEncoding() {
+            if (firstReport == npos && output != nullptr) firstReport = output->diagnostics.size();
+            if (reportedEncoding == encodingErrors.size()) return;
+            auto position = blockOffset + (size_t) (cursor - blockBegin);
+            while (reportedEncoding < encodingErrors.size() && encodingErrors[reportedEncoding].first < position) {
+                report(encodingErrors[reportedEncoding++].second);
+            }
+            if (reportedEncoding == encodingErrors.size()) {
+                encodingErrors.clear();
+                reportedEncoding = 0;
+            }
+        }
+
+        // 当前字符在行内的位置
+        size_t getColumn() const {
+            return blockOffset + (size_t) (cursor - blockBegin) - lineOffset;
+        }
+
+        /**
+         * 一次跳过 [cursor, skip.stop) 的所有字符, 行号和行首的更新与逐个调用 getNextChar() 完全一致.
+         * (ECHO_SOURCE 需要逐行打印源码, 所以打开 ECHO_SOURCE 时不走快速路径)
+         */
+        void skipTo(const Simd::SkipResult &skip) {
+            if (skip.stop == cursor) return;
+            if (lineStart) {
+                lineNumber++;
+                lineOffset = blockOffset + (size_t) (cursor - blockBegin);
+            }
+            lineStart = false;
+            if (skip.newlines > 0) {
+                if (skip.lastNewline + 1 == skip.stop) {
+                    // 最后一个字符是换行符: 下一次读取时才进入新的一行
+                    lineNumber += (int) skip.newlines - 1;
+                    lineStart = true;
                 } else {
-                    ExceptionHandle::getHandle().add_exception(
-                            ExceptionType::LEXICAL_ERROR,
-                            "LineNumber:" + std::to_string(lineNumber) + ",Pos:" +
-                            std::to_string(pos) + ",illegal char:" + char_t(c));
-                    continue; // 跳过非法字符
+                    lineNumber += (int) skip.newlines;
+                    lineOffset = blockOffset + (size_t) (skip.lastNewline + 1 - blockBegin);
                 }
-            }// 处理非法字符,直接跳过,在注释里或者字符串里的字符不管合不合法.
-            saveTokenString = true;
+            }
+            cursor = skip.stop;
+        }
+
+        // 在进入下一个字符的DFA转移之前,批量跳过不影响DFA状态的字符
+        void fastSkip(State state) {
+            if (ECHO_SOURCE || cursor >= limit) return;
             switch (state) {
-                case START:
-                    if (c == '.') {
-                        state = IN_FLOAT;
-                    } else if (c == '0') {
-                        state = IN_OCT;
-                    } else if (c >= '1' && c <= '9') {
-                        state = IN_DECIMAL;
-                    } else if (isalpha(c)) {
-                        state = INID;
-                    } else if (c == ':') {
-                        state = INASSIGN;
-                    } else if (c == '!') {
-                        state = INNE;
-                    } else if (c == '>') {
-                        state = INBE;
-                    } else if (c == '<') {
-                        state = INLE;
-                    } else if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
-                        saveTokenString = false;
-                    } else if (c == '{') {
-                        saveTokenString = false;
-                        state = INCOMMENT;
-                    } else if (c == '\'') {
-                        saveTokenString = false; // str常量开头的'不记录在tokenString里
-                        state = INSTR;
-                    } else {
-                        state = DONE;
-                        switch (c) {
-                            case EOF:
-                                saveTokenString = false;
-                                currentToken = END_FILE;
-                                break;
-                            case '=':
-                                currentToken = EQ;
-                                break;
-                            case '+':
-                                currentToken = PLUS;
-                                break;
-                            case '-':
-                                currentToken = MINUS;
-                                break;
-                            case '*':
-                                currentToken = TIMES;
-                                break;
-                            case '/':
-                                currentToken = OVER;
-                                break;
-                            case '%':
-                                currentToken = MOD;
-                                break;
-                            case '(':
-                                currentToken = LPAREN;
-                                break;
-                            case ')':
-                                currentToken = RPAREN;
-                                break;
-                            case ';':
-                                currentToken = SEMI;
-                                break;
-                            case ',':
-                                currentToken = COMMA;
-                                break;
-                            default:
-                                currentToken = ERROR;
-                                break;
-                        }
+                case START: // 多数Token之间只有一个空格,第一个字符不是空白就不必调用
+                    if (charClass((unsigned char) *cursor) == C_BLANK || *cursor == '\n') {
+                        skipTo(Simd::skipBlank(cursor, limit));
                     }
                     break;
                 case INCOMMENT:
-                    saveTokenString = false;
-                    if (c == '}') {
-                        state = START;
-                    } else if (c == EOF) {
-                        // 处理不匹配的情况,在EOF时如果还没有结束注释(仍然处于INCOMMENT状态)就是不匹配
-                        // (注释允许跨多行,因此可以一直判断到EOF)
-                        state = DONE;
-                        currentToken = END_FILE;
-                        ExceptionHandle::getHandle().add_exception(
-                                ExceptionType::LEXICAL_ERROR,
-                                "Comment match error on : LineNumber " + std::to_string(lineNumber));
-                    }
-                    break;
-                case INSTR:
-                    if (c == '\'') {
-                        saveTokenString = false; // 不记录str常量最后的'字符
-                        state = DONE;
-                        currentToken = STR;
-                    } else if (c == EOF || c == '\n') {
-                        // 处理不匹配情况,在一行结束后还不结束字符串就是不匹配.
-                        saveTokenString = false;
-                        state = DONE;
-                        if (c == EOF) currentToken = END_FILE;
-                        else currentToken = ERROR;
-                        ExceptionHandle::getHandle().add_exception(
-                                ExceptionType::LEXICAL_ERROR,
-                                "String match error on : LineNumber " + std::to_string(lineNumber));
-                    } else {
-                        saveTokenString = true;
-                    }
-                    break;
-                case IN_DECIMAL:
-                    if (!isdigit(c)) {
-                        if (c == '.') state = IN_FLOAT;
-                        else {
-                            undoGetNextChar();
-                            saveTokenString = false;
-                            state = DONE;
-                            currentToken = NUM;
-                        }
-                    }
+                    skipTo(Simd::skipComment(cursor, limit));
                     break;
-                case IN_FLOAT:
-                    // 注意其他状态已经处理了第一次小数点的出现,所以这里只需要处理[小数部分]即可,一旦发现非数字就结束.
-                    // 当然这样做在处理像 0.2555.23555.356.33 的时候会切成: 0.2555 .23555 .356 .33 四个NUM,
-                    // 看上去好像是很不合理的,但是在词法分析这一轮我们不关心语法的问题,只要把词切出来即可,
-                    // 后面语法分析很容易就可以分析出　NUM NUM NUM NUM 这样的句子是非法的.
-                    // 另外这里有一些特殊情况需要处理:
-                    // 比如.021或者12.这些值是允许的,可以认为是 0.021 以及 12.0, 但如果只有单独一个小数点,则是非法的Token
-                    if (!isdigit(c)) {
-                        if (tokenString == ".") {
-                            undoGetNextChar();
-                            saveTokenString = false;
-                            currentToken = ERROR; // 只出现一个小数点,Token非法.
-                        } else {
-                            if (c != 'f' && c != 'F') {
-                                // 如果是末尾带一个f或者F,不需要undoGetNextChar,同时需要把f/F附加到tokenString
-                                undoGetNextChar();
-                                saveTokenString = false;
-                            }
-                            currentToken = NUM;
-                        }
-                        state = DONE;
-                    }
+                case INSTR: {
+                    auto skip = Simd::skipString(cursor, limit); // 字符串内容全部保存,不检查字符是否合法
+                    if (spilled) spill.append(cursor, skip.stop);
+                    else tokenEnd = skip.stop;
+                    skipTo(skip);
                     break;
-                case IN_OCT:
-                    if (!(c >= '0' && c <= '7')) {
-                        if ((c == 'x' || c == 'X') && tokenString == "0") {
-                            state = IN_HEX;  // 0x或者0X
-                        } else if (c == '.') {
-                            state = IN_FLOAT; // [0-7]+. 浮点数值
-                        } else {
-                            // 这里不需要对c=='8'或者c=='9'或者其他情况做错误分析处理,直接丢给下一个Token即可,
-                            // 反正后面语法分析的时候很容易就可以发现这些错误了,
-                            // 比如 int a := 0147999,切成 INT ID := NUM(0147) NUM(999),根据语法完全可以判断出错误.
-                            undoGetNextChar();
-                            saveTokenString = false;
-                            state = DONE;
-                            currentToken = NUM;
-                            // 如果输入串只是一个"0",虽然是十进制,但Token类型依旧是NUM型,所以不用额外处理.
-                        }
-                    }
-                    break;
-                case IN_HEX:
-                    if (!(isdigit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'))) {
-                        if (tokenString == "0x" || tokenString == "0X") {
-                            // 只有一个0x或者0X,是无法构成数值的,token为ERROR.
-                            currentToken = ERROR;
-                        } else {
-                            currentToken = NUM;
-                        }
-                        undoGetNextChar();
-                        saveTokenString = false;
-                        state = DONE;
-                    }
-                    break;
-                case INID:
-                    if (!isalpha(c) && !isdigit(c)) {
-                        undoGetNextChar();
-                        saveTokenString = false;
-                        state = DONE;
-                        currentToken = ID;
-                    }
+                }
+                default:
                     break;
-                case INASSIGN:
-                    state = DONE;
-                    if (c == '=') {
-                        currentToken = ASSIGN;
-                    } else {
-                        undoGetNextChar();
-                        saveTokenString = false;
-                        currentToken = ERROR;
+            }
+        }
+
+        void saveChar(int c) {
+            if (spilled) {
+                spill += (char_t) c;
+            } else {
+                if (tokenBegin == nullptr) tokenBegin = cursor - 1;
+                tokenEnd = cursor;
+            }
+        }
+
+        void report(const string_t &message) {
+            using namespace Compiler::Exception;
+            if (output != nullptr) {
+                output->diagnostics.emplace_back((uint32_t) output->size(),
+                                                 ExceptionEntry{message, ExceptionType::LEXICAL_ERROR});
+            } else {
+                ExceptionHandle::getHandle().add_exception(ExceptionType::LEXICAL_ERROR, message);
+            }
+        }
+
+        /**
+         * 表驱动的DFA: 每读一个字符只需要查一次字节分类表和一次转移表(见 ScannerTable.h).
+         * entry 是入口状态, 只有并行扫描猜测"分块从注释中间开始"时才是 INCOMMENT.
+         */
+        TokenRet getToken(State entry = START) {
+            tokenBegin = tokenEnd = nullptr;
+            spill.clear();
+            spilled = false;
+            State state = entry;
+            State accepting = START; // 转移到 DONE 之前的状态, 用来确定数值常量的进制
+            Transition transition;
+
+            do {
+                fastSkip(state);
+                int c = getNextChar();
+                if (c == EOF && !lastChunk) { // 分块末尾(一定在行首), 只可能处于 START 或者 INCOMMENT
+                    exitState = state;
+                    return {END_FILE, {}, lineNumber};
+                }
+                transition = transitions[state][charClass(c)];
+                if (transition.action != A_NONE) {
+                    if (transition.action & A_ILLEGAL) { // 处理非法字符,直接跳过,在注释里或者字符串里的字符不管合不合法.
+                        report("LineNumber:" + std::to_string(lineNumber) + ",Pos:" +
+                               std::to_string(getColumn()) + ",illegal char:" + char_t(c));
+                        continue;
                     }
-                    break;
-                case INNE:
-                    state = DONE;
-                    if (c == '=') {
-                        currentToken = NE;
-                    } else {
-                        undoGetNextChar();
-                        saveTokenString = false;
-                        currentToken = ERROR;
+                    if (transition.action & A_SAVE) saveChar(c);
+                    if (transition.action & A_UNDO) undoGetNextChar();
+                    if (transition.action & A_STRING_BEGIN) {
+                        tokenBegin = tokenEnd = cursor; // 空字符串''也要有一个(空的)视图
                     }
-                    break;
-                case INBE:
-                    state = DONE;
-                    if (c == '=') {
-                        currentToken = BE;
-                    } else {
-                        undoGetNextChar();
-                        saveTokenString = false;
-                        currentToken = BT; // 只保留 > Token
+                    if (transition.action & A_COMMENT_ERROR) {
+                        // 在EOF时如果还没有结束注释(仍然处于INCOMMENT状态)就是不匹配
+                        report("Comment match error on : LineNumber " + std::to_string(lineNumber));
                     }
-                    break;
-                case INLE:
-                    state = DONE;
-                    if (c == '=') {
-                        currentToken = LE;
-                    } else {
-                        undoGetNextChar();
-                        saveTokenString = false;
-                        currentToken = LT; // 只保留 < Token
+                    if (transition.action & A_STRING_ERROR) {
+                        report("String match error on : LineNumber " + std::to_string(lineNumber));
                     }
-                    break;
-                case DONE:
-                    break;
+                }
+                accepting = state;
+                state = transition.next;
+            } while (state != DONE);
+
+            auto currentToken = (TokenType) transition.token;
+            // 其他类型的Token,比如关键字,特殊符号,END_FILE,都不需要一个TokenString.
+            std::string_view tokenString;
+            if (currentToken == ID) {
+                currentToken = lookupKeyword(lexeme());
             }
-            if (saveTokenString) {
-                tokenString += (char_t) c;
+            if (currentToken == STR || currentToken == ID || currentToken == NUM || currentToken == ERROR) {
+                tokenString = lexeme();
             }
-            if (state == DONE) {
-                if (currentToken == ID) {
-                    auto key_ = keyWordTable.find(tokenString);
-                    if (key_ != keyWordTable.end()) {
-                        currentToken = (*key_).second;
-                    }
+            num_t number{};
+            if (currentToken == NUM && !convertNumber(tokenString, accepting, number)) {
+                report("LineNumber:" + std::to_string(lineNumber) + ",number out of range:" + string_t(tokenString));
+            }
+            reportEncoding();
+            if (trace && !pastEnd) { // 语法分析越过 END_FILE 继续读取时不再打印, 和批量扫描一样只有一个 EOF
+                dumpToken(lineNumber, currentToken, tokenString);
+            }
+            if (currentToken == END_FILE) pastEnd = true;
+            return {currentToken, tokenString, lineNumber, number};
+        }
+    };
+
+    ScannerState::ScannerState() : serial(std::make_unique<Lexer>()) {}
+
+    ScannerState::~ScannerState() = default;
+
+    TokenRet getToken() {
+        auto &context = CompilerContext::current();
+        auto &serial = *context.scanner.serial;
+        serial.source = context.file;
+        serial.trace = context.options.dumpTokens;
+        return serial.getToken();
+    }
+
+    // buffer 里第 begin 个Token以后的第一个数值
+    std::vector<std::pair<uint32_t, num_t>>::const_iterator firstNumber(const TokenBuffer &buffer, size_t begin) {
+        return std::lower_bound(buffer.numbers.begin(), buffer.numbers.end(), (uint32_t) begin,
+                                [](const std::pair<uint32_t, num_t> &entry, uint32_t i) {
+                                    return entry.first < i;
+                                });
+    }
+
+    void TokenBuffer::clear() {
+        types.clear();
+        offsets.clear();
+        lengths.clear();
+        lines.clear();
+        text.clear();
+        numbers.clear();
+        diagnostics.clear();
+        source = nullptr;
+    }
+
+    void TokenBuffer::reserve(size_t count) {
+        types.reserve(count);
+        offsets.reserve(count);
+        lengths.reserve(count);
+        lines.reserve(count);
+    }
+
+    void TokenBuffer::push(const TokenRet &token) {
+        uint32_t offset = 0;
+        if (token.tokenString.data() != nullptr) {
+            if (source != nullptr) {
+                offset = (uint32_t) (token.tokenString.data() - source);
+            } else {
+                offset = (uint32_t) text.size();
+                text.append(token.tokenString);
+            }
+        }
+        if (token.tokenType == NUM) {
+            numbers.emplace_back((uint32_t) size(), token.number);
+        }
+        types.push_back((uint8_t) token.tokenType);
+        offsets.push_back(offset);
+        lengths.push_back((uint32_t) token.tokenString.size());
+        lines.push_back((uint32_t) token.lineNumber);
+    }
+
+    TokenRet TokenBuffer::get(size_t index) const {
+        auto type = (TokenType) types[index];
+        std::string_view tokenString;
+        if (type == STR || type == ID || type == NUM || type == ERROR) {
+            tokenString = std::string_view((source != nullptr ? source : text.data()) + offsets[index], lengths[index]);
+        }
+        num_t number{};
+        if (type == NUM) {
+            number = firstNumber(*this, index)->second;
+        }
+        return {type, tokenString, (int) lines[index], number};
+    }
+
+    // 逐个扫描整个文件
+    void tokenizeSerial(TokenBuffer &buffer) {
+        auto &context = CompilerContext::current();
+        auto &serial = *context.scanner.serial;
+        serial.source = context.file;
+        serial.trace = context.options.dumpTokens;
+        serial.output = &buffer; // 词法错误按Token下标推迟到语法分析读到这个Token时再提交
+        TokenRet token;
+        do {
+            token = serial.getToken();
+            buffer.push(token);
+        } while (token.tokenType != END_FILE);
+        serial.output = nullptr;
+    }
+
+    bool tokenizeBatch(TokenBuffer &buffer, size_t count) {
+        buffer.clear();
+        auto &context = CompilerContext::current();
+        auto &serial = *context.scanner.serial;
+        buffer.source = context.file->mapping;
+        serial.source = context.file;
+        serial.trace = context.options.dumpTokens;
+        serial.output = &buffer;
+        TokenRet token;
+        do {
+            token = serial.getToken();
+            buffer.push(token);
+        } while (token.tokenType != END_FILE && buffer.size() < count);
+        serial.output = nullptr;
+        return token.tokenType == END_FILE;
+    }
+
+    /**
+     * 并行扫描的一个分块. 分块总是从某一行的行首开始, 而除了注释以外的Token都不能跨行
+     * (字符串遇到换行就报错结束), 所以分块的入口状态只有两种可能: 普通代码(START) 或者 注释中间(INCOMMENT).
+     * 每个分块在两种入口状态下各扫描一次:
+     * 1. 按 START 入口扫描整块, 结果在 tokens, starts[k] 是扫描第 k 个Token时进入 getToken() 的位置;
+     * 2. 按 INCOMMENT 入口扫描, 一旦在 getToken() 入口走到了某个 starts[k], 后面的扫描结果必然和 1 完全相同,
+     *    所以只保存汇合之前的 commentTokens 和汇合点 join. 一般只需要多扫描到第一个 } 附近.
+     * 所有分块扫描完以后, 从第一块(入口一定是 START)开始依次用上一块的出口状态决定下一块取哪个结果.
+     * 编码错误和逐个扫描时一样在扫描完所在的Token时报告. 分块末尾还没有报告的编码错误属于跨块的那个Token,
+     * 拼接时排在后面第一个扫描完Token的分块里, 这个Token扫描过程中的其他词法错误之后.
+     */
+    struct Chunk {
+        const char_t *begin = nullptr;
+        const char_t *end = nullptr;
+        int lineBase = 0; // 分块之前的行数
+        std::vector<const char_t *> invalid; // 非法的 UTF-8 序列
+        std::vector<std::pair<size_t, string_t>> encodingErrors; // 换算成偏移和错误信息, 交给两个 Lexer
+
+        TokenBuffer tokens;
+        std::vector<const char_t *> starts;
+        State exitState = START;
+        size_t firstReport = npos; // 扫描完第一个Token之前 tokens.diagnostics 的个数, 一个Token都没有扫描完则为 npos
+        std::vector<string_t> unreported; // 分块末尾还没有报告的编码错误
+
+        TokenBuffer commentTokens;
+        size_t join = npos; // 汇合时 tokens 里对应的下标, 没有汇合则为 npos
+        State commentExitState = INCOMMENT;
+        size_t commentFirstReport = npos;
+        std::vector<string_t> commentUnreported;
+
+        bool commentEntry = false; // 确定下来的入口状态是否是 INCOMMENT
+        size_t outputBase = 0;     // 这一块的第一个Token在最终结果里的下标
+        size_t numberBase = 0;     // 这一块的第一个数值在最终结果 numbers 里的下标
+
+        static constexpr size_t npos = std::numeric_limits<size_t>::max();
+    };
+
+    Lexer chunkLexer(const char_t *source, const Chunk &chunk, TokenBuffer &output, bool last) {
+        Lexer lexer;
+        lexer.lastChunk = last;
+        lexer.output = &output;
+        lexer.trace = false; // 多个线程同时打印会乱序, 拼接完以后再按顺序打印
+        lexer.cursor = lexer.blockBegin = chunk.begin;
+        lexer.limit = chunk.end;
+        lexer.blockOffset = lexer.lineOffset = (size_t) (chunk.begin - source);
+        lexer.lineNumber = chunk.lineBase;
+        lexer.encodingErrors = chunk.encodingErrors;
+        output.source = source;
+        output.reserve((size_t) (chunk.end - chunk.begin) / 4 + 1);
+        return lexer;
+    }
+
+    // 分块末尾还没有报告的编码错误
+    std::vector<string_t> unreportedEncoding(const Lexer &lexer) {
+        std::vector<string_t> messages;
+        for (auto i = lexer.reportedEncoding; i < lexer.encodingErrors.size(); i++) {
+            messages.push_back(lexer.encodingErrors[i].second);
+        }
+        return messages;
+    }
+
+    void lexChunk(const char_t *source, Chunk &chunk, bool first, bool last) {
+        Lexer lexer = chunkLexer(source, chunk, chunk.tokens, last);
+        TokenRet token;
+        do {
+            chunk.starts.push_back(lexer.cursor);
+            token = lexer.getToken();
+            if (token.tokenType == END_FILE && !last) break; // 分块末尾
+            chunk.tokens.push(token);
+        } while (token.tokenType != END_FILE);
+        chunk.exitState = last ? START : lexer.exitState;
+        chunk.firstReport = lexer.firstReport;
+        chunk.unreported = unreportedEncoding(lexer);
+
+        if (first) return; // 第一块的入口一定是 START
+        Lexer speculative = chunkLexer(source, chunk, chunk.commentTokens, last);
+        State entry = INCOMMENT;
+        size_t k = 0;
+        while (true) {
+            if (entry == START) {
+                while (k < chunk.starts.size() && chunk.starts[k] < speculative.cursor) k++;
+                if (k < chunk.starts.size() && chunk.starts[k] == speculative.cursor) {
+                    chunk.join = k; // 之后的编码错误由 tokens 报告
+                    chunk.commentFirstReport = speculative.firstReport;
+                    return;
+                }
+            }
+            token = speculative.getToken(entry);
+            entry = START;
+            if (token.tokenType == END_FILE && !last) break;
+            chunk.commentTokens.push(token);
+            if (token.tokenType == END_FILE) break;
+        }
+        chunk.commentExitState = last ? START : speculative.exitState;
+        chunk.commentFirstReport = speculative.firstReport;
+        chunk.commentUnreported = unreportedEncoding(speculative);
+    }
+
+    // 第 begin 个Token以后的数值个数
+    size_t countNumbers(const TokenBuffer &buffer, size_t begin) {
+        return (size_t) (buffer.numbers.end() - firstNumber(buffer, begin));
+    }
+
+    /**
+     * 把 from 的第 begin 个以后的Token复制到 to 的第 base 个位置开始, 数值复制到 to.numbers 的第 numberBase 个位置开始.
+     * 返回复制的数值个数.
+     */
+    size_t copyTokens(const TokenBuffer &from, size_t begin, TokenBuffer &to, size_t base, size_t numberBase) {
+        auto count = (std::ptrdiff_t) (from.size() - begin);
+        auto first = (std::ptrdiff_t) begin;
+        auto target = (std::ptrdiff_t) base;
+        std::copy(from.types.begin() + first, from.types.begin() + first + count, to.types.begin() + target);
+        std::copy(from.offsets.begin() + first, from.offsets.begin() + first + count, to.offsets.begin() + target);
+        std::copy(from.lengths.begin() + first, from.lengths.begin() + first + count, to.lengths.begin() + target);
+        std::copy(from.lines.begin() + first, from.lines.begin() + first + count, to.lines.begin() + target);
+        auto number = to.numbers.begin() + (std::ptrdiff_t) numberBase;
+        for (auto pos = firstNumber(from, begin); pos != from.numbers.end(); ++pos, ++number) {
+            *number = {(uint32_t) (pos->first - begin + base), pos->second};
+        }
+        return (size_t) (number - to.numbers.begin()) - numberBase;
+    }
+
+    /**
+     * 把 from.diagnostics 的 [first, last) 里属于第 begin 个以后的Token的词法错误复制到 to,
+     * Token下标从 base 开始.
+     */
+    void copyDiagnostics(const TokenBuffer &from, size_t begin, TokenBuffer &to, size_t base,
+                         size_t first, size_t last) {
+        for (auto i = first; i < last; i++) {
+            auto &diagnostic = from.diagnostics[i];
+            if (diagnostic.first >= begin) {
+                to.diagnostics.emplace_back((uint32_t) (diagnostic.first - begin + base), diagnostic.second);
+            }
+        }
+    }
+
+    void tokenizeParallel(TokenBuffer &buffer, unsigned threads) {
+        auto file = CompilerContext::current().file;
+        const char_t *source = file->mapping;
+        size_t size = file->size;
+        buffer.source = source;
+
+        // 1. 按大小切分, 每个切分点后移到下一个换行符之后. 分块太小时线程的开销比扫描还大
+        threads = (unsigned) std::min<size_t>(threads, size / PARALLEL_LEX_MIN_CHUNK + 1);
+        std::vector<Chunk> chunks(1);
+        chunks[0].begin = source;
+        for (unsigned i = 1; i < threads; i++) {
+            size_t target = size / threads * i;
+            if (source + target < chunks.back().begin) continue;
+            auto newline = static_cast<const char_t *>(memchr(source + target, '\n', size - target));
+            if (newline == nullptr || newline + 1 >= source + size) break;
+            chunks.back().end = newline + 1;
+            chunks.emplace_back();
+            chunks.back().begin = newline + 1;
+        }
+        chunks.back().end = source + size;
+
+        auto parallel = [&chunks](auto &&task) {
+            std::vector<std::future<void>> futures;
+            for (size_t i = 1; i < chunks.size(); i++) {
+                futures.push_back(std::async(std::launch::async, task, i));
+            }
+            task(0);
+            for (auto &future:futures) future.get();
+        };
+
+        // 2. 统计每一块的换行符数量, 前缀和就是每一块开头的行号. 同时校验编码(切分点在换行符之后, 不会截断字符)
+        std::vector<int> newlines(chunks.size());
+        parallel([&](size_t i) {
+            newlines[i] = (int) std::count(chunks[i].begin, chunks[i].end, '\n');
+            Simd::validateUtf8(chunks[i].begin, chunks[i].end, true, chunks[i].invalid);
+        });
+        for (size_t i = 1; i < chunks.size(); i++) {
+            chunks[i].lineBase = chunks[i - 1].lineBase + newlines[i - 1];
+        }
+        for (auto &chunk:chunks) {
+            auto offset = (size_t) (chunk.begin - source);
+            locateInvalid(chunk.invalid, chunk.begin, offset, chunk.lineBase + 1, offset,
+                          [&chunk](size_t at, int line, size_t column, unsigned char byte) {
+                              chunk.encodingErrors.emplace_back(at, encodingError(line, column, byte));
+                          });
+        }
+
+        // 3. 每一块在两种入口状态下分别扫描
+        parallel([&](size_t i) {
+            lexChunk(source, chunks[i], i == 0, i + 1 == chunks.size());
+        });
+
+        // 4. 从第一块开始确定每一块的入口状态和它在最终结果里的位置
+        State entry = START;
+        size_t total = 0, numbers = 0;
+        for (auto &chunk:chunks) {
+            chunk.commentEntry = entry == INCOMMENT;
+            chunk.outputBase = total;
+            chunk.numberBase = numbers;
+            if (!chunk.commentEntry) {
+                total += chunk.tokens.size();
+                numbers += chunk.tokens.numbers.size();
+                entry = chunk.exitState;
+            } else if (chunk.join != Chunk::npos) {
+                total += chunk.commentTokens.size() + chunk.tokens.size() - chunk.join;
+                numbers += chunk.commentTokens.numbers.size() + countNumbers(chunk.tokens, chunk.join);
+                entry = chunk.exitState;
+            } else {
+                total += chunk.commentTokens.size();
+                numbers += chunk.commentTokens.numbers.size();
+                entry = chunk.commentExitState;
+            }
+        }
+
+        // 5. 拼接
+        buffer.types.resize(total);
+        buffer.offsets.resize(total);
+        buffer.lengths.resize(total);
+        buffer.lines.resize(total);
+        buffer.numbers.resize(numbers);
+        parallel([&](size_t i) {
+            auto &chunk = chunks[i];
+            if (!chunk.commentEntry) {
+                copyTokens(chunk.tokens, 0, buffer, chunk.outputBase, chunk.numberBase);
+            } else {
+                auto copied = copyTokens(chunk.commentTokens, 0, buffer, chunk.outputBase, chunk.numberBase);
+                if (chunk.join != Chunk::npos) {
+                    copyTokens(chunk.tokens, chunk.join, buffer, chunk.outputBase + chunk.commentTokens.size(),
+                               chunk.numberBase + copied);
+                }
+            }
+        });
+        std::vector<string_t> unreported; // 前面的分块末尾还没有报告的编码错误
+        for (auto &chunk:chunks) { // 词法错误很少, 按顺序合并即可
+            auto &head = chunk.commentEntry ? chunk.commentTokens : chunk.tokens;
+            auto firstReport = chunk.commentEntry ? chunk.commentFirstReport : chunk.firstReport;
+            auto split = std::min(firstReport, head.diagnostics.size());
+            copyDiagnostics(head, 0, buffer, chunk.outputBase, 0, split);
+            if (firstReport != Chunk::npos) { // 跨块的Token在这一块扫描完
+                for (auto &message:unreported) {
+                    buffer.diagnostics.emplace_back((uint32_t) chunk.outputBase, Exception::ExceptionEntry{
+                            message, Exception::ExceptionType::LEXICAL_ERROR});
                 }
+                unreported.clear();
             }
+            copyDiagnostics(head, 0, buffer, chunk.outputBase, split, head.diagnostics.size());
+            if (chunk.commentEntry && chunk.join != Chunk::npos) {
+                copyDiagnostics(chunk.tokens, chunk.join, buffer, chunk.outputBase + chunk.commentTokens.size(),
+                                0, chunk.tokens.diagnostics.size());
+            }
+            auto &tail = chunk.commentEntry && chunk.join == Chunk::npos ? chunk.commentUnreported : chunk.unreported;
+            unreported.insert(unreported.end(), tail.begin(), tail.end());
         }
-        string_ptr ptr;
-        if (currentToken == STR) {
-            ptr = StringLiteralPool::getInstance().getLiteralString(tokenString);
-        } else if (currentToken == ID || currentToken == NUM || currentToken == ERROR) {
-            ptr = make_string_ptr(tokenString);
-        } else { // 其他类型的Token,比如关键字,特殊符号,END_FILE,都不需要一个TokenString.
-            ptr = nullptr;
+
+        if (options().dumpTokens) {
+            for (size_t i = 0; i < buffer.size(); i++) {
+                auto token = buffer.get(i);
+                dumpToken(token.lineNumber, token.tokenType, token.tokenString);
+            }
         }
-        if (TRACE_SCANNER) {
-            fprintf(OUTPUT_STREAM, "\t%d ", lineNumber);
-            printToken(currentToken, ptr);
+    }
+
+    void tokenize(TokenBuffer &buffer, unsigned threads) {
+        buffer.clear();
+        auto file = CompilerContext::current().file;
+        buffer.source = file->mapping;
+        if (buffer.source == nullptr || threads <= 1 || ECHO_SOURCE) {
+            if (buffer.source != nullptr) {
+                // 典型源码平均每个Token不少于4个字节, 按文件大小一次预留, 避免 vector 反复扩容搬运
+                buffer.reserve(file->size / 4 + 1);
+            }
+            tokenizeSerial(buffer);
+        } else {
+            tokenizeParallel(buffer, threads);
         }
-        return {currentToken, ptr};
     }
 
     void clearAll() {
-        // 清空缓存,指示变量归零
-        memset(buffer, '\0', LINE_BUFFER_SIZE);
-        bufSize = 0;
-        lineNumber = 0;
-        pos = 0;
-        EOF_flag = false;
+        // 游标和指示变量归零
+        *CompilerContext::current().scanner.serial = Lexer();
     }
 }
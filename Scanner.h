@@ -7,18 +7,79 @@
 
 #include "Compiler.h"
 #include "Token.h"
+#include "Exception.h"
 
 namespace Compiler::Scanner {
 
-    extern int lineNumber;
-
     struct TokenRet {
         TokenType tokenType;
-        string_ptr tokenString;
+        std::string_view tokenString; // 指向源文件内容的视图,不复制字符串. 只有 ID/NUM/STR/ERROR 非空.
+        int lineNumber = 0;           // 扫描完这个Token时Scanner的行号,语法树节点和语法错误都使用这个行号
+        num_t number{};               // NUM 的数值(扫描时已经转换好), 其他Token没有意义
+    };
+
+    /**
+     * 批量模式: 一次把整个文件切成Token, 按列(struct-of-arrays)储存, 每个Token只占 13 个字节:
+     * 8位的TokenType, 32位的文本偏移, 32位的文本长度, 32位的行号.
+     * 语法分析按下标读取, 可以任意向前看, 也不需要给每个Token分配字符串.
+     * clear() 保留已经分配的容量, 同一个 TokenBuffer 可以在多个文件之间重复使用.
+     * (32位偏移限制单个源文件不超过4GB)
+     */
+    struct TokenBuffer {
+        std::vector<uint8_t> types;
+        std::vector<uint32_t> offsets;
+        std::vector<uint32_t> lengths;
+        std::vector<uint32_t> lines;
+
+        // mmap 的文件: 偏移直接指向映射区; 流式读取的文件: Token文本复制到 text 里,偏移指向 text.
+        const char_t *source = nullptr;
+        string_t text;
+
+        // NUM 的数值只占少数Token, 单独按 (Token下标, 数值) 储存, 下标递增, 读取时二分查找
+        std::vector<std::pair<uint32_t, num_t>> numbers;
+
+        // 扫描第 i 个Token时产生的词法错误,语法分析读到第 i 个Token时再提交,保证错误顺序和逐个扫描时一致.
+        std::vector<std::pair<uint32_t, Exception::ExceptionEntry>> diagnostics;
+
+        size_t size() const { return types.size(); }
+
+        void clear();
+
+        void reserve(size_t count);
+
+        void push(const TokenRet &token);
+
+        TokenRet get(size_t index) const;
+    };
+
+    struct Lexer;
+
+    /**
+     * 逐个扫描(包括批量模式和流水线模式)使用的扫描器, 每个 CompilerContext 一个.
+     */
+    struct ScannerState {
+        std::unique_ptr<Lexer> serial;
+
+        ScannerState();
+
+        ~ScannerState();
     };
 
     TokenRet getToken();
 
+    /**
+     * 从当前文件(CompilerContext::file)扫描所有Token到 buffer, 最后一个Token是 END_FILE.
+     * threads > 1 并且文件是 mmap 的时候, 把文件切成 threads 块并行扫描, 结果和逐个扫描完全相同.
+     * (流式读取的输入在读完之前无法切分, 仍然逐个扫描)
+     */
+    void tokenize(TokenBuffer &buffer, unsigned threads = 1);
+
+    /**
+     * 清空 buffer, 从当前文件接着上一次的位置最多再扫描 count 个Token. 返回是否已经扫描到 END_FILE.
+     * 流水线模式的扫描线程用它分批扫描, 词法错误和 tokenize() 一样按批内的下标记录在 buffer.diagnostics.
+     */
+    bool tokenizeBatch(TokenBuffer &buffer, size_t count);
+
     void clearAll();
 }
 #endif //SCANNER_SCANNER_H
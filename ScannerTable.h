@@ -0,0 +1,309 @@
+//
+// Created by junior on 19-5-8.
+//
+
+#ifndef COMPILER_SCANNERTABLE_H
+#define COMPILER_SCANNERTABLE_H
+
+#include "Compiler.h"
+#include "Token.h"
+
+/**
+ * 表驱动词法分析器用到的常量表, 全部在编译期(constexpr)由下面的 Token 规格生成:
+ * 1. 字节分类表: 256个字节(加上EOF)压缩成 CLASS_COUNT 个字符类, 同一类字符在任何状态下的转移都相同;
+ * 2. 状态转移表: transitions[state][class] 给出下一个状态, 动作(保存字符/回退字符/报错) 以及接受时的Token;
+ * 3. 关键字完美哈希表: 编译期搜索一个没有冲突的哈希种子, 查询关键字只需要一次哈希和一次字符串比较.
+ */
+namespace Compiler::Scanner {
+    // DFA 状态
+    enum State : uint8_t {
+        START,
+        INCOMMENT, // {comment}
+        INSTR,    // 'str'
+        INID,     // [a-z;A-z][0-9;A-Z;a-z]*
+        INASSIGN, // :=
+        INNE,     // !=
+        INBE,     // >=
+        INLE,     // <=
+        /*
+         * 下面的 DECIMAL,OCT,HEX,FLOAT 都会被解析为 NUM（数值常量型）Token.
+         * 而不会分成四种Token来处理,原因很简单,在没有语法语义分析之前尚不能确定它们所指变量的实际类型,
+         * 比如 int a = 1.23; 实际a的类型为int,只有后面语义分析的时候才能根据a的类型转换常量.
+         * 常量本身的类型只由字面量决定: 整数(16/10/8进制)为int, 带 f/F 后缀的为float, 其他浮点数为double.
+         * 接受一个NUM时按接受状态(进制/浮点)用 std::from_chars 直接把字面量转换成 num_t (int_t/float_t/double_t),
+         * 存在 TokenRet::number 里(批量扫描时存在 TokenBuffer::numbers), 语法分析直接拿它设置语法树节点的属性,
+         * 不再保存数值的字符串再转换一次. 超出范围的常量在扫描时就报告词法错误(见 Scanner.cpp 的 convertNumber).
+         *
+         * TODO: 现在还有个负数常量没有解决,我之前考虑将所有的整型常量(16/10/8进制)都看成没有符号的(但是在语法树节点属性里依旧设置为int属性).
+         *   实际处理负号(-)或者正号(+)是通过解析为运算符解决,但是运算符只能处理 NUM (+/- NUM)* 的情况, 如果是单独一个 (+/-)NUM
+         *   就不行了. 这里考虑的解决方案是: 给正负运算规则加上 (+/-)NUM 的规则,在语义分析里,这个规则的语义是: 0 (+/-) NUM.
+         *
+         * 以前的手写DFA要比较 tokenString 是不是 "0" / "0x" / "." 来区分几种特殊情况,
+         * 表驱动之后把这几种情况拆成了独立的状态(IN_ZERO/IN_HEX_PREFIX/IN_DOT).
+         */
+        IN_DECIMAL,    // 十进制
+        IN_ZERO,       // 只有一个 0 (后面可以接八进制数字/x/X/小数点)
+        IN_OCT,        // 八进制
+        IN_HEX_PREFIX, // 只有 0x 或者 0X,还不能构成数值
+        IN_HEX,        // 十六进制
+        IN_DOT,        // 只有一个小数点,还不能构成数值
+        IN_FLOAT,      // 浮点数值常量,包括双精度浮点常量和单精度浮点常量(最后带一个f或者F)
+        DONE,
+        STATE_COUNT = DONE // 转移表只需要 DONE 之前的状态
+    };
+
+    // 字符类
+    enum CharClass : uint8_t {
+        C_EOF,
+        C_ILLEGAL,    // 非法字符
+        C_BLANK,      // ' ' '\t' '\r'
+        C_NEWLINE,    // '\n'
+        C_ZERO,       // 0
+        C_OCT_DIGIT,  // 1-7
+        C_DEC_DIGIT,  // 8 9
+        C_HEX_LETTER, // a-e A-E
+        C_F,          // f F (十六进制数字,也是单精度浮点后缀)
+        C_X,          // x X
+        C_LETTER,     // 其他字母
+        C_UTF8,       // 0x80-0xFF: UTF-8 多字节字符的字节, 可以出现在标识符, 注释和字符串里
+        C_DOT, C_COLON, C_BANG, C_GT, C_LT, C_EQ,
+        C_LBRACE, C_RBRACE, C_QUOTE,
+        C_PLUS, C_MINUS, C_TIMES, C_OVER, C_MOD,
+        C_LPAREN, C_RPAREN, C_SEMI, C_COMMA,
+        CLASS_COUNT
+    };
+
+    // 转移动作,可以组合
+    enum Action : uint8_t {
+        A_NONE = 0,
+        A_SAVE = 1,           // 把当前字符加到 tokenString
+        A_UNDO = 2,           // 回退当前字符(留给下一个Token)
+        A_ILLEGAL = 4,        // 非法字符,报错并跳过
+        A_STRING_BEGIN = 8,   // 字符串常量开始,tokenString 从下一个字符开始
+        A_COMMENT_ERROR = 16, // 注释不匹配
+        A_STRING_ERROR = 32   // 字符串不匹配
+    };
+
+    struct Transition {
+        State next = START;
+        uint8_t action = A_NONE;
+        uint8_t token = END_FILE; // next == DONE 时接受的Token
+    };
+
+    using ClassTable = std::array<CharClass, 257>;
+    using TransitionTable = std::array<std::array<Transition, CLASS_COUNT>, STATE_COUNT>;
+
+    // 字节分类表. 下标 0 是 EOF, 下标 c+1 是字节 c (见 charClass()).
+    constexpr ClassTable makeClassTable() {
+        ClassTable table{};
+        auto set = [&table](int c, CharClass cls) { table[(size_t) c + 1] = cls; };
+        for (int c = 0; c < 128; c++) set(c, C_ILLEGAL);
+        for (int c = 128; c < 256; c++) set(c, C_UTF8); // 编码是否合法由 Simd::validateUtf8 整块检查
+        table[0] = C_EOF;
+        for (int c = 'a'; c <= 'z'; c++) set(c, C_LETTER);
+        for (int c = 'A'; c <= 'Z'; c++) set(c, C_LETTER);
+        for (int c = 'a'; c <= 'e'; c++) set(c, C_HEX_LETTER);
+        for (int c = 'A'; c <= 'E'; c++) set(c, C_HEX_LETTER);
+        for (int c = '1'; c <= '7'; c++) set(c, C_OCT_DIGIT);
+        set('f', C_F), set('F', C_F), set('x', C_X), set('X', C_X);
+        set('0', C_ZERO), set('8', C_DEC_DIGIT), set('9', C_DEC_DIGIT);
+        set(' ', C_BLANK), set('\t', C_BLANK), set('\r', C_BLANK), set('\n', C_NEWLINE);
+        set('.', C_DOT), set(':', C_COLON), set('!', C_BANG), set('>', C_GT), set('<', C_LT), set('=', C_EQ);
+        set('{', C_LBRACE), set('}', C_RBRACE), set('\'', C_QUOTE);
+        set('+', C_PLUS), set('-', C_MINUS), set('*', C_TIMES), set('/', C_OVER), set('%', C_MOD);
+        set('(', C_LPAREN), set(')', C_RPAREN), set(';', C_SEMI), set(',', C_COMMA);
+        return table;
+    }
+
+    constexpr ClassTable classTable = makeClassTable();
+
+    inline CharClass charClass(int c) {
+        return classTable[(size_t) (c + 1)]; // EOF(-1) 映射到下标 0
+    }
+
+    /**
+     * Token 规格: 按状态逐条给出转移规则, 没有列出的字符类走该状态的默认规则.
+     */
+    constexpr TransitionTable makeTransitionTable() {
+        TransitionTable table{};
+        // 规则: 在 state 状态下遇到 classes 中的字符类, 转移到 next, 执行 action, 接受 token
+        auto rule = [&table](State state, std::initializer_list<CharClass> classes,
+                             State next, uint8_t action, TokenType token = END_FILE) {
+            for (auto cls:classes) table[state][cls] = Transition{next, action, (uint8_t) token};
+        };
+        // 默认规则: state 状态下所有字符类都这样转移, 之后再用 rule 覆盖个别字符类
+        auto otherwise = [&table](State state, State next, uint8_t action, TokenType token = END_FILE) {
+            for (auto &t:table[state]) t = Transition{next, action, (uint8_t) token};
+        };
+        const std::initializer_list<CharClass> digits{C_ZERO, C_OCT_DIGIT, C_DEC_DIGIT};
+        const std::initializer_list<CharClass> hexDigits{C_ZERO, C_OCT_DIGIT, C_DEC_DIGIT, C_HEX_LETTER, C_F};
+        // 所有非ASCII字符都可以作为标识符的字符(不区分Unicode的字母和符号)
+        const std::initializer_list<CharClass> letters{C_HEX_LETTER, C_F, C_X, C_LETTER, C_UTF8};
+        const std::initializer_list<CharClass> alnum{C_ZERO, C_OCT_DIGIT, C_DEC_DIGIT,
+                                                     C_HEX_LETTER, C_F, C_X, C_LETTER, C_UTF8};
+
+        // START: 单字符Token直接接受; 其他符号进入对应状态
+        otherwise(START, DONE, A_SAVE, ERROR); // 合法但不能开始一个Token的字符,比如 }
+        rule(START, {C_EOF}, DONE, A_NONE, END_FILE);
+        rule(START, {C_BLANK, C_NEWLINE}, START, A_NONE);
+        rule(START, {C_LBRACE}, INCOMMENT, A_NONE);
+        rule(START, {C_QUOTE}, INSTR, A_STRING_BEGIN); // str常量开头的'不记录在tokenString里
+        rule(START, {C_DOT}, IN_DOT, A_SAVE);
+        rule(START, {C_ZERO}, IN_ZERO, A_SAVE);
+        rule(START, {C_OCT_DIGIT, C_DEC_DIGIT}, IN_DECIMAL, A_SAVE);
+        rule(START, letters, INID, A_SAVE);
+        rule(START, {C_COLON}, INASSIGN, A_SAVE);
+        rule(START, {C_BANG}, INNE, A_SAVE);
+        rule(START, {C_GT}, INBE, A_SAVE);
+        rule(START, {C_LT}, INLE, A_SAVE);
+        rule(START, {C_EQ}, DONE, A_SAVE, EQ);
+        rule(START, {C_PLUS}, DONE, A_SAVE, PLUS);
+        rule(START, {C_MINUS}, DONE, A_SAVE, MINUS);
+        rule(START, {C_TIMES}, DONE, A_SAVE, TIMES);
+        rule(START, {C_OVER}, DONE, A_SAVE, OVER);
+        rule(START, {C_MOD}, DONE, A_SAVE, MOD);
+        rule(START, {C_LPAREN}, DONE, A_SAVE, LPAREN);
+        rule(START, {C_RPAREN}, DONE, A_SAVE, RPAREN);
+        rule(START, {C_SEMI}, DONE, A_SAVE, SEMI);
+        rule(START, {C_COMMA}, DONE, A_SAVE, COMMA);
+
+        // INCOMMENT: 注释允许跨多行,一直到 } 为止; 到EOF还没有结束注释就是不匹配
+        otherwise(INCOMMENT, INCOMMENT, A_NONE);
+        rule(INCOMMENT, {C_RBRACE}, START, A_NONE);
+        rule(INCOMMENT, {C_EOF}, DONE, A_COMMENT_ERROR, END_FILE);
+
+        // INSTR: 在一行结束后还不结束字符串就是不匹配
+        otherwise(INSTR, INSTR, A_SAVE);
+        rule(INSTR, {C_QUOTE}, DONE, A_NONE, STR); // 不记录str常量最后的'字符
+        rule(INSTR, {C_NEWLINE}, DONE, A_STRING_ERROR, ERROR);
+        rule(INSTR, {C_EOF}, DONE, A_STRING_ERROR, END_FILE);
+
+        otherwise(INID, DONE, A_UNDO, ID);
+        rule(INID, alnum, INID, A_SAVE);
+
+        otherwise(INASSIGN, DONE, A_UNDO, ERROR);
+        rule(INASSIGN, {C_EQ}, DONE, A_SAVE, ASSIGN);
+        otherwise(INNE, DONE, A_UNDO, ERROR);
+        rule(INNE, {C_EQ}, DONE, A_SAVE, NE);
+        otherwise(INBE, DONE, A_UNDO, BT); // 只保留 > Token
+        rule(INBE, {C_EQ}, DONE, A_SAVE, BE);
+        otherwise(INLE, DONE, A_UNDO, LT); // 只保留 < Token
+        rule(INLE, {C_EQ}, DONE, A_SAVE, LE);
+
+        otherwise(IN_DECIMAL, DONE, A_UNDO, NUM);
+        rule(IN_DECIMAL, digits, IN_DECIMAL, A_SAVE);
+        rule(IN_DECIMAL, {C_DOT}, IN_FLOAT, A_SAVE);
+
+        // 这里不需要对8或者9做错误分析处理,直接丢给下一个Token即可,
+        // 比如 int a := 0147999,切成 INT ID := NUM(0147) NUM(999),语法分析很容易发现错误.
+        otherwise(IN_ZERO, DONE, A_UNDO, NUM); // 只有一个"0",虽然是十进制,Token类型依旧是NUM
+        rule(IN_ZERO, {C_ZERO, C_OCT_DIGIT}, IN_OCT, A_SAVE);
+        rule(IN_ZERO, {C_X}, IN_HEX_PREFIX, A_SAVE); // 0x或者0X
+        rule(IN_ZERO, {C_DOT}, IN_FLOAT, A_SAVE);
+        otherwise(IN_OCT, DONE, A_UNDO, NUM);
+        rule(IN_OCT, {C_ZERO, C_OCT_DIGIT}, IN_OCT, A_SAVE);
+        rule(IN_OCT, {C_DOT}, IN_FLOAT, A_SAVE); // [0-7]+. 浮点数值
+
+        otherwise(IN_HEX_PREFIX, DONE, A_UNDO, ERROR); // 只有一个0x或者0X,是无法构成数值的
+        rule(IN_HEX_PREFIX, hexDigits, IN_HEX, A_SAVE);
+        otherwise(IN_HEX, DONE, A_UNDO, NUM);
+        rule(IN_HEX, hexDigits, IN_HEX, A_SAVE);
+
+        // 浮点数只处理[小数部分],一旦发现非数字就结束. 0.2555.23555 会切成 0.2555 .23555 两个NUM,
+        // 留给语法分析报错. .021 或者 12. 是允许的,但如果只有单独一个小数点,则是非法的Token.
+        otherwise(IN_DOT, DONE, A_UNDO, ERROR);
+        rule(IN_DOT, digits, IN_FLOAT, A_SAVE);
+        otherwise(IN_FLOAT, DONE, A_UNDO, NUM);
+        rule(IN_FLOAT, digits, IN_FLOAT, A_SAVE);
+        rule(IN_FLOAT, {C_F}, DONE, A_SAVE, NUM); // 末尾带一个f或者F,不需要回退,同时把f/F附加到tokenString
+
+        // 除了注释和字符串内部,非法字符都直接跳过(状态不变)并报错
+        for (int state = START; state < STATE_COUNT; state++) {
+            if (state != INCOMMENT && state != INSTR) {
+                table[state][C_ILLEGAL] = Transition{(State) state, A_ILLEGAL, END_FILE};
+            }
+        }
+        return table;
+    }
+
+    constexpr TransitionTable transitions = makeTransitionTable();
+
+    /**
+     * 关键字的完美哈希表. 编译期从FNV偏移基数开始逐个搜索种子,直到所有关键字落到不同的槽里.
+     */
+    struct KeywordEntry {
+        std::string_view keyword;
+        TokenType token = ID;
+    };
+
+    constexpr KeywordEntry keywordSpec[] = {
+            {"if",     IF},
+            {"then",   THEN},
+            {"else",   ELSE},
+            {"end",    END},
+            {"repeat", REPEAT},
+            {"until",  UNTIL},
+            {"do",     DO},
+            {"while",  WHILE},
+            {"read",   READ},
+            {"write",  WRITE},
+            {"true",   TRUE},
+            {"false",  FALSE},
+            {"or",     OR},
+            {"and",    AND},
+            {"not",    NOT},
+            {"int",    INT},
+            {"bool",   BOOL},
+            {"float",  FLOAT},
+            {"double", DOUBLE},
+            {"string", STRING}
+    };
+
+    constexpr size_t KEYWORD_SLOTS = 64; // 2的幂,取模用位与
+
+    // 只用长度,前两个字符和最后一个字符计算哈希(FNV-1a 方式混合),关键字都很短,足够区分
+    constexpr size_t keywordHash(std::string_view s, uint32_t seed) {
+        uint32_t h = seed;
+        h = (h ^ (unsigned char) s.front()) * 16777619u;
+        h = (h ^ (s.size() > 1 ? (unsigned char) s[1] : 0u)) * 16777619u;
+        h = (h ^ (unsigned char) s.back()) * 16777619u;
+        h = (h ^ (uint32_t) s.size()) * 16777619u;
+        return (size_t) ((h ^ (h >> 15)) & (KEYWORD_SLOTS - 1));
+    }
+
+    constexpr bool isPerfectSeed(uint32_t seed) {
+        bool used[KEYWORD_SLOTS]{};
+        for (auto &entry:keywordSpec) {
+            auto slot = keywordHash(entry.keyword, seed);
+            if (used[slot]) return false;
+            used[slot] = true;
+        }
+        return true;
+    }
+
+    constexpr uint32_t findKeywordSeed() {
+        uint32_t seed = 2166136261u;
+        while (!isPerfectSeed(seed)) seed++;
+        return seed;
+    }
+
+    constexpr uint32_t keywordSeed = findKeywordSeed();
+
+    constexpr std::array<KeywordEntry, KEYWORD_SLOTS> makeKeywordTable() {
+        std::array<KeywordEntry, KEYWORD_SLOTS> table{};
+        for (auto &entry:keywordSpec) table[keywordHash(entry.keyword, keywordSeed)] = entry;
+        return table;
+    }
+
+    constexpr std::array<KeywordEntry, KEYWORD_SLOTS> keywordTable = makeKeywordTable();
+
+    // 标识符是关键字就返回关键字Token,否则返回 ID
+    constexpr TokenType lookupKeyword(std::string_view id) {
+        const auto &entry = keywordTable[keywordHash(id, keywordSeed)];
+        return entry.keyword == id ? entry.token : ID;
+    }
+
+    static_assert(lookupKeyword("repeat") == REPEAT && lookupKeyword("string") == STRING &&
+                  lookupKeyword("strings") == ID && lookupKeyword("x") == ID, "keyword perfect hash broken");
+}
+#endif //COMPILER_SCANNERTABLE_H
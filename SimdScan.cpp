@@ -0,0 +1,246 @@
+//
+// Created by junior on 19-5-9.
+//
+
+#include "SimdScan.h"
+
+#if SIMD_SCAN && defined(__GNUC__) && defined(__x86_64__)
+#define SIMD_SCAN_X86 1
+#include <immintrin.h>
+#else
+#define SIMD_SCAN_X86 0
+#endif
+
+namespace Compiler::Scanner::Simd {
+    enum class Kind {
+        Comment, String, Blank
+    };
+
+    template<Kind kind>
+    inline bool isStop(unsigned char c) {
+        if constexpr (kind == Kind::Comment) return c == '}';
+        else if constexpr (kind == Kind::String) return c == '\'' || c == '\n';
+        else return c != ' ' && c != '\t' && c != '\r' && c != '\n';
+    }
+
+    // 标量实现, 也用来处理向量实现最后不足一个向量宽度的部分
+    template<Kind kind>
+    SkipResult skipTail(const char_t *p, const char_t *end, SkipResult result) {
+        for (; p < end; p++) {
+            auto c = (unsigned char) *p;
+            if (isStop<kind>(c)) {
+                result.stop = p;
+                return result;
+            }
+            if (c == '\n') {
+                result.newlines++;
+                result.lastNewline = p;
+            }
+        }
+        result.stop = end;
+        return result;
+    }
+
+    template<Kind kind>
+    SkipResult skipScalar(const char_t *begin, const char_t *end) {
+        return skipTail<kind>(begin, end, SkipResult{end, 0, nullptr});
+    }
+
+    // 跳到第一个非ASCII字节(最高位为1)
+    const char_t *skipAsciiScalar(const char_t *p, const char_t *end) {
+        while (p < end && (unsigned char) *p < 0x80) p++;
+        return p;
+    }
+
+#if SIMD_SCAN_X86
+
+    // 把一个向量里的换行符掩码累加到结果上
+    inline void addNewlines(SkipResult &result, const char_t *p, unsigned mask) {
+        if (mask != 0) {
+            result.newlines += (size_t) __builtin_popcount(mask);
+            result.lastNewline = p + (31 - __builtin_clz(mask));
+        }
+    }
+
+    template<Kind kind>
+    SkipResult skipSse2(const char_t *begin, const char_t *end) {
+        SkipResult result{end, 0, nullptr};
+        const char_t *p = begin;
+        const __m128i newline = _mm_set1_epi8('\n');
+        for (; end - p >= 16; p += 16) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+            __m128i isNewline = _mm_cmpeq_epi8(v, newline);
+            unsigned stop;
+            if constexpr (kind == Kind::Comment) {
+                stop = (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('}')));
+            } else if constexpr (kind == Kind::String) {
+                stop = (unsigned) _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\'')), isNewline));
+            } else {
+                __m128i blank = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                                                          _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+                                             _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')), isNewline));
+                stop = ~(unsigned) _mm_movemask_epi8(blank) & 0xFFFFu;
+            }
+            auto newlines = (unsigned) _mm_movemask_epi8(isNewline);
+            if (stop != 0) {
+                auto index = (unsigned) __builtin_ctz(stop);
+                addNewlines(result, p, newlines & ((1u << index) - 1));
+                result.stop = p + index;
+                return result;
+            }
+            addNewlines(result, p, newlines);
+        }
+        return skipTail<kind>(p, end, result);
+    }
+
+    template<Kind kind>
+    __attribute__((target("avx2")))
+    SkipResult skipAvx2(const char_t *begin, const char_t *end) {
+        SkipResult result{end, 0, nullptr};
+        const char_t *p = begin;
+        const __m256i newline = _mm256_set1_epi8('\n');
+        for (; end - p >= 32; p += 32) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+            __m256i isNewline = _mm256_cmpeq_epi8(v, newline);
+            unsigned stop;
+            if constexpr (kind == Kind::Comment) {
+                stop = (unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('}')));
+            } else if constexpr (kind == Kind::String) {
+                stop = (unsigned) _mm256_movemask_epi8(
+                        _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\'')), isNewline));
+            } else {
+                __m256i blank = _mm256_or_si256(
+                        _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                                        _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+                        _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')), isNewline));
+                stop = ~(unsigned) _mm256_movemask_epi8(blank);
+            }
+            auto newlines = (unsigned) _mm256_movemask_epi8(isNewline);
+            if (stop != 0) {
+                auto index = (unsigned) __builtin_ctz(stop);
+                addNewlines(result, p, newlines & ((1u << index) - 1));
+                result.stop = p + index;
+                return result;
+            }
+            addNewlines(result, p, newlines);
+        }
+        return skipTail<kind>(p, end, result);
+    }
+
+    const char_t *skipAsciiSse2(const char_t *p, const char_t *end) {
+        for (; end - p >= 16; p += 16) {
+            auto mask = (unsigned) _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+            if (mask != 0) return p + __builtin_ctz(mask);
+        }
+        return skipAsciiScalar(p, end);
+    }
+
+    __attribute__((target("avx2")))
+    const char_t *skipAsciiAvx2(const char_t *p, const char_t *end) {
+        for (; end - p >= 64; p += 64) { // 每次检查两个向量, 全是ASCII时只需要一次判断
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+            __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 32));
+            if (_mm256_movemask_epi8(_mm256_or_si256(a, b)) != 0) break;
+        }
+        for (; end - p >= 32; p += 32) {
+            auto mask = (unsigned) _mm256_movemask_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)));
+            if (mask != 0) return p + __builtin_ctz(mask);
+        }
+        return skipAsciiScalar(p, end);
+    }
+
+    bool hasAvx2() {
+        __builtin_cpu_init(); // 在静态初始化阶段调用 __builtin_cpu_supports 之前必须先初始化
+        return __builtin_cpu_supports("avx2");
+    }
+
+#endif
+
+    // 运行期根据CPU选择实现(CPU dispatch), 只在程序启动时做一次
+    template<Kind kind>
+    SkipFunction select() {
+#if SIMD_SCAN_X86
+        return hasAvx2() ? skipAvx2<kind> : skipSse2<kind>;
+#else
+        return skipScalar<kind>;
+#endif
+    }
+
+    const SkipFunction skipComment = select<Kind::Comment>();
+    const SkipFunction skipString = select<Kind::String>();
+    const SkipFunction skipBlank = select<Kind::Blank>();
+
+    using AsciiFunction = const char_t *(*)(const char_t *p, const char_t *end);
+
+#if SIMD_SCAN_X86
+    const AsciiFunction skipAscii = hasAvx2() ? skipAsciiAvx2 : skipAsciiSse2;
+#else
+    const AsciiFunction skipAscii = skipAsciiScalar;
+#endif
+
+    int decodeUtf8(const char_t *p, const char_t *end) {
+        auto lead = (unsigned char) p[0];
+        int length;
+        unsigned char low = 0x80, high = 0xBF; // 第二个字节的范围, 排除过长编码/代理区/超过 U+10FFFF 的码点
+        if (lead >= 0xC2 && lead <= 0xDF) {
+            length = 2;
+        } else if (lead >= 0xE0 && lead <= 0xEF) {
+            length = 3;
+            if (lead == 0xE0) low = 0xA0;
+            else if (lead == 0xED) high = 0x9F;
+        } else if (lead >= 0xF0 && lead <= 0xF4) {
+            length = 4;
+            if (lead == 0xF0) low = 0x90;
+            else if (lead == 0xF4) high = 0x8F;
+        } else {
+            return -1; // 单独的后续字节, C0/C1, F5 以上
+        }
+        for (int i = 1; i < length; i++) {
+            if (p + i >= end) return 0;
+            auto c = (unsigned char) p[i];
+            if (c < low || c > high) return -i;
+            low = 0x80, high = 0xBF;
+        }
+        return length;
+    }
+
+    const char_t *validateUtf8(const char_t *begin, const char_t *end, bool final,
+                               std::vector<const char_t *> &invalid) {
+        const char_t *p = begin;
+        while ((p = skipAscii(p, end)) < end) {
+            int length = decodeUtf8(p, end);
+            if (length > 0) {
+                p += length;
+            } else if (length < 0) {
+                invalid.push_back(p);
+                p -= length;
+            } else if (!final) {
+                return p;
+            } else {
+                invalid.push_back(p); // 文件末尾被截断的字符
+                break;
+            }
+        }
+        return end;
+    }
+
+    const char *implementation() {
+#if SIMD_SCAN_X86
+        return hasAvx2() ? "avx2" : "sse2";
+#else
+        return "scalar";
+#endif
+    }
+
+    std::vector<SkipKernels> availableKernels() {
+        std::vector<SkipKernels> kernels{{"scalar", skipScalar<Kind::Comment>, skipScalar<Kind::String>,
+                                          skipScalar<Kind::Blank>}};
+#if SIMD_SCAN_X86
+        kernels.push_back({"sse2", skipSse2<Kind::Comment>, skipSse2<Kind::String>, skipSse2<Kind::Blank>});
+        if (hasAvx2()) {
+            kernels.push_back({"avx2", skipAvx2<Kind::Comment>, skipAvx2<Kind::String>, skipAvx2<Kind::Blank>});
+        }
+#endif
+        return kernels;
+    }
+}
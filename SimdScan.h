@@ -0,0 +1,60 @@
+//
+// Created by junior on 19-5-9.
+//
+
+#ifndef COMPILER_SIMDSCAN_H
+#define COMPILER_SIMDSCAN_H
+
+#include "Compiler.h"
+#include "Util.h"
+
+/**
+ * Scanner 的向量化快速路径.
+ * 源码里大部分字节是空白, { 注释 } 和 '字符串' 的内容, 逐字节走DFA很浪费.
+ * 这里用 SSE2 (x86-64 的基线) 每次比较16个字节, CPU 支持 AVX2 时运行期切换到每次32个字节,
+ * 直接跳到下一个 } / ' / 换行符 / 非空白字符, 同时统计跳过的换行符, 保证行号不变.
+ * 非 x86 平台或者 config.h 里关闭 SIMD_SCAN 时使用逐字节的标量实现, 结果完全相同.
+ */
+namespace Compiler::Scanner::Simd {
+    struct SkipResult {
+        const char_t *stop;        // 第一个需要停下来的字符, 没有找到则为 end
+        size_t newlines;           // [begin, stop) 里换行符的数量
+        const char_t *lastNewline; // [begin, stop) 里最后一个换行符, 没有则为 nullptr
+    };
+
+    using SkipFunction = SkipResult (*)(const char_t *begin, const char_t *end);
+
+    // 注释内部: 停在 }
+    extern const SkipFunction skipComment;
+    // 字符串内部: 停在 ' 或者换行符(字符串不能跨行,所以不会跳过换行符)
+    extern const SkipFunction skipString;
+    // Token 之间: 停在第一个不是 ' ' '\t' '\r' '\n' 的字符
+    extern const SkipFunction skipBlank;
+
+    /**
+     * UTF-8 校验: 源码绝大部分是ASCII, 用向量指令成块跳过ASCII, 遇到非ASCII字节再逐个检查这个字符的编码.
+     * 每个非法的字节序列(按 Unicode 的"最大子部分"规则划分, 同一个错误只报告一次)的起始位置追加到 invalid.
+     * final 为 false 时(流式读取的一块), 末尾被截断的字符可能在下一块继续, 返回它的起始位置; 否则返回 end.
+     */
+    const char_t *validateUtf8(const char_t *begin, const char_t *end, bool final,
+                               std::vector<const char_t *> &invalid);
+
+    /**
+     * 检查 p 开始的一个非ASCII字符: 合法时返回它的字节数; 非法时返回负的最大子部分长度;
+     * 到 end 为止还是合法的前缀(字符被截断)时返回 0.
+     */
+    int decodeUtf8(const char_t *p, const char_t *end);
+
+    // 当前使用的实现: "avx2" / "sse2" / "scalar"
+    const char *implementation();
+
+    // 一种实现的三个跳过函数
+    struct SkipKernels {
+        const char *name;
+        SkipFunction comment, string, blank;
+    };
+
+    // 所有能在这个CPU上运行的实现, 第一个是标量实现(测试用它检查向量实现的结果)
+    std::vector<SkipKernels> availableKernels();
+}
+#endif //COMPILER_SIMDSCAN_H
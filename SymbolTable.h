@@ -9,104 +9,205 @@
 #include "Exception.h"
 #include "TypeSystem.h"
 #include "Util.h"
+#include "AtomTable.h"
+#include "Dump.h"
 
 namespace Compiler {
     /**
-     * 单例模式,全局符号表
+     * 符号表, 每个源文件一个(CompilerContext 的成员)
+     *
+     * 原来是 unordered_set<SymbolEntry>, 每次 update 都要哈希查找, 每个出现的行号还要在 std::list 里分配一个节点.
+     * 现在按列存放(struct of arrays):
+     * 1. 符号按声明的顺序编号, 名字/类型/内存地址/声明行号分别存放在以编号为下标的平行数组里;
+     * 2. atom => 符号编号 用开放寻址(线性探测)的哈希表, 槽里只有两个32位整数, 容量为2的幂, 负载不超过1/2,
+     *    atom 相等就是名字相等, 查找只做整数运算;
+     * 3. 交叉引用(每个符号出现过的行号)只在需要时收集(--dump-symbols), 每次出现往一个数组末尾追加一项,
+     *    输出前再按符号编号计数排序成连续的一段(和原来一样, 第一个是声明的行号, 后面按出现的顺序).
+     *
+     * 块作用域: if/repeat/do 的语句序列各自是一层作用域, 最外层是全局作用域.
+     * 1. 槽里存放的是这个名字当前可见的符号, 内层声明同名变量时新符号记下被它遮盖(shadow)的外层符号,
+     *    所以查找始终只看一个槽, 和嵌套深度无关;
+     * 2. 每次声明都记入撤销日志, enterScope 只记下日志的长度, exitScope 按日志倒序把槽恢复成被遮盖的符号,
+     *    进出一层作用域的代价和这一层声明的变量个数成正比;
+     * 3. 内存地址按栈分配, 退出作用域时收回这一层分配的地址, 作用域不重叠的变量共用同一个地址,
+     *    dataSize() 是整个程序需要的数据区大小(最深时同时存活的变量个数).
+     * 同一层作用域重复声明, 或者使用时名字不可见(没有声明或者声明所在的块已经结束)都报错.
      */
     class SymbolTable {
+    public:
+        static const uintptr_t null_address = std::numeric_limits<uintptr_t>::max();
+
     private:
-        /**
-          * 1. 储存一个变量的内存地址用什么类型? 参考:
-          * https://stackoverflow.com/questions/13235280/how-to-store-a-memory-address-in-an-integer
-          * 2. 哈希集set<entry>用entry的symbol_name作为key来插入和查找, 但是找到一个存在的entry时,有时候需要更新它的symbol_appear_lines.
-          * 如果使用set.find(entry)就无法实现这种更新,因为set.find(entry)返回的是const iterator,无法修改内部成员.
-          * C++设计的思路是不能破坏哈希集合内部的元素,因为哈希集的元素可能参与到hash()值的计算中,为了安全干脆一刀切.
-          * 要解决这一点,有三种方法:
-          * 1. 查找到一个元素后,将这个元素拷贝一份,修改这个拷贝,然后将原来的元素删除,再将拷贝插入哈希集合,这种开销太大;
-          * 2. 将原来的哈希集合拆解变成哈希表,即 map<key,value>,然后将symbol_appear_lines,memory_address这些存在value里,这是比较好的重构思路.
-          * 3. 在原来SymbolEntry结构体的 symbol_appear_lines　前加上 mutable(可变) 关键字, C++允许对const对象的mutable成员进行修改.
-          * 这个方法可以不破坏原来的代码,而且明确了Entry的哪些元素可以修改
-          * (这里只给symbol_appear_lines加上mutable,内存地址我认为第一次分配后就不需要改变了).
-          * 参考: https://stackoverflow.com/questions/18704129/unordered-set-non-const-iterator
-          */
-        struct SymbolEntry {
-            explicit SymbolEntry(string_ptr name) : symbol_name(std::move(name)) {}
-
-            string_ptr symbol_name = nullptr;                 // 符号名称
-            uintptr_t memory_address = 0;                     // 内存地址
-            mutable std::list<int> symbol_appear_lines;       // 符号出现过的行号列表(加上mutable表示可变)
-            Type type = Type::Void;                           // 类型信息
+        static constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+
+        // 以符号编号为下标的属性
+        std::vector<atom_t> names;           // 符号名称(AtomTable 里的编号)
+        std::vector<Type> types;             // 类型信息
+        std::vector<uintptr_t> addresses;    // 内存地址
+        std::vector<int> declarationLines;   // 声明的行号
+        std::vector<uint32_t> depths;        // 声明所在作用域的深度, 全局为 0
+        std::vector<uint32_t> shadowed;      // 被它遮盖的外层同名符号, 没有则为 NONE
+
+        struct Slot {
+            uint32_t atom;   // NONE 表示空槽
+            uint32_t symbol;
         };
+        std::vector<Slot> slots;
+        size_t usedSlots = 0;
 
-        struct SymbolEntryHash {
-            std::size_t operator()(const SymbolEntry &entry) const {
-                return std::hash<string_t>()(*entry.symbol_name);
-            }
+        // 作用域栈
+        struct Scope {
+            size_t undoLength;    // 进入时撤销日志的长度
+            uintptr_t address;    // 进入时下一个可分配的地址
         };
+        std::vector<Scope> scopes;
+        std::vector<uint32_t> undoLog;   // 当前所有打开的作用域里声明的符号, 按声明的顺序
+        uintptr_t nextAddress = 0;
+        uintptr_t highWater = 0;
 
-        struct SymbolEqual {
-            bool operator()(const SymbolEntry &a, const SymbolEntry &b) const {
-                return *(a.symbol_name) == *(b.symbol_name);
-            }
+        // 交叉引用
+        struct Occurrence {
+            uint32_t symbol;
+            int lineNumber;
         };
+        bool crossReference = false;
+        std::vector<Occurrence> occurrences;     // 按出现的顺序追加
+        std::vector<uint32_t> occurrenceStart;   // 整理后: 符号 i 的行号是 occurrenceLines[start[i], start[i+1])
+        std::vector<int> occurrenceLines;
 
-    public:
-        static const uintptr_t null_address = std::numeric_limits<uintptr_t>::max();
+        SymbolTable() : slots(256, Slot{NONE, NONE}) {}
 
-    private:
-        SymbolTable() = default;
+        friend class Compiler::CompilerContext;
 
-        typedef std::unordered_set<SymbolEntry, SymbolEntryHash, SymbolEqual> symbol_table_t;
-        symbol_table_t table;
+        static string_t getName(atom_t name) {
+            return string_t(AtomTable::getInstance().getString(name));
+        }
 
-    public:
-        static SymbolTable &globalTable() {
-            static SymbolTable symbolTable;
-            return symbolTable;
+        size_t slotOf(atom_t name) const {
+            auto mask = slots.size() - 1;
+            auto h = name.id * 0x9E3779B1u; // atom 编号是连续分配的, 乘法打散后再取低位
+            auto i = (size_t) (h ^ (h >> 16)) & mask;
+            while (slots[i].atom != NONE && slots[i].atom != name.id) {
+                i = (i + 1) & mask;
+            }
+            return i;
+        }
+
+        uint32_t find(atom_t name) const {
+            return slots[slotOf(name)].symbol;
+        }
+
+        void grow() {
+            std::vector<Slot> old(slots.size() * 2, Slot{NONE, NONE});
+            old.swap(slots);
+            for (auto &slot:old) {
+                if (slot.atom != NONE) slots[slotOf(atom_t{slot.atom})] = slot;
+            }
+        }
+
+        void occur(uint32_t symbol, int lineNumber) {
+            if (crossReference) occurrences.push_back(Occurrence{symbol, lineNumber});
         }
 
+        // 把追加的出现记录按符号编号计数排序(稳定, 保持出现的顺序)
+        void indexOccurrences() {
+            occurrenceStart.assign(names.size() + 1, 0);
+            for (auto &o:occurrences) {
+                occurrenceStart[o.symbol + 1]++;
+            }
+            for (size_t i = 0; i < names.size(); i++) {
+                occurrenceStart[i + 1] += occurrenceStart[i];
+            }
+            occurrenceLines.resize(occurrences.size());
+            std::vector<uint32_t> cursor(occurrenceStart.begin(), occurrenceStart.end() - 1);
+            for (auto &o:occurrences) {
+                occurrenceLines[cursor[o.symbol]++] = o.lineNumber;
+            }
+        }
+
+    public:
+        // 当前线程正在编译的文件的符号表(每个 CompilerContext 一个, 见 CompilerContext.h)
+        static SymbolTable &globalTable();
+
         SymbolTable(SymbolTable const &) = delete;
 
         void operator=(SymbolTable const &) = delete;
 
+        void enterScope() {
+            scopes.push_back(Scope{undoLog.size(), nextAddress});
+        }
+
+        void exitScope() {
+            auto scope = scopes.back();
+            scopes.pop_back();
+            while (undoLog.size() > scope.undoLength) {
+                auto symbol = undoLog.back();
+                undoLog.pop_back();
+                slots[slotOf(names[symbol])].symbol = shadowed[symbol];
+            }
+            nextAddress = scope.address;
+        }
+
+        // 数据区大小: 同时存活的变量最多的时候需要的地址个数
+        uintptr_t dataSize() const {
+            return highWater;
+        }
+
+        // 是否收集交叉引用(每个符号出现过的行号), 只有 --dump-symbols 用到, 要在第一次 insert 之前设置
+        void collectCrossReference(bool enable) {
+            crossReference = enable;
+        }
+
         /**
          * 遍历AST时,如果遇到其他使用symbol的statement或者expr,更新它的lineNumber.
          * 如果更新的时候发现symbol还没有插入符号表,则报符号未声明错误.
          * 比如下面的:
          * x := 5 (第一次出现x时并没有声明)
          * 会报未声明错误.
+         * 返回symbol的类型(未声明时为空类型), 省得调用者再查一次.
          */
-        void update(const string_ptr &name, int lineNumber) {
-            SymbolEntry search(name);
-            symbol_table_t::iterator pos;
-            if ((pos = table.find(search)) != table.end()) {
-                (*pos).symbol_appear_lines.push_back(lineNumber);
+        Type update(atom_t name, int lineNumber) {
+            auto symbol = find(name);
+            if (symbol != NONE) {
+                occur(symbol, lineNumber);
+                return types[symbol];
             } else {
                 using namespace Compiler::Exception;
-                string_t message = "Symbol " + *name + " not declaration on line " + std::to_string(lineNumber);
+                string_t message = "Symbol " + getName(name) + " not declaration on line " + std::to_string(lineNumber);
                 ExceptionHandle::getHandle().add_exception(ExceptionType::ANALYSIS_ERROR, message);
+                return Type::Void;
             }
         }
 
         /**
-         * 遍历AST 遇到declaration_statement时调用.
-         * 如果同一个symbol两次调用insert,将报重复定义错误.
+         * 遍历AST 遇到declaration_statement时调用, 在当前作用域声明变量并分配内存地址.
+         * 如果同一个symbol在同一层作用域两次调用insert,将报重复定义错误.
          * 比如:
          * int a := 1;
          * double a := 1.2;
-         * 会报重复定义错误
+         * 会报重复定义错误. 内层块里声明外层已有的名字则遮盖外层的变量, 直到内层块结束.
          */
-        void insert(const string_ptr &name, int lineNumber, uintptr_t memory_address, Type type) {
-            SymbolEntry search(name);
-            if (table.find(search) == table.end()) {
-                search.memory_address = memory_address;
-                search.symbol_appear_lines.push_back(lineNumber);
-                search.type = type;
-                table.insert(search);
+        void insert(atom_t name, int lineNumber, Type type) {
+            auto slot = slotOf(name);
+            auto visible = slots[slot].symbol;
+            auto depth = (uint32_t) scopes.size();
+            if (visible == NONE || depths[visible] != depth) {
+                auto symbol = (uint32_t) names.size();
+                names.push_back(name);
+                types.push_back(type);
+                addresses.push_back(nextAddress++);
+                declarationLines.push_back(lineNumber);
+                depths.push_back(depth);
+                shadowed.push_back(visible);
+                undoLog.push_back(symbol);
+                highWater = std::max(highWater, nextAddress);
+                occur(symbol, lineNumber);
+                bool newName = slots[slot].atom == NONE;
+                slots[slot] = Slot{name.id, symbol};
+                if (newName && ++usedSlots * 2 > slots.size()) grow();
             } else {
                 using namespace Compiler::Exception;
-                string_t message = "Symbol " + *name + " declaration more than once on line "
+                string_t message = "Symbol " + getName(name) + " declaration more than once on line "
                                    + std::to_string(lineNumber);
                 ExceptionHandle::getHandle().add_exception(ExceptionType::ANALYSIS_ERROR, message);
             }
@@ -114,39 +215,72 @@ namespace Compiler {
 
         /**
          * 注意插入符号表的symbol都是非空类型的. 因为当前语言没有void关键字,不允许声明一个void类型的ID.
-         * 如果返回空类型就说明查找的symbol不存在.
+         * 如果返回空类型就说明查找的symbol不存在(或者在当前作用域不可见).
          */
-        Type getSymbolType(const string_ptr &name) {
-            symbol_table_t::iterator pos;
-            if ((pos = table.find(SymbolEntry(name))) != table.end()) {
-                return (*pos).type; // 必然返回非空类型
-            }
-            return Type::Void;
+        Type getSymbolType(atom_t name) const {
+            auto symbol = find(name);
+            return symbol != NONE ? types[symbol] : Type::Void; // 找到时必然返回非空类型
         }
 
-        uintptr_t getSymbolAddress(const string_ptr &name) {
-            symbol_table_t::iterator pos;
-            if ((pos = table.find(SymbolEntry(name))) != table.end()) {
-                return (*pos).memory_address;
-            }
-            return null_address;
+        uintptr_t getSymbolAddress(atom_t name) const {
+            auto symbol = find(name);
+            return symbol != NONE ? addresses[symbol] : null_address;
         }
 
-        friend std::ostream &operator<<(std::ostream &out, const SymbolTable &symbolTable) {
-            out << "Variable_Name" << std::setw(20)
-                << "Memory_Address" << std::setw(20)
-                << "Data_Type" << std::setw(28)
-                << "Appear_Line_Number" << "\n";
-            for (auto &entry:symbolTable.table) {
-                out << boost::format("%-20s 0x%08x %-12s %-20s")
-                       % *entry.symbol_name % entry.memory_address % ""
-                       % TypeSystem::getTypeRepresentation(entry.type);
-                for (auto &line:entry.symbol_appear_lines) {
-                    out << boost::format("%-8d") % line;
+        /**
+         * --dump-symbols: 按 --dump-format 输出符号表(格式见 Dump.h), 按声明的顺序.
+         * text 格式每一行和原来 operator<< 的输出相同.
+         */
+        void dump() {
+            indexOccurrences();
+            auto &writer = Dump::Writer::getInstance();
+            switch (options().dumpFormat) {
+                case DumpFormat::Text:
+                    writer.printf("%s%20s%20s%28s\n", "Variable_Name", "Memory_Address", "Data_Type",
+                                  "Appear_Line_Number");
+                    break;
+                case DumpFormat::Json:
+                case DumpFormat::Binary:
+                    break;
+            }
+            for (size_t i = 0; i < names.size(); i++) {
+                auto name = AtomTable::getInstance().getString(names[i]);
+                auto first = occurrenceLines.data() + occurrenceStart[i];
+                auto last = occurrenceLines.data() + occurrenceStart[i + 1];
+                switch (options().dumpFormat) {
+                    case DumpFormat::Text:
+                        writer.printf("%-20.*s 0x%08" PRIxPTR " %-12s %-20s", (int) name.size(), name.data(),
+                                      addresses[i], "", TypeSystem::getTypeRepresentation(types[i]).c_str());
+                        for (auto line = first; line != last; line++) {
+                            writer.printf("%-8d", *line);
+                        }
+                        writer.put('\n');
+                        break;
+                    case DumpFormat::Json: {
+                        writer.write("{\"name\":");
+                        writer.jsonString(name);
+                        writer.printf(",\"address\":%" PRIuPTR ",\"type\":", addresses[i]);
+                        writer.jsonString(TypeSystem::getTypeRepresentation(types[i]));
+                        writer.write(",\"lines\":[");
+                        for (auto line = first; line != last; line++) {
+                            writer.printf(line == first ? "%d" : ",%d", *line);
+                        }
+                        writer.write("]}\n");
+                        break;
+                    }
+                    case DumpFormat::Binary:
+                        writer.put('S');
+                        writer.bytes(name);
+                        writer.value((uint64_t) addresses[i]);
+                        writer.value((uint8_t) types[i]);
+                        writer.value((uint32_t) (last - first));
+                        for (auto line = first; line != last; line++) {
+                            writer.value((uint32_t) *line);
+                        }
+                        break;
                 }
-                out << "\n";
             }
-            return out;
+            writer.flush();
         }
     };
 }
@@ -2,59 +2,12 @@
 // Created by junior on 19-4-7.
 //
 #include "Token.h"
+#include "Dump.h"
 
 namespace Compiler {
-    // 下面两个表(关键字表和合法字符表),本来是可以直接写成静态成员的,
-    // 但是那样写会报警告,可能会无法捕获异常.
-    // 所以一个更好的写法是,利用一个get-function来获取表,同时get-function构造的表前面加上static,
-    // 这样就避免每次调用get-function都去生成一次表.
+    // 关键字表和合法字符表都在 ScannerTable.h 里,由编译期常量表实现.
 
-    // 用哈希表处理关键字查询表
-    std::map<string_t, TokenType> getKeyWordTable() {
-        static std::map<string_t, TokenType> table{
-                {"if",     IF},
-                {"then",   THEN},
-                {"else",   ELSE},
-                {"end",    END},
-                {"repeat", REPEAT},
-                {"until",  UNTIL},
-                {"do",     DO},
-                {"while",  WHILE},
-                {"read",   READ},
-                {"write",  WRITE},
-                {"true",   TRUE},
-                {"false",  FALSE},
-                {"or",     OR},
-                {"and",    AND},
-                {"not",    NOT},
-                {"int",    INT},
-                {"bool",   BOOL},
-                {"float",  FLOAT},
-                {"double", DOUBLE},
-                {"string", STRING}
-        };
-        return table;
-    }
-
-    // 手动创建合法字符表,用哈希集合实现
-    std::unordered_set<char_t> getLegalCharTable() {
-        static std::unordered_set<char_t> table{
-                'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r', 's', 't', 'u',
-                'v', 'w', 'x', 'y', 'z',
-                'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L', 'M', 'N', 'O', 'P', 'Q', 'R', 'S', 'T', 'U',
-                'V', 'W', 'X', 'Y', 'Z',
-                '0', '1', '2', '3', '4', '5', '6', '7', '8', '9',
-                '+', '-', '*', '/', '%',
-                '(', ')', '{', '}',
-                '>', '<', '=', '!',
-                ':', ',', '\'', ';', '.',
-                '\r', '\n', '\t', ' ',
-                EOF
-        };
-        return table;
-    }
-
-    string_t getTokenRepresentation(TokenType type, const string_ptr &ptr) {
+    string_t getTokenRepresentation(TokenType type, std::string_view text) {
         switch (type) {
             case IF:
                 return "if";
@@ -131,20 +84,20 @@ namespace Compiler {
             case END_FILE:
                 return "EOF";
             case STR:
-                return (ptr != nullptr) ? *ptr : "STR";
+                return (text.data() != nullptr) ? string_t(text) : "STR";
             case ID:
-                return (ptr != nullptr) ? *ptr : "ID";
+                return (text.data() != nullptr) ? string_t(text) : "ID";
             case NUM:
-                return (ptr != nullptr) ? *ptr : "NUM";
+                return (text.data() != nullptr) ? string_t(text) : "NUM";
             case ERROR:
-                return (ptr != nullptr) ? *ptr : "ERROR";
+                return (text.data() != nullptr) ? string_t(text) : "ERROR";
         }
-        return (ptr != nullptr) ? *ptr : "";
+        return string_t(text);
     }
 
-    void printToken(TokenType type, const string_ptr &ptr) {
+    void printToken(TokenType type, std::string_view text) {
         string_t numType;
-        string_t representation = getTokenRepresentation(type, ptr);
+        string_t representation = getTokenRepresentation(type, text);
         switch (type) {
             case IF:
             case THEN:
@@ -166,7 +119,7 @@ namespace Compiler {
             case FLOAT:
             case DOUBLE:
             case STRING:
-                fprintf(OUTPUT_STREAM, "reserved word: %s\n", representation.c_str());
+                Dump::Writer::getInstance().printf("reserved word: %s\n", representation.c_str());
                 break;
             case ASSIGN:
             case LT:
@@ -185,10 +138,10 @@ namespace Compiler {
             case OVER:
             case MOD:
             case END_FILE:
-                fprintf(OUTPUT_STREAM, "%s\n", representation.c_str());
+                Dump::Writer::getInstance().printf("%s\n", representation.c_str());
                 break;
             case NUM:
-                switch (getNumType(*ptr)) {
+                switch (getNumType(text)) {
                     case NUM_TYPE::DECIMAL:
                         numType = "DECIMAL";
                         break;
@@ -205,17 +158,39 @@ namespace Compiler {
                         numType = "DOUBLE";
                         break;
                 }
-                fprintf(OUTPUT_STREAM, "NUMBER, val=%s, type=%s\n", representation.c_str(), numType.c_str());
+                Dump::Writer::getInstance().printf("NUMBER, val=%s, type=%s\n", representation.c_str(), numType.c_str());
                 break;
             case ID:
-                fprintf(OUTPUT_STREAM, "ID, name=%s\n", representation.c_str());
+                Dump::Writer::getInstance().printf("ID, name=%s\n", representation.c_str());
                 break;
             case STR:
-                fprintf(OUTPUT_STREAM, "STR, val=%s\n", representation.c_str());
+                Dump::Writer::getInstance().printf("STR, val=%s\n", representation.c_str());
                 break;
             default:
-                fprintf(OUTPUT_STREAM, "Unknown token: %s\n", representation.c_str());
+                Dump::Writer::getInstance().printf("Unknown token: %s\n", representation.c_str());
+                break;
+        }
+    }
+
+    void dumpToken(int lineNumber, TokenType type, std::string_view text) {
+        auto &writer = Dump::Writer::getInstance();
+        switch (options().dumpFormat) {
+            case DumpFormat::Text:
+                writer.printf("\t%d ", lineNumber);
+                printToken(type, text);
+                break;
+            case DumpFormat::Json:
+                writer.printf("{\"line\":%d,\"type\":%d,\"text\":", lineNumber, (int) type);
+                writer.jsonString(getTokenRepresentation(type, text));
+                writer.write("}\n");
+                break;
+            case DumpFormat::Binary:
+                writer.put('T');
+                writer.value((uint32_t) lineNumber);
+                writer.value((uint8_t) type);
+                writer.bytes(getTokenRepresentation(type, text));
                 break;
         }
+        if (type == END_FILE) writer.flush(); // 一个文件的Token输出完
     }
 }
@@ -52,12 +52,16 @@ namespace Compiler {
         // POINT  // 小数点.(用于提取浮点数以及后面支持对象对成员的访问)
     } TokenType;
 
-    std::map<string_t, TokenType> getKeyWordTable();
+    /**
+     * text 为 Token 在源文件中的文本视图(ID/NUM/STR/ERROR 才需要), 其他Token传空视图即可.
+     */
+    string_t getTokenRepresentation(TokenType type, std::string_view text = {});
 
-    std::unordered_set<char_t> getLegalCharTable();
+    void printToken(TokenType type, std::string_view text);
 
-    string_t getTokenRepresentation(TokenType type, const string_ptr &ptr);
-
-    void printToken(TokenType type, const string_ptr &ptr);
+    /**
+     * --dump-tokens: 按 --dump-format 输出一个Token(见 Dump.h), 输出 END_FILE 时写出缓冲.
+     */
+    void dumpToken(int lineNumber, TokenType type, std::string_view text);
 }
 #endif //SCANNER_TOKEN_H
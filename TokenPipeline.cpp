@@ -0,0 +1,49 @@
+//
+// Created by junior on 19-5-19.
+//
+
+#include "TokenPipeline.h"
+#include "CompilerContext.h"
+
+namespace Compiler::Scanner {
+    TokenPipeline::TokenPipeline() : context(CompilerContext::current()), lexer(&TokenPipeline::produce, this) {}
+
+    TokenPipeline::~TokenPipeline() {
+        ring.close(); // 语法分析可能没有读到 END_FILE 就结束了, 扫描线程不能一直等空槽
+        lexer.join();
+    }
+
+    void TokenPipeline::produce() {
+        CompilerContext::Bind bind(context);
+        bool end = false;
+        while (!end) {
+            auto batch = ring.beginWrite();
+            if (batch == nullptr) return;
+            end = tokenizeBatch(*batch, PIPELINE_BATCH_SIZE);
+            ring.endWrite();
+        }
+    }
+
+    TokenRet TokenPipeline::next() {
+        if (finished) {
+            // 越过 END_FILE 继续读取时和 Scanner 一样返回 END_FILE (Scanner 每次读到EOF行号都会加一)
+            last.lineNumber++;
+            return last;
+        }
+        if (current == nullptr || index == current->size()) {
+            // 上一批的最后一个Token已经被替换掉, 这一批可以还给扫描线程了
+            if (current != nullptr) ring.endRead();
+            current = ring.beginRead();
+            index = diagnosticIndex = 0;
+        }
+        while (diagnosticIndex < current->diagnostics.size() && current->diagnostics[diagnosticIndex].first <= index) {
+            Exception::ExceptionHandle::getHandle().add_exception(current->diagnostics[diagnosticIndex++].second);
+        }
+        auto token = current->get(index++);
+        if (token.tokenType == END_FILE) {
+            finished = true;
+            last = token;
+        }
+        return token;
+    }
+}
@@ -0,0 +1,111 @@
+//
+// Created by junior on 19-5-19.
+//
+/**
+ * 流水线模式: 独立的扫描线程一批一批地扫描Token, 通过单生产者/单消费者(SPSC)的无锁环形缓冲交给语法分析,
+ * 扫描和语法分析在两个核上同时进行.
+ *
+ * 环形缓冲的每个槽是一个 TokenBuffer(一批Token), 槽在两个线程之间轮流使用, clear() 保留容量, 稳定以后不再分配内存.
+ * 缓冲满时扫描线程等待语法分析读完一批(背压), 所以不论文件多大, 最多只占 PIPELINE_RING_SIZE 批的内存.
+ */
+
+#ifndef COMPILER_TOKENPIPELINE_H
+#define COMPILER_TOKENPIPELINE_H
+
+#include "Compiler.h"
+#include "Scanner.h"
+#include <atomic>
+#include <thread>
+
+namespace Compiler::Scanner {
+    /**
+     * 容量为 N(2的幂) 的 SPSC 环形缓冲. head 只由消费者写, tail 只由生产者写, 各占一个 cache line 避免伪共享.
+     * 槽的内容直接在原地读写: beginWrite()/endWrite() 之间生产者独占槽, beginRead()/endRead() 之间消费者独占槽.
+     * 等待时先自旋一小段时间, 然后让出CPU(单核机器上自旋没有意义).
+     */
+    template<typename T, size_t N>
+    class SpscRing {
+        static_assert(N > 0 && (N & (N - 1)) == 0, "ring size must be a power of 2");
+
+        std::array<T, N> slots;
+        alignas(64) std::atomic<size_t> head{0}; // 消费者下一个要读的位置
+        alignas(64) std::atomic<size_t> tail{0}; // 生产者下一个要写的位置
+        alignas(64) std::atomic<bool> closed{false};
+
+        template<typename Ready>
+        static void waitUntil(Ready &&ready) {
+            for (int spin = 0; !ready(); spin++) {
+                if (spin >= 64) std::this_thread::yield();
+            }
+        }
+
+    public:
+        /**
+         * 等待一个空槽. 消费者已经关闭缓冲时返回 nullptr, 生产者应该停止.
+         */
+        T *beginWrite() {
+            size_t position = tail.load(std::memory_order_relaxed);
+            waitUntil([&] {
+                return position - head.load(std::memory_order_acquire) < N || closed.load(std::memory_order_relaxed);
+            });
+            if (closed.load(std::memory_order_relaxed)) return nullptr;
+            return &slots[position & (N - 1)];
+        }
+
+        void endWrite() {
+            tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        // 等待生产者写好下一个槽
+        T *beginRead() {
+            size_t position = head.load(std::memory_order_relaxed);
+            waitUntil([&] { return tail.load(std::memory_order_acquire) != position; });
+            return &slots[position & (N - 1)];
+        }
+
+        void endRead() {
+            head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        // 消费者不再读取, 唤醒等待空槽的生产者
+        void close() {
+            closed.store(true, std::memory_order_relaxed);
+        }
+    };
+
+    class TokenPipeline {
+    private:
+        SpscRing<TokenBuffer, PIPELINE_RING_SIZE> ring;
+        CompilerContext &context; // 创建流水线的线程正在编译的文件, 扫描线程也绑定到它
+        std::thread lexer;
+
+        const TokenBuffer *current = nullptr; // 语法分析正在读取的一批
+        size_t index = 0;
+        size_t diagnosticIndex = 0;
+        bool finished = false; // 已经读到 END_FILE
+        TokenRet last;
+
+        void produce();
+
+    public:
+        /**
+         * 启动扫描线程, 从头扫描当前文件(CompilerContext::file). 扫描线程使用和逐个扫描相同的扫描器,
+         * 析构(等待扫描线程结束)之前不能调用 getToken()/tokenize().
+         */
+        TokenPipeline();
+
+        ~TokenPipeline();
+
+        TokenPipeline(TokenPipeline const &) = delete;
+
+        void operator=(TokenPipeline const &) = delete;
+
+        /**
+         * 读取下一个Token, 同时提交扫描这个Token时产生的词法错误. 只能在构造它的线程里调用.
+         * 返回的 tokenString 在下一次调用之前有效.
+         */
+        TokenRet next();
+    };
+}
+
+#endif //COMPILER_TOKENPIPELINE_H
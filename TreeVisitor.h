@@ -0,0 +1,92 @@
+//
+// Created by junior on 19-6-8.
+//
+
+#ifndef COMPILER_TREEVISITOR_H
+#define COMPILER_TREEVISITOR_H
+
+#include "Compiler.h"
+#include "Parser.h"
+
+namespace Compiler::Parser {
+    /**
+     * 语法树访问者, 静态分派(CRTP): Derived 继承 TreeVisitor<Derived>, 定义需要的
+     *   void enter(TreeNode &n)  先序处理, 子节点之前
+     *   void leave(TreeNode &n)  后序处理, 所有子节点之后, 兄弟节点之前
+     *   void beginChild(TreeNode &parent, size_t i)  进入 parent 的第 i 个子节点(连同它的兄弟链)之前
+     *   void endChild(TreeNode &parent, size_t i)    第 i 个子节点的兄弟链全部处理完之后
+     *   bool skip(TreeNode &n)   返回 true 时跳过 n 和它的子树(n 的兄弟照常访问)
+     * 没有定义的就用这里的空函数. 调用在编译期确定, 可以内联, 不经过 std::function 或者虚函数.
+     *
+     * traverse() 用显式栈遍历, 栈里每一项是一条兄弟链上当前的节点和它下一个要访问的子节点,
+     * 深度只受堆内存限制. 栈保留在访问者里, 多次遍历不用重新分配.
+     *
+     * --hash-cons 时表达式是 DAG, 共享的节点从每个父节点都会访问一次. 只想访问一次的访问者在 skip 里返回 revisit(n).
+     */
+    template<typename Derived>
+    class TreeVisitor {
+    private:
+        std::vector<std::pair<TreeNode::ptr, size_t>> stack;
+        std::unordered_set<const TreeNode *> visitedShared;
+
+        // 从 p 开始沿兄弟链找到第一个不跳过的节点, 到 end 为止
+        TreeNode::ptr unskipped(TreeNode::ptr p, TreeNode::ptr end = nullptr) {
+            auto &derived = static_cast<Derived &>(*this);
+            while (p != end && derived.skip(*p)) p = p->sibling;
+            return p == end ? nullptr : p;
+        }
+
+    protected:
+        // 共享的节点在这次遍历里已经访问过
+        bool revisit(const TreeNode &n) {
+            return n.shared && !visitedShared.insert(&n).second;
+        }
+
+    public:
+        void enter(TreeNode &) {}
+
+        void leave(TreeNode &) {}
+
+        void beginChild(TreeNode &, size_t) {}
+
+        void endChild(TreeNode &, size_t) {}
+
+        bool skip(TreeNode &) { return false; }
+
+        // 遍历从 head 开始的兄弟链(到 end 之前为止, 默认到链尾)以及所有子树
+        void traverse(TreeNode::ptr head, TreeNode::ptr end = nullptr) {
+            auto &derived = static_cast<Derived &>(*this);
+            stack.clear();
+            visitedShared.clear();
+            head = unskipped(head, end);
+            if (head != nullptr) {
+                derived.enter(*head);
+                stack.emplace_back(head, 0);
+            }
+            while (!stack.empty()) {
+                auto node = stack.back().first;
+                auto next = stack.back().second;
+                TreeNode::ptr p;
+                if (next < node->children.size()) {
+                    stack.back().second++;
+                    p = unskipped(node->children[next]);
+                    derived.beginChild(*node, next);
+                    if (p == nullptr) derived.endChild(*node, next);
+                } else {
+                    p = unskipped(node->sibling, stack.size() == 1 ? end : nullptr);
+                    derived.leave(*node);
+                    stack.pop_back();
+                    if (p == nullptr && !stack.empty()) { // 一条子节点的兄弟链结束
+                        derived.endChild(*stack.back().first, stack.back().second - 1);
+                    }
+                }
+                if (p != nullptr) {
+                    derived.enter(*p);
+                    stack.emplace_back(p, 0);
+                }
+            }
+        }
+    };
+}
+
+#endif //COMPILER_TREEVISITOR_H
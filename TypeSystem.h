@@ -40,7 +40,7 @@ namespace Compiler {
             }
         }
 
-        static Type getTypeFromToken(TokenType token) {
+        static constexpr Type getTypeFromToken(TokenType token) {
             switch (token) {
                 case TokenType::INT:
                     return Type::Integer;
@@ -57,5 +57,118 @@ namespace Compiler {
             }
         }
     };
+
+    /**
+     * 类型格(lattice): 运算和赋值的类型规则都从下面的编译期常量表查出来, 不再写成一串分支.
+     *  数值类型 Integer < Float < Double, 两个数值类型的 join 是较大的那个(往大的类型cast):
+     *          int       float     double
+     *  int      I          F          D
+     *  float    F          F          D
+     *  double   D          D          D
+     *  Boolean 和 String 只和自己相容; Void 表示类型错误.
+     */
+    constexpr size_t TYPE_COUNT = (size_t) Type::Double + 1;
+
+    // 数值类型的秩, 非数值类型为 0
+    constexpr uint8_t numericRank(Type t) {
+        switch (t) {
+            case Type::Integer:
+                return 1;
+            case Type::Float:
+                return 2;
+            case Type::Double:
+                return 3;
+            default:
+                return 0;
+        }
+    }
+
+    // 运算符的类别, 同一类的运算符类型规则相同
+    enum class OperatorClass : uint8_t {
+        None,       // 不是运算符
+        Not,        // 单目逻辑运算 NOT (输入bool,输出bool)
+        Arithmetic, // 双目数值运算 PLUS MINUS TIMES OVER MOD (输入两个NUM,输出一个NUM)
+        Logical,    // 双目逻辑运算 AND OR (输入两个bool,输出一个bool)
+        Comparison, // 双目比较运算 LT BT LE BE EQ NE (输入两个NUM,输出一个bool)
+        Count
+    };
+
+    constexpr OperatorClass operatorClass(TokenType op) {
+        switch (op) {
+            case TokenType::NOT:
+                return OperatorClass::Not;
+            case TokenType::PLUS:
+            case TokenType::MINUS:
+            case TokenType::TIMES:
+            case TokenType::OVER:
+            case TokenType::MOD:
+                return OperatorClass::Arithmetic;
+            case TokenType::AND:
+            case TokenType::OR:
+                return OperatorClass::Logical;
+            case TokenType::LT:
+            case TokenType::LE:
+            case TokenType::BT:
+            case TokenType::BE:
+            case TokenType::EQ:
+            case TokenType::NE:
+                return OperatorClass::Comparison;
+            default:
+                return OperatorClass::None;
+        }
+    }
+
+    using TypeTable = std::array<std::array<Type, TYPE_COUNT>, TYPE_COUNT>;
+
+    // resultTypes[类别][t1][t2]: 运算结果的类型, 操作数类型不对时为 Void. 单目运算只看 t1.
+    constexpr std::array<TypeTable, (size_t) OperatorClass::Count> makeResultTypes() {
+        std::array<TypeTable, (size_t) OperatorClass::Count> table{};
+        constexpr Type numeric[] = {Type::Void, Type::Integer, Type::Float, Type::Double};
+        for (size_t i = 0; i < TYPE_COUNT; i++) {
+            for (size_t j = 0; j < TYPE_COUNT; j++) {
+                auto t1 = (Type) i, t2 = (Type) j;
+                auto r1 = numericRank(t1), r2 = numericRank(t2);
+                bool numbers = r1 != 0 && r2 != 0;
+                bool booleans = t1 == Type::Boolean && t2 == Type::Boolean;
+                table[(size_t) OperatorClass::None][i][j] = Type::Void;
+                table[(size_t) OperatorClass::Not][i][j] = t1 == Type::Boolean ? Type::Boolean : Type::Void;
+                table[(size_t) OperatorClass::Arithmetic][i][j] = numbers ? numeric[std::max(r1, r2)] : Type::Void;
+                table[(size_t) OperatorClass::Logical][i][j] = booleans ? Type::Boolean : Type::Void;
+                table[(size_t) OperatorClass::Comparison][i][j] = numbers ? Type::Boolean : Type::Void;
+            }
+        }
+        return table;
+    }
+
+    constexpr auto resultTypes = makeResultTypes();
+
+    /**
+     * assignableTypes[target][value]: value 类型的表达式能否赋给 target 类型的变量:
+     * 1. target 为 String 或 Boolean 的, 则 value 必须类型相同;
+     * 2. target 为 Integer|Float|Double 的, 则 value 为 Integer|Float|Double 都可以
+     *    (即使expr类型是double,ID的type是int也没有关系,可以 int ID = int_cast(double_expr));
+     * 3. target 为 Void(符号没有正确声明)时不检查.
+     */
+    constexpr std::array<std::array<bool, TYPE_COUNT>, TYPE_COUNT> makeAssignableTypes() {
+        std::array<std::array<bool, TYPE_COUNT>, TYPE_COUNT> table{};
+        for (size_t i = 0; i < TYPE_COUNT; i++) {
+            for (size_t j = 0; j < TYPE_COUNT; j++) {
+                auto target = (Type) i, value = (Type) j;
+                if (target == Type::String || target == Type::Boolean) table[i][j] = value == target;
+                else if (numericRank(target) != 0) table[i][j] = numericRank(value) != 0;
+                else table[i][j] = true;
+            }
+        }
+        return table;
+    }
+
+    constexpr auto assignableTypes = makeAssignableTypes();
+
+    static_assert(resultTypes[(size_t) OperatorClass::Arithmetic][(size_t) Type::Integer][(size_t) Type::Float] ==
+                  Type::Float, "int op float widens to float");
+    static_assert(resultTypes[(size_t) OperatorClass::Arithmetic][(size_t) Type::Float][(size_t) Type::Double] ==
+                  Type::Double, "float op double widens to double");
+    static_assert(resultTypes[(size_t) OperatorClass::Logical][(size_t) Type::Boolean][(size_t) Type::Integer] ==
+                  Type::Void, "logic operators only accept Boolean");
 }
 #endif //COMPILER_TYPESYSTEM_H
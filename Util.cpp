@@ -5,9 +5,9 @@
 #include <cassert>
 
 namespace Compiler {
-    NUM_TYPE getNumType(const string_t &tokenString) {
+    NUM_TYPE getNumType(std::string_view tokenString) {
         // assert(tokenString.size() > 0);
-        if (tokenString.find('.') != string_t::npos) {
+        if (tokenString.find('.') != std::string_view::npos) {
             if (*tokenString.rbegin() == 'F' || *tokenString.rbegin() == 'f') return NUM_TYPE::FLOAT;
             else return NUM_TYPE::DOUBLE;
         }
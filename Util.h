@@ -35,12 +35,26 @@ namespace Compiler {
     typedef double double_t;
     typedef char char_t;
     typedef std::string string_t;
-    typedef std::shared_ptr<string_t> string_ptr;
 
-    inline string_ptr make_string_ptr(const string_t &str) {
-        return std::make_shared<string_t>(str);
-    }
+    /**
+     * 标识符/字符串常量在 AtomTable 里的编号. 相同的字符串一定得到相同的 atom,
+     * 所以比较两个名字只需要比较两个整数. 用结构体包装而不是直接 typedef uint32_t,
+     * 避免和 int_t 之类的整数属性在 std::variant 里混淆.
+     */
+    struct atom_t {
+        uint32_t id;
+
+        bool operator==(const atom_t &other) const { return id == other.id; }
+
+        bool operator!=(const atom_t &other) const { return id != other.id; }
+    };
+
+    /**
+     * NUM 型Token在扫描时就按进制转换好的数值: 整数常量(10/16/8进制)为 int_t,
+     * 以 f/F 结尾的浮点常量为 float_t, 其他浮点常量为 double_t.
+     */
+    typedef std::variant<int_t, float_t, double_t> num_t;
 
-    NUM_TYPE getNumType(const string_t &tokenString);
+    NUM_TYPE getNumType(std::string_view tokenString);
 }
 #endif //COMPILER_UTIL_H
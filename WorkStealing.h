@@ -0,0 +1,77 @@
+//
+// Created by junior on 19-6-11.
+//
+/**
+ * 工作窃取(work stealing)的并行循环 parallelFor(count, threads, task): 对 [0, count) 的每个 i 调用一次 task(worker, i).
+ * 任务按编号平均切成 threads 段, 每个线程先从自己那一段的前面取任务, 做完以后从别的线程那一段的后面偷走一半,
+ * 任务大小不均匀(比如一个很大的 if 语句)时也不会有线程早早空闲.
+ * 每一段 [begin, end) 打包在一个64位原子变量里, 取和偷都是一次 CAS. 同一个编号只会被分出去一次, 所以没有 ABA 问题.
+ *
+ * worker 是执行任务的线程编号(0 是调用者自己), 同一个 worker 的任务串行执行, 可以用它索引线程自己的缓冲区.
+ * 任务之间要自己保证互不干扰.
+ */
+
+#ifndef COMPILER_WORKSTEALING_H
+#define COMPILER_WORKSTEALING_H
+
+#include "Compiler.h"
+#include <atomic>
+
+namespace Compiler {
+    template<typename Task>
+    void parallelFor(size_t count, unsigned threads, Task &&task) {
+        threads = (unsigned) std::min<size_t>(threads, count);
+        if (threads <= 1) {
+            for (size_t i = 0; i < count; i++) task(0u, i);
+            return;
+        }
+        auto pack = [](uint64_t begin, uint64_t end) { return begin << 32 | end; };
+        struct alignas(64) Range { // 每段单独一个缓存行, 避免伪共享
+            std::atomic<uint64_t> bounds;
+        };
+        std::vector<Range> ranges(threads);
+        for (unsigned w = 0; w < threads; w++) {
+            ranges[w].bounds.store(pack(count * w / threads, count * (w + 1) / threads), std::memory_order_relaxed);
+        }
+
+        auto work = [&](unsigned worker) {
+            auto &own = ranges[worker].bounds;
+            for (;;) {
+                auto bounds = own.load(std::memory_order_acquire);
+                uint64_t begin = bounds >> 32, end = bounds & 0xFFFFFFFFu;
+                if (begin < end) {
+                    if (own.compare_exchange_weak(bounds, pack(begin + 1, end), std::memory_order_acq_rel)) {
+                        task(worker, (size_t) begin);
+                    }
+                    continue;
+                }
+                // 自己的任务做完了, 依次看其他线程, 偷走剩下的一半
+                bool stolen = false;
+                for (unsigned k = 1; k < threads && !stolen; k++) {
+                    auto &victim = ranges[(worker + k) % threads].bounds;
+                    auto theirs = victim.load(std::memory_order_acquire);
+                    for (;;) {
+                        uint64_t from = theirs >> 32, to = theirs & 0xFFFFFFFFu;
+                        if (from >= to) break;
+                        auto half = (to - from + 1) / 2;
+                        if (victim.compare_exchange_weak(theirs, pack(from, to - half), std::memory_order_acq_rel)) {
+                            own.store(pack(to - half, to), std::memory_order_release);
+                            stolen = true;
+                            break;
+                        }
+                    }
+                }
+                if (!stolen) return; // 没有剩下的任务(别人手里正在做的不用等)
+            }
+        };
+
+        std::vector<std::future<void>> futures;
+        for (unsigned w = 1; w < threads; w++) {
+            futures.push_back(std::async(std::launch::async, work, w));
+        }
+        work(0);
+        for (auto &future:futures) future.get();
+    }
+}
+
+#endif //COMPILER_WORKSTEALING_H
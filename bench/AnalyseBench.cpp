@@ -0,0 +1,67 @@
+//
+// Created by junior on 19-6-13.
+//
+/**
+ * 语义分析: 先扫描和语法分析(不计时), 然后分别计时指针形式的 analyse(root) 和 --flat-ast 的 analyse(flat).
+ * 扁平形式另外给出 flatten() 的时间, 编译器在 --flat-ast 下要多付这一步.
+ * 用法: AnalyseBench [输入大小(MB), 默认16] [运行次数, 默认3]
+ */
+
+#include "BenchUtil.h"
+#include "Analyser.h"
+
+using namespace Compiler;
+
+int main(int argc, char *argv[]) {
+    auto arguments = Bench::parseArguments(argc, argv);
+    auto path = Bench::bulkInput(arguments.megabytes);
+
+    printf("input: %s, %.1f MB\n", path.c_str(), (double) Bench::fileSize(path) / (1 << 20));
+    printf("%-8s %10s %10s %8s\n", "form", "flatten", "analyse", "speedup");
+    double pointerTime = 0;
+    for (std::string form : {"pointer", "flat"}) {
+        double flatten = 1e30, analyse = 1e30;
+        for (int run = 0; run < arguments.runs; run++) {
+            FileUtil::SourceFile source;
+            FileUtil::openFile(path.c_str(), source);
+            {
+                CompilerContext context;
+                CompilerContext::Bind bind(context);
+                context.file = &source;
+                context.options.flatAst = form == "flat";
+                Scanner::TokenBuffer buffer;
+                Scanner::tokenize(buffer);
+                auto root = Parser::parse(buffer);
+
+                Parser::FlatTree flat;
+                if (context.options.flatAst) {
+                    double start = Bench::now();
+                    flat = Parser::flatten(root);
+                    flatten = std::min(flatten, Bench::now() - start);
+                    Parser::clearAll(); // 和编译器一样先释放指针形式的树
+                    root = nullptr;
+                }
+                double start = Bench::now();
+                if (context.options.flatAst) Analyser::analyse(flat);
+                else Analyser::analyse(root);
+                double analysed = Bench::now();
+
+                if (context.diagnostics.hasException()) {
+                    fprintf(stderr, "unexpected errors in %s\n", path.c_str());
+                    return 1;
+                }
+                analyse = std::min(analyse, analysed - start);
+                Scanner::clearAll();
+                Parser::clearAll();
+            }
+            FileUtil::closeFile(source);
+        }
+        if (form == "pointer") {
+            pointerTime = analyse;
+            printf("%-8s %10s %10.3f %8s\n", form.c_str(), "-", analyse, "1.00x");
+        } else {
+            printf("%-8s %10.3f %10.3f %7.2fx\n", form.c_str(), flatten, analyse, pointerTime / analyse);
+        }
+    }
+    return 0;
+}
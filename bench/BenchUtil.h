@@ -0,0 +1,109 @@
+//
+// Created by junior on 19-6-13.
+//
+/**
+ * 性能测试共用的工具: 生成输入文件, 计时(取多次运行中最快的一次), 读取进程的峰值内存.
+ * 每个性能测试程序的参数都是 [输入大小(MB)] [运行次数], 输入由 ProgramGenerator 按固定的种子生成,
+ * 同样的参数在任何机器上得到同样的输入.
+ */
+
+#ifndef COMPILER_BENCHUTIL_H
+#define COMPILER_BENCHUTIL_H
+
+#include "ProgramGenerator.h"
+#include "TestUtil.h"
+#include <chrono>
+#include <fstream>
+#include <sys/resource.h>
+
+namespace Compiler::Bench {
+    struct Arguments {
+        size_t megabytes = 16;
+        int runs = 3;
+    };
+
+    inline Arguments parseArguments(int argc, char *argv[]) {
+        Arguments arguments;
+        if (argc > 1) arguments.megabytes = (size_t) std::max(1, atoi(argv[1]));
+        if (argc > 2) arguments.runs = std::max(1, atoi(argv[2]));
+        return arguments;
+    }
+
+    // 生成 megabytes 大小的程序(ProgramGenerator::bulk), 返回文件名
+    inline std::string bulkInput(size_t megabytes) {
+        auto path = "bench_" + std::to_string(megabytes) + "m.tny";
+        std::ifstream existing(path, std::ios::binary | std::ios::ate);
+        if (existing && (size_t) existing.tellg() >= megabytes << 20) return path; // 上一次已经生成过
+        Test::writeFile(path, Test::ProgramGenerator(2019).bulk(megabytes << 20));
+        return path;
+    }
+
+    inline size_t fileSize(const std::string &path) {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        return (size_t) file.tellg();
+    }
+
+    inline double now() {
+        using namespace std::chrono;
+        return duration<double>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    // 进程用掉的CPU时间(用户态+内核态, 所有线程), 秒
+    inline double cpuTime() {
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        return (double) usage.ru_utime.tv_sec + (double) usage.ru_utime.tv_usec / 1e6 +
+               (double) usage.ru_stime.tv_sec + (double) usage.ru_stime.tv_usec / 1e6;
+    }
+
+    struct Timing {
+        double wall = 1e30; // 最快一次的墙钟时间
+        double cpu = 0;     // 同一次的CPU时间
+    };
+
+    // 运行 runs 次 body, 返回最快的一次
+    template<typename Body>
+    Timing bestOf(int runs, Body &&body) {
+        Timing best;
+        for (int i = 0; i < runs; i++) {
+            double wall = now(), cpu = cpuTime();
+            body();
+            wall = now() - wall;
+            cpu = cpuTime() - cpu;
+            if (wall < best.wall) best = {wall, cpu};
+        }
+        return best;
+    }
+
+    // /proc/self/status 里的一项(VmRSS, VmHWM ...), KB. 读不到时返回 -1
+    inline long memoryStatus(const std::string &key) {
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line)) {
+            if (line.compare(0, key.size() + 1, key + ":") == 0) return atol(line.c_str() + key.size() + 1);
+        }
+        return -1;
+    }
+
+    // 进程当前的常驻内存, KB
+    inline long currentRss() {
+        return memoryStatus("VmRSS");
+    }
+
+    // 进程的峰值常驻内存, KB
+    inline long peakRss() {
+        auto peak = memoryStatus("VmHWM");
+        if (peak >= 0) return peak;
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss;
+    }
+
+    // 把峰值常驻内存重置为当前的常驻内存, 之后的 peakRss() 只反映这之后的峰值. 不支持时什么也不做
+    inline void resetPeakRss() {
+        std::ofstream clear("/proc/self/clear_refs");
+        clear << "5";
+    }
+}
+
+#endif //COMPILER_BENCHUTIL_H
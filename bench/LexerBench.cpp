@@ -0,0 +1,58 @@
+//
+// Created by junior on 19-6-13.
+//
+/**
+ * 扫描速度: 现在的 Scanner(mmap + 查表 + SIMD 跳过空白/注释/字符串)和原来逐行 fgets 的 DFA(ReferenceLexer.h),
+ * 扫描同一个文件, 输出每秒的Token数.
+ * 用法: LexerBench [输入大小(MB), 默认16] [运行次数, 默认3]
+ */
+
+#include "BenchUtil.h"
+#include "ReferenceLexer.h"
+
+using namespace Compiler;
+
+int main(int argc, char *argv[]) {
+    auto arguments = Bench::parseArguments(argc, argv);
+    auto path = Bench::bulkInput(arguments.megabytes);
+    auto megabytes = (double) Bench::fileSize(path) / (1 << 20);
+
+    size_t tokens = 0;
+    auto current = Bench::bestOf(arguments.runs, [&] {
+        FileUtil::SourceFile source;
+        FileUtil::openFile(path.c_str(), source);
+        {
+            CompilerContext context;
+            CompilerContext::Bind bind(context);
+            context.file = &source;
+            Scanner::TokenBuffer buffer;
+            Scanner::tokenize(buffer);
+            tokens = buffer.size();
+            Scanner::clearAll();
+        }
+        FileUtil::closeFile(source);
+    });
+
+    size_t referenceTokens = 0;
+    auto reference = Bench::bestOf(arguments.runs, [&] {
+        FILE *file = fopen(path.c_str(), "r");
+        Bench::ReferenceLexer lexer(file);
+        referenceTokens = 0;
+        while (lexer.getToken().first != END_FILE) referenceTokens++;
+        referenceTokens++; // END_FILE
+        fclose(file);
+    });
+
+    printf("input: %s, %.1f MB, %zu tokens\n", path.c_str(), megabytes, tokens);
+    printf("%-10s %10s %12s %10s\n", "lexer", "seconds", "Mtokens/s", "MB/s");
+    printf("%-10s %10.3f %12.2f %10.1f\n", "previous", reference.wall, (double) referenceTokens / reference.wall / 1e6,
+           megabytes / reference.wall);
+    printf("%-10s %10.3f %12.2f %10.1f\n", "current", current.wall, (double) tokens / current.wall / 1e6,
+           megabytes / current.wall);
+    printf("speedup: %.1fx\n", reference.wall / current.wall);
+    if (tokens != referenceTokens) {
+        fprintf(stderr, "token count differs: current %zu, previous %zu\n", tokens, referenceTokens);
+        return 1;
+    }
+    return 0;
+}
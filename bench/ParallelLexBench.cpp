@@ -0,0 +1,44 @@
+//
+// Created by junior on 19-6-13.
+//
+/**
+ * 并行扫描的扩展性: 用 1 到 32 个线程(--lex-threads)扫描同一个文件, 输出墙钟时间, CPU时间和相对一个线程的加速比.
+ * CPU时间/墙钟时间接近线程数说明各块真的在同时扫描; 核数少于线程数时墙钟时间不会再下降.
+ * 用法: ParallelLexBench [输入大小(MB), 默认16] [运行次数, 默认3]
+ */
+
+#include "BenchUtil.h"
+#include <thread>
+
+using namespace Compiler;
+
+int main(int argc, char *argv[]) {
+    auto arguments = Bench::parseArguments(argc, argv);
+    auto path = Bench::bulkInput(arguments.megabytes);
+
+    printf("input: %s, %.1f MB, %u hardware threads\n", path.c_str(), (double) Bench::fileSize(path) / (1 << 20),
+           std::thread::hardware_concurrency());
+    printf("%-8s %10s %10s %12s %8s\n", "threads", "seconds", "cpu", "Mtokens/s", "speedup");
+    double serial = 0;
+    for (unsigned threads : {1u, 2u, 4u, 8u, 16u, 32u}) {
+        size_t tokens = 0;
+        auto timing = Bench::bestOf(arguments.runs, [&] {
+            FileUtil::SourceFile source;
+            FileUtil::openFile(path.c_str(), source);
+            {
+                CompilerContext context;
+                CompilerContext::Bind bind(context);
+                context.file = &source;
+                Scanner::TokenBuffer buffer;
+                Scanner::tokenize(buffer, threads);
+                tokens = buffer.size();
+                Scanner::clearAll();
+            }
+            FileUtil::closeFile(source);
+        });
+        if (threads == 1) serial = timing.wall;
+        printf("%-8u %10.3f %10.3f %12.2f %7.2fx\n", threads, timing.wall, timing.cpu,
+               (double) tokens / timing.wall / 1e6, serial / timing.wall);
+    }
+    return 0;
+}
@@ -0,0 +1,56 @@
+//
+// Created by junior on 19-6-13.
+//
+/**
+ * 语法分析: 先把文件扫描到 TokenBuffer(不计时), 然后分别计时语法分析和释放整棵语法树(Parser::clearAll),
+ * 并输出语法分析期间常驻内存的增长(峰值减去开始时的值). 递归下降和 --ll1 表驱动分析器各测一次.
+ * 用法: ParseBench [输入大小(MB), 默认16] [运行次数, 默认3]
+ */
+
+#include "BenchUtil.h"
+
+using namespace Compiler;
+
+int main(int argc, char *argv[]) {
+    auto arguments = Bench::parseArguments(argc, argv);
+    auto path = Bench::bulkInput(arguments.megabytes);
+
+    printf("input: %s, %.1f MB\n", path.c_str(), (double) Bench::fileSize(path) / (1 << 20));
+    printf("%-18s %10s %10s %12s\n", "parser", "parse", "teardown", "peak RSS MB");
+    for (std::string mode : {"recursive descent", "LL(1) table"}) {
+        double parse = 1e30, teardown = 1e30;
+        long growth = 0;
+        for (int run = 0; run < arguments.runs; run++) {
+            FileUtil::SourceFile source;
+            FileUtil::openFile(path.c_str(), source);
+            {
+                CompilerContext context;
+                CompilerContext::Bind bind(context);
+                context.file = &source;
+                context.options.tableParser = mode != "recursive descent";
+                Scanner::TokenBuffer buffer;
+                Scanner::tokenize(buffer);
+
+                Bench::resetPeakRss();
+                long before = Bench::currentRss();
+                double start = Bench::now();
+                Parser::parse(buffer);
+                double parsed = Bench::now();
+                growth = std::max(growth, Bench::peakRss() - before);
+                Parser::clearAll();
+                double freed = Bench::now();
+
+                if (context.diagnostics.hasException()) {
+                    fprintf(stderr, "unexpected errors in %s\n", path.c_str());
+                    return 1;
+                }
+                parse = std::min(parse, parsed - start);
+                teardown = std::min(teardown, freed - parsed);
+                Scanner::clearAll();
+            }
+            FileUtil::closeFile(source);
+        }
+        printf("%-18s %10.3f %10.3f %12.1f\n", mode.c_str(), parse, teardown, (double) growth / 1024);
+    }
+    return 0;
+}
@@ -0,0 +1,57 @@
+//
+// Created by junior on 19-6-13.
+//
+/**
+ * 扫描和语法分析的三种组合, 计时包括扫描, 语法分析和释放语法树:
+ *  inline:   语法分析每次要一个Token时才扫描(默认);
+ *  batch:    先把整个文件扫描到 TokenBuffer, 再语法分析(--batch-lex);
+ *  pipeline: 扫描线程和语法分析同时进行(--pipeline), 至少两个核时墙钟时间才会比 inline 少.
+ * 用法: PipelineBench [输入大小(MB), 默认16] [运行次数, 默认3]
+ */
+
+#include "BenchUtil.h"
+#include "TokenPipeline.h"
+#include <thread>
+
+using namespace Compiler;
+
+int main(int argc, char *argv[]) {
+    auto arguments = Bench::parseArguments(argc, argv);
+    auto path = Bench::bulkInput(arguments.megabytes);
+
+    printf("input: %s, %.1f MB, %u hardware threads\n", path.c_str(), (double) Bench::fileSize(path) / (1 << 20),
+           std::thread::hardware_concurrency());
+    printf("%-10s %10s %10s %8s\n", "mode", "seconds", "cpu", "speedup");
+    double inlineTime = 0;
+    for (std::string mode : {"inline", "batch", "pipeline"}) {
+        auto timing = Bench::bestOf(arguments.runs, [&] {
+            FileUtil::SourceFile source;
+            FileUtil::openFile(path.c_str(), source);
+            {
+                CompilerContext context;
+                CompilerContext::Bind bind(context);
+                context.file = &source;
+                if (mode == "inline") {
+                    Parser::parse();
+                } else if (mode == "batch") {
+                    Scanner::TokenBuffer buffer;
+                    Scanner::tokenize(buffer);
+                    Parser::parse(buffer);
+                } else {
+                    Scanner::TokenPipeline pipeline;
+                    Parser::parse(pipeline);
+                }
+                if (context.diagnostics.hasException()) {
+                    fprintf(stderr, "unexpected errors in %s\n", path.c_str());
+                    exit(1);
+                }
+                Scanner::clearAll();
+                Parser::clearAll();
+            }
+            FileUtil::closeFile(source);
+        });
+        if (mode == "inline") inlineTime = timing.wall;
+        printf("%-10s %10.3f %10.3f %7.2fx\n", mode.c_str(), timing.wall, timing.cpu, inlineTime / timing.wall);
+    }
+    return 0;
+}
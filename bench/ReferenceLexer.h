@@ -0,0 +1,271 @@
+//
+// Created by junior on 19-6-13.
+//
+/**
+ * 性能测试的参照: 原来(mmap 和 SIMD 之前)的 Scanner. 逐行 fgets 读文件, 每个Token复制一次关键字表和合法字符表,
+ * ID/NUM/STR/ERROR 各分配一个字符串. 状态转移和原来完全一样, 只是去掉了全局变量, 词法错误只计数不放进 ExceptionHandle.
+ */
+
+#ifndef COMPILER_REFERENCELEXER_H
+#define COMPILER_REFERENCELEXER_H
+
+#include "Token.h"
+#include <cstring>
+#include <map>
+#include <memory>
+#include <unordered_set>
+
+namespace Compiler::Bench {
+    class ReferenceLexer {
+    public:
+        explicit ReferenceLexer(FILE *file) : file(file) {}
+
+        size_t errors = 0; // 词法错误的个数
+
+        // 返回下一个Token的类型和文本(ID/NUM/STR/ERROR 以外为 nullptr)
+        std::pair<TokenType, std::shared_ptr<string_t>> getToken() {
+            string_t tokenString;
+            TokenType currentToken = END_FILE;
+            State state = START;
+            bool saveTokenString;
+            auto legalCharTable = getLegalCharTable();
+            auto keyWordTable = getKeyWordTable();
+
+            while (state != DONE) {
+                int c = getNextChar();
+                if (legalCharTable.find((char_t) c) == legalCharTable.end()) {
+                    if (state != INCOMMENT && state != INSTR) {
+                        error("LineNumber:" + std::to_string(lineNumber) + ",Pos:" + std::to_string(pos) +
+                              ",illegal char:" + char_t(c));
+                        continue;
+                    }
+                }
+                saveTokenString = true;
+                switch (state) {
+                    case START:
+                        if (c == '.') state = IN_FLOAT;
+                        else if (c == '0') state = IN_OCT;
+                        else if (c >= '1' && c <= '9') state = IN_DECIMAL;
+                        else if (isalpha(c)) state = INID;
+                        else if (c == ':') state = INASSIGN;
+                        else if (c == '!') state = INNE;
+                        else if (c == '>') state = INBE;
+                        else if (c == '<') state = INLE;
+                        else if (c == ' ' || c == '\t' || c == '\r' || c == '\n') saveTokenString = false;
+                        else if (c == '{') {
+                            saveTokenString = false;
+                            state = INCOMMENT;
+                        } else if (c == '\'') {
+                            saveTokenString = false;
+                            state = INSTR;
+                        } else {
+                            state = DONE;
+                            switch (c) {
+                                case EOF:
+                                    saveTokenString = false;
+                                    currentToken = END_FILE;
+                                    break;
+                                case '=':
+                                    currentToken = EQ;
+                                    break;
+                                case '+':
+                                    currentToken = PLUS;
+                                    break;
+                                case '-':
+                                    currentToken = MINUS;
+                                    break;
+                                case '*':
+                                    currentToken = TIMES;
+                                    break;
+                                case '/':
+                                    currentToken = OVER;
+                                    break;
+                                case '%':
+                                    currentToken = MOD;
+                                    break;
+                                case '(':
+                                    currentToken = LPAREN;
+                                    break;
+                                case ')':
+                                    currentToken = RPAREN;
+                                    break;
+                                case ';':
+                                    currentToken = SEMI;
+                                    break;
+                                case ',':
+                                    currentToken = COMMA;
+                                    break;
+                                default:
+                                    currentToken = ERROR;
+                                    break;
+                            }
+                        }
+                        break;
+                    case INCOMMENT:
+                        saveTokenString = false;
+                        if (c == '}') {
+                            state = START;
+                        } else if (c == EOF) {
+                            state = DONE;
+                            currentToken = END_FILE;
+                            error("Comment match error on : LineNumber " + std::to_string(lineNumber));
+                        }
+                        break;
+                    case INSTR:
+                        if (c == '\'') {
+                            saveTokenString = false;
+                            state = DONE;
+                            currentToken = STR;
+                        } else if (c == EOF || c == '\n') {
+                            saveTokenString = false;
+                            state = DONE;
+                            currentToken = c == EOF ? END_FILE : ERROR;
+                            error("String match error on : LineNumber " + std::to_string(lineNumber));
+                        }
+                        break;
+                    case IN_DECIMAL:
+                        if (!isdigit(c)) {
+                            if (c == '.') state = IN_FLOAT;
+                            else {
+                                undoGetNextChar();
+                                saveTokenString = false;
+                                state = DONE;
+                                currentToken = NUM;
+                            }
+                        }
+                        break;
+                    case IN_FLOAT:
+                        if (!isdigit(c)) {
+                            if (tokenString == ".") {
+                                undoGetNextChar();
+                                saveTokenString = false;
+                                currentToken = ERROR;
+                            } else {
+                                if (c != 'f' && c != 'F') {
+                                    undoGetNextChar();
+                                    saveTokenString = false;
+                                }
+                                currentToken = NUM;
+                            }
+                            state = DONE;
+                        }
+                        break;
+                    case IN_OCT:
+                        if (!(c >= '0' && c <= '7')) {
+                            if ((c == 'x' || c == 'X') && tokenString == "0") {
+                                state = IN_HEX;
+                            } else if (c == '.') {
+                                state = IN_FLOAT;
+                            } else {
+                                undoGetNextChar();
+                                saveTokenString = false;
+                                state = DONE;
+                                currentToken = NUM;
+                            }
+                        }
+                        break;
+                    case IN_HEX:
+                        if (!(isdigit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'))) {
+                            currentToken = tokenString == "0x" || tokenString == "0X" ? ERROR : NUM;
+                            undoGetNextChar();
+                            saveTokenString = false;
+                            state = DONE;
+                        }
+                        break;
+                    case INID:
+                        if (!isalpha(c) && !isdigit(c)) {
+                            undoGetNextChar();
+                            saveTokenString = false;
+                            state = DONE;
+                            currentToken = ID;
+                        }
+                        break;
+                    case INASSIGN:
+                    case INNE:
+                    case INBE:
+                    case INLE:
+                        if (c == '=') {
+                            currentToken = state == INASSIGN ? ASSIGN : state == INNE ? NE : state == INBE ? BE : LE;
+                        } else {
+                            undoGetNextChar();
+                            saveTokenString = false;
+                            currentToken = state == INBE ? BT : state == INLE ? LT : ERROR;
+                        }
+                        state = DONE;
+                        break;
+                    case DONE:
+                        break;
+                }
+                if (saveTokenString) tokenString += (char_t) c;
+                if (state == DONE && currentToken == ID) {
+                    auto key = keyWordTable.find(tokenString);
+                    if (key != keyWordTable.end()) currentToken = key->second;
+                }
+            }
+            std::shared_ptr<string_t> text;
+            if (currentToken == ID || currentToken == NUM || currentToken == STR || currentToken == ERROR) {
+                text = std::make_shared<string_t>(tokenString);
+            }
+            return {currentToken, text};
+        }
+
+    private:
+        enum State {
+            START, INCOMMENT, INSTR, INID, INASSIGN, INNE, INBE, INLE, IN_DECIMAL, IN_OCT, IN_HEX, IN_FLOAT, DONE
+        };
+
+        static constexpr int LINE_BUFFER_SIZE = 4096;
+
+        FILE *file;
+        char_t buffer[LINE_BUFFER_SIZE]{};
+        int bufSize = 0;
+        int lineNumber = 0;
+        int pos = 0;
+        bool eof = false;
+
+        void error(const string_t &) {
+            errors++;
+        }
+
+        int getNextChar() {
+            if (pos >= bufSize) {
+                lineNumber++;
+                if (fgets(buffer, LINE_BUFFER_SIZE - 1, file)) {
+                    bufSize = (int) strlen(buffer);
+                    pos = 0;
+                    return buffer[pos++];
+                }
+                eof = true;
+                return EOF;
+            }
+            return buffer[pos++];
+        }
+
+        void undoGetNextChar() {
+            if (!eof) pos--;
+        }
+
+        static std::map<string_t, TokenType> getKeyWordTable() {
+            static std::map<string_t, TokenType> table{
+                    {"if",     IF}, {"then", THEN}, {"else", ELSE}, {"end", END}, {"repeat", REPEAT},
+                    {"until",  UNTIL}, {"do", DO}, {"while", WHILE}, {"read", READ}, {"write", WRITE},
+                    {"true",   TRUE}, {"false", FALSE}, {"or", OR}, {"and", AND}, {"not", NOT},
+                    {"int",    INT}, {"bool", BOOL}, {"float", FLOAT}, {"double", DOUBLE}, {"string", STRING}};
+            return table;
+        }
+
+        static std::unordered_set<char_t> getLegalCharTable() {
+            static std::unordered_set<char_t> table = [] {
+                std::unordered_set<char_t> legal{'+', '-', '*', '/', '%', '(', ')', '{', '}', '>', '<', '=', '!',
+                                                 ':', ',', '\'', ';', '.', '\r', '\n', '\t', ' ', (char_t) EOF};
+                for (char_t c = 'a'; c <= 'z'; c++) legal.insert(c);
+                for (char_t c = 'A'; c <= 'Z'; c++) legal.insert(c);
+                for (char_t c = '0'; c <= '9'; c++) legal.insert(c);
+                return legal;
+            }();
+            return table;
+        }
+    };
+}
+
+#endif //COMPILER_REFERENCELEXER_H
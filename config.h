@@ -5,11 +5,13 @@
 #ifndef SCANNER_CONFIG_H
 #define SCANNER_CONFIG_H
 
-#define LINE_BUFFER_SIZE 256 // 文件一行最大字符数量
+#define STREAM_BLOCK_SIZE (1 << 20) // 流式读取(管道/标准输入)时每个缓冲块的大小
+#define SIMD_SCAN true // Scanner 跳过空白/注释/字符串时使用 SSE2/AVX2 快速路径, false 时使用标量实现
+#define PARALLEL_LEX_MIN_CHUNK (1 << 16) // 并行扫描时每一块至少这么大
+#define PIPELINE_BATCH_SIZE 4096 // 流水线模式扫描线程每一批的Token数量
+#define PIPELINE_RING_SIZE 8 // 流水线模式环形缓冲的批数(2的幂), 扫描线程最多领先语法分析这么多批
 #define ECHO_SOURCE false
-#define TRACE_SCANNER false
-#define TRACE_PARSER true
-#define TRACE_ANALYSER true
+#define DUMP_BUFFER_SIZE (1 << 20) // --dump-* 输出缓冲的大小
 #define OUTPUT_STREAM stdout
 
 #endif //SCANNER_CONFIG_H
@@ -3,5 +3,5 @@
 using namespace std;
 
 auto main(int argc, char *argv[]) -> int {
-    Compiler::compile(argc, argv);
+    return Compiler::compile(argc, argv);
 }
\ No newline at end of file
@@ -0,0 +1,51 @@
+//
+// Created by junior on 19-6-13.
+//
+/**
+ * 语义分析的回归测试, 每个用例在指针形式和扁平形式(--flat-ast)下都检查一次.
+ */
+
+#include "TestUtil.h"
+
+using namespace Compiler;
+
+int main() {
+    Test::Checker checker;
+    for (bool flat : {false, true}) {
+        Options options;
+        options.flatAst = flat;
+        auto mode = std::string(flat ? " (--flat-ast)" : "");
+
+        // 循环条件可以使用循环体里声明的变量
+        auto result = Test::compileSource("repeat int k := 1; write k until k < 0", options);
+        checker.expect(result.success, "repeat condition sees body locals" + mode, result.diagnostics);
+        result = Test::compileSource("do int k := 1; write k while k > 1", options);
+        checker.expect(result.success, "do-while condition sees body locals" + mode, result.diagnostics);
+        result = Test::compileSource("int k := 5; repeat bool k := true; write k until k; k := k + 1", options);
+        checker.expect(result.success, "repeat condition sees the shadowing local" + mode, result.diagnostics);
+
+        // 循环结束以后循环体里的变量不再可见
+        result = Test::compileSource("repeat int k := 1 until k < 0; write k", options);
+        checker.expect(!result.success && result.diagnostics.find("Symbol k not declaration") != std::string::npos,
+                       "body locals end with the loop" + mode, result.diagnostics);
+
+        // --hash-cons 不改变 --dump-symbols 的输出, 共享的标识符每次出现都要记下行号
+        for (auto source : {"int a := 1;\nwrite a + 1;\nwrite a + 1",
+                            "int k := 0;\nrepeat int k := 1;\nwrite k + 1\nuntil k + 1 > 0;\nwrite k + 1"}) {
+            auto dump = options;
+            dump.dumpSymbols = true;
+            auto expected = Test::compileSource(source, dump);
+            dump.shareExpressions = true;
+            checker.same(expected, Test::compileSource(source, dump), "--hash-cons keeps every appearance" + mode);
+        }
+
+        // --check-threads N 的诊断信息和单线程相同: 有符号错误时只报告符号错误
+        for (auto source : {"int a := 1; write b; a := true", "int a := 1; a := true; write a"}) {
+            auto expected = Test::compileSource(source, options);
+            auto threads = options;
+            threads.checkThreads = 4;
+            checker.same(expected, Test::compileSource(source, threads), "--check-threads matches serial" + mode);
+        }
+    }
+    return checker.finish();
+}
@@ -0,0 +1,91 @@
+//
+// Created by junior on 19-6-13.
+//
+/**
+ * 差分测试: --lex-threads N 并行扫描, --pipeline 流水线扫描和逐个扫描的Token(--dump-tokens)和诊断信息必须完全相同.
+ * 输入是随机的字节串(没有结束的注释和字符串, 非法字节, CRLF...)和大的随机程序, 都足够大,
+ * 每个线程至少分到 PARALLEL_LEX_MIN_CHUNK, 所以每个 N 都真的切成了 N 块, 块的边界落在各种状态中间.
+ * 超过 STREAM_BLOCK_SIZE 的输入再从标准输入(管道, 按块读取)编译一次, 结果必须和映射整个文件时相同.
+ */
+
+#include "TestUtil.h"
+#include "ProgramGenerator.h"
+#include <thread>
+#include <unistd.h>
+
+using namespace Compiler;
+
+// 把 text 写进管道作为标准输入编译("-"), 和命令行 `compiler - < file` 一样按块读取
+Test::Result compileStdin(const std::string &text, const Options &options) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        perror("pipe");
+        exit(2);
+    }
+    int saved = dup(STDIN_FILENO);
+    dup2(fds[0], STDIN_FILENO);
+    close(fds[0]);
+    std::thread writer([&text, fd = fds[1]] {
+        for (size_t written = 0; written < text.size();) {
+            auto n = write(fd, text.data() + written, text.size() - written);
+            if (n <= 0) break;
+            written += (size_t) n;
+        }
+        close(fd);
+    });
+    auto result = Test::compileFile("-", options);
+    writer.join();
+    dup2(saved, STDIN_FILENO);
+    close(saved);
+    return result;
+}
+
+int main() {
+    Test::Checker checker;
+    std::vector<std::pair<std::string, std::string>> inputs;
+    // 空文件和没有语句的文件: 语法分析在 END_FILE 上报错以后还会再读, EOF 也只能打印一次
+    inputs.emplace_back("empty", "");
+    inputs.emplace_back("comment only", "{ nothing }\n");
+    for (unsigned seed = 1; seed <= 12; seed++) {
+        Test::ProgramGenerator generator(seed);
+        inputs.emplace_back("noise " + std::to_string(seed), generator.noise(PARALLEL_LEX_MIN_CHUNK * (seed % 4 + 2)));
+    }
+    for (unsigned seed = 1; seed <= 4; seed++) {
+        inputs.emplace_back("bulk " + std::to_string(seed), Test::ProgramGenerator(seed).bulk(PARALLEL_LEX_MIN_CHUNK * 9));
+    }
+    // 跨越几个流式读取块的输入, 编码错误分布在每一块里.
+    // 最后一个输入在两个块的边界上各有一个被截断的字符(一个不完整, 一个合法)
+    for (unsigned seed = 1; seed <= 2; seed++) {
+        inputs.emplace_back("stream noise " + std::to_string(seed),
+                            Test::ProgramGenerator(seed).noise(STREAM_BLOCK_SIZE * 5 / 2));
+    }
+    std::string straddle = Test::ProgramGenerator(3).bulk(STREAM_BLOCK_SIZE * 5 / 2);
+    straddle.replace(STREAM_BLOCK_SIZE / 2, 1, "\xff");
+    straddle.replace(STREAM_BLOCK_SIZE - 2, 4, "{\xe2\x82}");
+    straddle.replace(STREAM_BLOCK_SIZE * 2 - 1, 2, "\xc3\xa9");
+    inputs.emplace_back("stream bulk", straddle);
+
+    for (auto &[name, source] : inputs) {
+        Test::writeFile("lexer_diff.tny", source);
+        Options serial;
+        serial.dumpTokens = true;
+        auto expected = Test::compileFile("lexer_diff.tny", serial);
+        for (unsigned threads : {1u, 2u, 3u, 4u, 8u, 16u}) {
+            Options parallel = serial;
+            parallel.batchLex = true;
+            parallel.lexThreads = threads;
+            checker.same(expected, Test::compileFile("lexer_diff.tny", parallel),
+                         name + " (" + std::to_string(source.size()) + " bytes) --lex-threads " +
+                         std::to_string(threads));
+        }
+        Options pipeline = serial;
+        pipeline.pipelineLex = true;
+        checker.same(expected, Test::compileFile("lexer_diff.tny", pipeline), name + " --pipeline");
+        if (source.size() > STREAM_BLOCK_SIZE) {
+            checker.same(expected, compileStdin(source, serial), name + " stdin");
+            checker.same(expected, compileStdin(source, pipeline), name + " stdin --pipeline");
+        }
+    }
+    remove("lexer_diff.tny");
+    return checker.finish();
+}
@@ -0,0 +1,183 @@
+//
+// Created by junior on 19-6-13.
+//
+/**
+ * 优化的回归测试, 每个用例在指针形式和扁平形式(--flat-ast)下都检查一次.
+ * 常量折叠直接调用 libcompiler 做到 optimize() 为止, 检查最后一条 write 的表达式折叠成的常量节点和诊断信息;
+ * 死代码消除通过 --opt-stats 的输出检查删掉的节点数.
+ */
+
+#include "TestUtil.h"
+#include "Analyser.h"
+#include "Optimizer.h"
+
+using namespace Compiler;
+using namespace Compiler::Parser;
+
+// 常量节点写成 "类型 值" 的形式, 不是常量时为空
+std::string describe(ExpKind kind, int_t integer, float_t real, double_t real64, bool_t boolean) {
+    char text[64];
+    switch (kind) {
+        case ExpKind::ConstIntK:
+            return "int " + std::to_string(integer);
+        case ExpKind::ConstFloatK:
+            snprintf(text, sizeof(text), "float %.9g", (double) real);
+            return text;
+        case ExpKind::ConstDoubleK:
+            snprintf(text, sizeof(text), "double %.17g", real64);
+            return text;
+        case ExpKind::ConstBoolK:
+            return std::string("bool ") + (boolean == BOOL::TRUE ? "true" : "false");
+        default:
+            return "";
+    }
+}
+
+std::string describe(const TreeNode &n) {
+    if (n.stmt_or_exp != StmtOrExp::ExpK) return "";
+    auto kind = std::get<ExpKind>(n.kind);
+    return describe(kind, kind == ExpKind::ConstIntK ? std::get<int_t>(n.attribute) : 0,
+                    kind == ExpKind::ConstFloatK ? std::get<float_t>(n.attribute) : 0,
+                    kind == ExpKind::ConstDoubleK ? std::get<double_t>(n.attribute) : 0,
+                    kind == ExpKind::ConstBoolK ? std::get<bool_t>(n.attribute) : BOOL::FALSE);
+}
+
+std::string describe(const FlatTree &tree, const FlatNode &n) {
+    if (n.isStatement()) return "";
+    auto kind = n.expKind();
+    return describe(kind, kind == ExpKind::ConstIntK ? tree.integer(n) : 0,
+                    kind == ExpKind::ConstFloatK ? tree.real(n) : 0,
+                    kind == ExpKind::ConstDoubleK ? tree.real64(n) : 0,
+                    kind == ExpKind::ConstBoolK ? tree.boolean(n) : BOOL::FALSE);
+}
+
+struct Folded {
+    std::string constant;    // 最后一条 write 的表达式折叠成的常量
+    std::string diagnostics;
+};
+
+// 和 CompilerContext::compile 一样扫描, 语法分析, 语义分析, 然后只做优化
+Folded fold(const std::string &text, bool flat) {
+    Test::writeFile("optimizer_test.tny", text);
+    FileUtil::SourceFile source;
+    FileUtil::openFile("optimizer_test.tny", source);
+    Folded result;
+    {
+        CompilerContext context;
+        CompilerContext::Bind bind(context);
+        context.file = &source;
+        Scanner::TokenBuffer buffer;
+        Scanner::tokenize(buffer);
+        auto root = parse(buffer);
+        if (!context.diagnostics.hasException() && flat) {
+            auto tree = flatten(root);
+            clearAll();
+            Analyser::analyse(tree);
+            if (!context.diagnostics.hasException()) Optimizer::optimize(tree);
+            auto last = tree.root;
+            while (last != FlatTree::NONE && tree.nodes[last].sibling != FlatTree::NONE) last = tree.nodes[last].sibling;
+            if (last != FlatTree::NONE) result.constant = describe(tree, tree.nodes[tree.child(tree.nodes[last], 0)]);
+        } else if (!context.diagnostics.hasException()) {
+            Analyser::analyse(root);
+            if (!context.diagnostics.hasException()) Optimizer::optimize(root);
+            auto last = root;
+            while (last != nullptr && last->sibling != nullptr) last = last->sibling;
+            if (last != nullptr) result.constant = describe(*last->children.at(0));
+        }
+        std::ostringstream diagnostics;
+        diagnostics << context.diagnostics;
+        result.diagnostics = diagnostics.str();
+        Scanner::clearAll();
+        clearAll();
+    }
+    FileUtil::closeFile(source);
+    remove("optimizer_test.tny");
+    return result;
+}
+
+int main() {
+    Test::Checker checker;
+    for (bool flat : {false, true}) {
+        auto mode = std::string(flat ? " (--flat-ast)" : "");
+        auto expectConstant = [&checker, flat, &mode](const std::string &source, const std::string &constant,
+                                                      const std::string &name) {
+            auto result = fold(source, flat);
+            checker.expect(result.constant == constant && result.diagnostics.find("ERROR") == std::string::npos,
+                           name + mode, "expected '" + constant + "', got '" + result.constant + "'\n" +
+                                        result.diagnostics);
+        };
+        auto expectError = [&checker, flat, &mode](const std::string &source, const std::string &message,
+                                                   const std::string &name) {
+            auto result = fold(source, flat);
+            checker.expect(result.diagnostics.find(message) != std::string::npos, name + mode,
+                           "expected '" + message + "', got:\n" + result.diagnostics);
+        };
+
+        // int 按32位补码回绕, INT_MIN / -1 和 INT_MIN % -1 也不例外
+        expectConstant("write 2147483647 + 1", "int -2147483648", "int addition wraps");
+        expectConstant("write 65536 * 65536", "int 0", "int multiplication wraps");
+        expectConstant("write 0 - 2147483647 - 2", "int 2147483647", "int subtraction wraps");
+        expectConstant("write (0 - 2147483647 - 1) / (0 - 1)", "int -2147483648", "INT_MIN / -1");
+        expectConstant("write (0 - 2147483647 - 1) % (0 - 1)", "int 0", "INT_MIN % -1");
+        expectConstant("write 7 / 2", "int 3", "int division truncates");
+
+        // int 和 float/double 混合运算先把操作数转换成结果类型: 16777217 转成 float 就是 16777216
+        expectConstant("write 16777217 + 0.0f", "float 16777216", "int widens to float");
+        expectConstant("write 16777217 + 0.0", "double 16777217", "int widens to double");
+        expectConstant("write 16777217 + 0.0f + 0.0", "double 16777216", "float result widens to double");
+        expectConstant("write 7 / 2.0f", "float 3.5", "int over float");
+        expectConstant("write 0.1f + 0.2", "double 0.30000000149011613", "float widens to double");
+
+        // 浮点数的模运算是 fmod, 结果的符号和被除数相同
+        expectConstant("write 7.5 % 2", "double 1.5", "double fmod");
+        expectConstant("write (0 - 7.5) % 2", "double -1.5", "fmod keeps the dividend's sign");
+        expectConstant("write 5.5f % 2", "float 1.5", "float fmod");
+
+        // 比较运算在两个操作数做算术运算时的类型上进行
+        expectConstant("write 16777217 = 16777216.0f", "bool true", "int = float compares as float");
+        expectConstant("write 16777217 = 16777216.0", "bool false", "int = double compares as double");
+        expectConstant("write 16777217 > 16777216.0f", "bool false", "int > float compares as float");
+        expectConstant("write 1 < 1.5f", "bool true", "int < float");
+        expectConstant("write 2147483647 + 1 < 0", "bool true", "comparison sees the wrapped int");
+        expectConstant("write 1 < 2 and not (2.5 <= 2)", "bool true", "logical operators fold");
+
+        // 除数是常量 0 时报错, 不管被除数是不是常量, 也不管 0 是字面量还是折叠出来的
+        expectError("int a := 1;\nwrite a / 0", "division by constant zero on line 2", "literal zero divisor");
+        expectError("int a := 1;\n\nwrite a % (2 - 2)", "division by constant zero on line 3",
+                    "folded zero divisor");
+        expectError("write 1 / (0.5 - 0.5)", "division by constant zero on line 1", "folded double zero divisor");
+        expectConstant("int a := 1;\nwrite a / (2 - 1)", "", "non-constant dividend is not folded");
+    }
+
+    auto expectRemoved = [&checker](const std::string &source, const Options &options, const std::string &removed,
+                                    const std::string &name) {
+        auto result = Test::compileSource(source, options);
+        checker.expect(result.success && result.output.find(removed) != std::string::npos, name,
+                       "expected '" + removed + "', got:\n" + result.output + result.diagnostics);
+    };
+    for (bool flat : {false, true}) {
+        Options options;
+        options.optimizerStatistics = true;
+        options.flatAst = flat;
+        auto mode = std::string(flat ? " (--flat-ast)" : "");
+
+        // 常量条件的 if, 留下的分支有声明(保留 if 和它的作用域)时, 不执行的分支也要删掉
+        expectRemoved("if true then int y := 1; write y else write 5 end", options,
+                      "dead code elimination removed 2 nodes", "constant-true if drops its else branch" + mode);
+        expectRemoved("if false then write 1 else int x := 2; write x end", options,
+                      "dead code elimination removed 2 nodes", "constant-false if drops its then branch" + mode);
+        expectRemoved("if false then write 1; write 2 + 3 else int x := 2; write x end", options,
+                      "dead code elimination removed 4 nodes", "constant-false if drops a whole then chain" + mode);
+
+        // --hash-cons 时共享的子树只算一次, 还被别处用到的节点(常量 1, write 的 a * 2 + 1)不算删掉
+        auto shared = options;
+        shared.shareExpressions = true;
+        expectRemoved("int a := 1; if false then write a + 1; write a + 1 else int x := 2; write x end", shared,
+                      "dead code elimination removed 7 nodes", "shared subtrees are counted once" + mode);
+        expectRemoved("int a := 1; int b := a * 2 + 1; write a * 2 + 1", options,
+                      "dead code elimination removed 7 nodes", "dead declaration" + mode);
+        expectRemoved("int a := 1; int b := a * 2 + 1; write a * 2 + 1", shared,
+                      "dead code elimination removed 2 nodes", "shared subtrees still in use are kept" + mode);
+    }
+    return checker.finish();
+}
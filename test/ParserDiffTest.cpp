@@ -0,0 +1,44 @@
+//
+// Created by junior on 19-6-13.
+//
+/**
+ * 差分测试: --ll1 表驱动分析器和递归下降分析器.
+ * 随机生成的正确程序: 语法树(--dump-ast)和诊断信息必须完全相同;
+ * 随机删改几个Token以后的程序: 两个分析器必须同时成功或者同时失败, 递归下降没有报语法错误时, 语法树和诊断信息也必须相同.
+ * (两个分析器在第一个语法错误之后的恢复方式不同, 错误信息不要求一致)
+ */
+
+#include "TestUtil.h"
+#include "ProgramGenerator.h"
+
+using namespace Compiler;
+
+int main() {
+    Test::Checker checker;
+    Options descent;
+    descent.dumpAst = true;
+    Options table = descent;
+    table.tableParser = true;
+
+    for (unsigned seed = 1; seed <= 200; seed++) {
+        Test::ProgramGenerator generator(seed);
+        auto program = generator.program((int) seed % 40 + 5);
+        auto name = "program " + std::to_string(seed);
+        auto expected = Test::compileSource(program, descent);
+        checker.expect(expected.success, name + " compiles", expected.diagnostics);
+        checker.same(expected, Test::compileSource(program, table), name + " --ll1");
+
+        for (int i = 0; i < 2; i++) {
+            auto mutated = generator.mutate(program);
+            auto mutatedName = name + " mutation " + std::to_string(i);
+            expected = Test::compileSource(mutated, descent);
+            auto actual = Test::compileSource(mutated, table);
+            if (expected.diagnostics.find("SYNTAX_ERROR") == std::string::npos) {
+                checker.same(expected, actual, mutatedName + " --ll1");
+            } else {
+                checker.expect(!actual.success, mutatedName + " --ll1 rejects it", mutated);
+            }
+        }
+    }
+    return checker.finish();
+}
@@ -0,0 +1,303 @@
+//
+// Created by junior on 19-6-13.
+//
+/**
+ * 测试和性能测试用的源码生成器, 同一个种子总是生成同样的内容:
+ *  program(): 类型正确的程序(变量先声明后使用, 有嵌套的 if/repeat/do 和块作用域), 可以完整地编译成功;
+ *  mutate():  在程序的Token序列上随机删除/插入/替换几个Token, 大多会产生语法错误;
+ *  noise():   由容易出错的片段拼成的字节串(没有结束的注释和字符串, 非法字节, CRLF, 各种进制的数值),
+ *             用来比较不同的扫描方式;
+ *  bulk():    指定大小的大文件(只用 double 变量的声明, 赋值, if, repeat, 跨行注释和字符串), 用于性能测试.
+ */
+
+#ifndef COMPILER_PROGRAMGENERATOR_H
+#define COMPILER_PROGRAMGENERATOR_H
+
+#include <random>
+#include <string>
+#include <vector>
+#include <map>
+#include <regex>
+
+namespace Compiler::Test {
+    class ProgramGenerator {
+    public:
+        explicit ProgramGenerator(unsigned seed) : random(seed) {}
+
+        std::string program(int statements) {
+            scopes.assign(1, {});
+            counter = 0;
+            return sequence(statements, 3);
+        }
+
+        std::string mutate(const std::string &source) {
+            static const std::regex tokenPattern(R"('[^']*'|:=|<=|>=|!=|\d+\.\d*[fF]?|\w+|\S)");
+            static const char *replacements[] = {"+", "-", "*", "/", "%", "<", "<=", ">", ">=", "=", "!=", "and", "or",
+                                                 "not", "(", ")", ";", "then", "end", ":=", "1", "x"};
+            std::vector<std::string> tokens;
+            for (std::sregex_iterator it(source.begin(), source.end(), tokenPattern), end; it != end; ++it) {
+                tokens.push_back(it->str());
+            }
+            for (int n = between(1, 4); n > 0 && !tokens.empty(); n--) {
+                auto i = (size_t) between(0, (int) tokens.size() - 1);
+                auto k = chance();
+                if (k < 0.33) tokens.erase(tokens.begin() + (long) i);
+                else if (k < 0.66) tokens.insert(tokens.begin() + (long) i, pick(replacements));
+                else tokens[i] = pick(replacements);
+            }
+            std::string result;
+            for (auto &token:tokens) result += token + ' ';
+            return result;
+        }
+
+        std::string noise(size_t size) {
+            static const char *pieces[] = {"{", "}", "'", "\n", "\r\n", "  ", "\t", "x", "abc", "0x1f", "017", ".5f",
+                                           "1.", ".", "0x", ":=", "!=", ">=", "<", "$", "\xc3\xa9", "\xff", "then",
+                                           "{aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa\n\n\n}",
+                                           "'ssssssssssssssssssssssssssssssssssssssssssssssssss'",
+                                           "                                     ", "\n\n\n\n\n\n\n\n\n\n", "%",
+                                           "12345", "@", ";", "99999999999", "1e5"};
+            std::string result;
+            while (result.size() < size) result += pick(pieces);
+            return result;
+        }
+
+        std::string bulk(size_t size) {
+            static const char *ops[] = {"+", "-", "*", "/", "%"};
+            std::vector<std::string> names;
+            std::string result;
+            auto number = [&]() {
+                auto k = chance();
+                if (k < 0.4) return std::to_string(between(0, 99999));
+                if (k < 0.55) return "0x" + hex(between(0, 9999));
+                if (k < 0.65) return "0" + octal(between(1, 999));
+                if (k < 0.85) return std::to_string(between(0, 999)) + "." + std::to_string(between(0, 999));
+                return std::to_string(between(0, 99)) + "." + std::to_string(between(0, 99)) + "f";
+            };
+            std::function<std::string(int)> expression = [&](int depth) -> std::string {
+                if (depth > 2 || chance() < 0.3) {
+                    return !names.empty() && chance() < 0.6 ? pick(names) : number();
+                }
+                auto e = expression(depth + 1) + " " + pick(ops) + " " + expression(depth + 1);
+                return chance() < 0.3 ? "(" + e + ")" : e;
+            };
+            for (int i = 0; result.size() < size; i++) {
+                auto k = chance();
+                std::string statement;
+                if (k < 0.3 || names.empty()) {
+                    statement = "double ";
+                    for (int j = 0, n = between(1, 4); j < n; j++) {
+                        auto name = "v" + std::to_string(i) + "x" + std::to_string(j);
+                        statement += (j > 0 ? ", " : "") + name + (chance() < 0.7 ? " := " + expression(0) : "");
+                        names.push_back(name);
+                    }
+                } else if (k < 0.5) {
+                    statement = pick(names) + " := " + expression(0);
+                } else if (k < 0.6) {
+                    statement = "{ comment " + std::to_string(i) + "\n   spanning lines } write " + expression(0);
+                } else if (k < 0.7) {
+                    statement = "string s" + std::to_string(i) + " := 'str literal " + std::to_string(i) + " here'";
+                } else if (k < 0.8) {
+                    statement = "if " + expression(0) + " > " + expression(0) + " and not (" + expression(0) +
+                                " = 1) then " + pick(names) + " := " + expression(0) + " else write " + expression(0) +
+                                " end";
+                } else if (k < 0.9) {
+                    auto name = pick(names);
+                    statement = "repeat " + name + " := " + name + " - 1 until " + name + " <= 0";
+                } else {
+                    statement = "read " + pick(names);
+                }
+                result += (i > 0 ? ";\n" : "") + statement;
+            }
+            return result + "\n";
+        }
+
+    private:
+        std::mt19937 random;
+        std::vector<std::map<std::string, std::string>> scopes; // 每层作用域: 名字 => 类型
+        int counter = 0;
+
+        double chance() { return std::uniform_real_distribution<double>(0, 1)(random); }
+
+        int between(int low, int high) { return std::uniform_int_distribution<int>(low, high)(random); }
+
+        template<typename T, size_t N>
+        std::string pick(T (&items)[N]) { return items[(size_t) between(0, (int) N - 1)]; }
+
+        std::string pick(const std::vector<std::string> &items) {
+            return items[(size_t) between(0, (int) items.size() - 1)];
+        }
+
+        static std::string hex(int value) {
+            char text[16];
+            snprintf(text, sizeof(text), "%X", value);
+            return text;
+        }
+
+        static std::string octal(int value) {
+            char text[16];
+            snprintf(text, sizeof(text), "%o", value);
+            return text;
+        }
+
+        // 当前可见的, 类型是 type 的变量(type 为空时不限类型)
+        std::vector<std::string> visible(const std::string &type = "") const {
+            std::map<std::string, std::string> seen;
+            for (auto &scope:scopes) {
+                for (auto &[name, t]:scope) seen[name] = t;
+            }
+            std::vector<std::string> names;
+            for (auto &[name, t]:seen) {
+                if (type.empty() || t == type) names.push_back(name);
+            }
+            return names;
+        }
+
+        std::string typeOf(const std::string &name) const {
+            for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope) {
+                auto found = scope->find(name);
+                if (found != scope->end()) return found->second;
+            }
+            return "";
+        }
+
+        std::string literal(const std::string &type) {
+            static const char *ints[] = {"0", "1", "2", "3", "5", "7", "10", "42", "100", "1000"};
+            static const char *floats[] = {"0.5f", "1.5f", "2.0f", "3.25f", "10.0f"};
+            static const char *doubles[] = {"0.25", "1.0", "2.5", "3.75", "100.0"};
+            static const char *bools[] = {"true", "false"};
+            static const char *strings[] = {"'a'", "'bc'", "''"};
+            if (type == "int") return pick(ints);
+            if (type == "float") return pick(floats);
+            if (type == "double") return pick(doubles);
+            if (type == "bool") return pick(bools);
+            return pick(strings);
+        }
+
+        static int rank(const std::string &type) {
+            return type == "int" ? 0 : type == "float" ? 1 : 2;
+        }
+
+        std::string numeric() {
+            static const char *types[] = {"int", "float", "double"};
+            return pick(types);
+        }
+
+        std::string expression(const std::string &type, int depth) {
+            static const char *comparisons[] = {"<", ">", "<=", ">=", "=", "!="};
+            static const char *logical[] = {"and", "or"};
+            static const char *arithmetic[] = {"+", "-", "*", "/", "%"};
+            static const char *divisors[] = {"2", "3", "7"};
+            auto names = visible(type);
+            if (depth <= 0 || chance() < 0.3) {
+                if (!names.empty() && chance() < 0.6) return pick(names);
+                return literal(type);
+            }
+            if (type == "string") return !names.empty() ? pick(names) : literal(type);
+            if (type == "bool") {
+                auto k = chance();
+                if (k < 0.15) return "not (" + expression("bool", depth - 1) + ")";
+                if (k < 0.45) {
+                    return "(" + expression("bool", depth - 1) + " " + pick(logical) + " " +
+                           expression("bool", depth - 1) + ")";
+                }
+                return "(" + expression(numeric(), depth - 1) + " " + pick(comparisons) + " " +
+                       expression(numeric(), depth - 1) + ")";
+            }
+            // 两个操作数中较宽的类型就是 type
+            std::string a = type, b = type;
+            do b = numeric(); while (rank(b) > rank(type));
+            if (chance() < 0.5) std::swap(a, b);
+            std::string op = pick(arithmetic);
+            if (op == "/" || op == "%") {
+                return "(" + expression(a, depth - 1) + " " + op + " " + (b == "int" ? pick(divisors) : literal(b)) +
+                       ")";
+            }
+            return "(" + expression(a, depth - 1) + " " + op + " " + expression(b, depth - 1) + ")";
+        }
+
+        // 可以赋给 type 类型变量的表达式类型
+        std::string assignable(const std::string &type) {
+            return rank(type) <= 2 && type != "bool" && type != "string" ? numeric() : type;
+        }
+
+        std::string condition() {
+            static const char *constants[] = {"true", "false", "(1 < 2)", "(2.5 > 3)", "not true", "(true and false)",
+                                              "(1 = 1)"};
+            return chance() < 0.35 ? pick(constants) : expression("bool", 2);
+        }
+
+        std::string fresh() {
+            counter++;
+            if (chance() < 0.3) { // 遮盖外层的同名变量. 循环计数器(c*)不遮盖, 循环条件能看到循环体里的声明
+                std::vector<std::string> outer;
+                for (auto &name:visible()) {
+                    if (scopes.back().count(name) == 0 && name[0] != 'c') outer.push_back(name);
+                }
+                if (!outer.empty()) return pick(outer);
+            }
+            return "v" + std::to_string(counter);
+        }
+
+        std::string block(int statements, int depth) {
+            scopes.emplace_back();
+            auto body = sequence(statements, depth);
+            scopes.pop_back();
+            return body;
+        }
+
+        std::string statement(int depth) {
+            static const char *types[] = {"int", "float", "double", "bool", "string"};
+            static const char *repeatExits[] = {"true", "(1 < 2)", "not false"};
+            static const char *whileExits[] = {"false", "(2 < 1)", "not true"};
+            auto k = chance();
+            if (k < 0.25) {
+                // 一条声明里的所有变量在它的初始值里就已经可见(和 Analyser 一致), 所以先声明再生成初始值
+                std::string type = pick(types), text = type + " ";
+                std::vector<std::string> declared;
+                for (int i = 0, n = between(1, 3); i < n; i++) {
+                    auto name = fresh();
+                    while (scopes.back().count(name) != 0) name = "w" + std::to_string(between(0, 1000000));
+                    scopes.back()[name] = type;
+                    declared.push_back(name);
+                }
+                for (size_t i = 0; i < declared.size(); i++) {
+                    text += (i > 0 ? ", " : "") + declared[i];
+                    if (chance() < 0.6) text += " := " + expression(assignable(type), 2);
+                }
+                return text;
+            }
+            auto names = visible();
+            if (k < 0.45 && !names.empty()) {
+                auto name = pick(names);
+                return name + " := " + expression(assignable(typeOf(name)), 2);
+            }
+            if (k < 0.5 && !names.empty()) return "read " + pick(names);
+            if (k < 0.65) return "write " + expression(pick(types), 2);
+            if (depth <= 0) return "write " + literal("int");
+            if (k < 0.8) {
+                auto text = "if " + condition() + " then " + block(between(1, 4), depth - 1);
+                if (chance() < 0.5) text += " else " + block(between(1, 4), depth - 1);
+                return text + " end";
+            }
+            if (chance() < 0.5) { // 计数3次的循环
+                auto c = "c" + std::to_string(counter++);
+                scopes.back()[c] = "int";
+                auto body = block(between(1, 3), depth - 1);
+                if (chance() < 0.5) return "int " + c + " := 0;\nrepeat " + c + " := " + c + " + 1; " + body +
+                                           " until " + c + " >= 3";
+                return "int " + c + " := 0;\ndo " + c + " := " + c + " + 1; " + body + " while " + c + " < 3";
+            }
+            if (chance() < 0.5) return "repeat " + block(between(1, 3), depth - 1) + " until " + pick(repeatExits);
+            return "do " + block(between(1, 3), depth - 1) + " while " + pick(whileExits);
+        }
+
+        std::string sequence(int statements, int depth) {
+            std::string text;
+            for (int i = 0; i < statements; i++) text += (i > 0 ? ";\n" : "") + statement(depth);
+            return text;
+        }
+    };
+}
+
+#endif //COMPILER_PROGRAMGENERATOR_H
@@ -0,0 +1,67 @@
+//
+// Created by junior on 19-6-13.
+//
+/**
+ * 直接调用 SimdScan 的跳过函数: 每个向量实现(sse2, CPU 支持时还有 avx2)和标量实现在同样的缓冲区上
+ * 必须停在同一个位置, 数出同样多的换行符, 给出同一个最后的换行符.
+ * 缓冲区由停止字符, 空白和普通字符随机拼成, 从各种对齐的位置开始, 在向量宽度前后的各种长度结束,
+ * 停止的位置落在向量内的每个字节和剩下不足一个向量的部分.
+ */
+
+#include "TestUtil.h"
+#include "SimdScan.h"
+#include <random>
+
+using namespace Compiler;
+using namespace Compiler::Scanner::Simd;
+
+namespace {
+    std::string describe(const SkipResult &result, const char_t *begin) {
+        return "stop " + std::to_string(result.stop - begin) + ", " + std::to_string(result.newlines) +
+               " newlines, last newline " +
+               (result.lastNewline == nullptr ? std::string("none") : std::to_string(result.lastNewline - begin));
+    }
+}
+
+int main() {
+    Test::Checker checker;
+    auto kernels = availableKernels();
+    std::cout << "kernels:";
+    for (auto &kernel:kernels) std::cout << " " << kernel.name;
+    std::cout << "\n";
+
+    // 停止字符多的缓冲区停得早, 空白多的缓冲区跨过好几个向量
+    static const char *alphabets[] = {" \t\r\n}'a\xc3", "      \n\n}", "\n\n\n\n '", "  \t\t\r\n\n\n\n\n\n}"};
+    static const char *kinds[] = {"comment", "string", "blank"};
+    std::mt19937 random(2019);
+    for (unsigned seed = 0; seed < 400; seed++) {
+        std::string alphabet = alphabets[seed % std::size(alphabets)];
+        std::string buffer(std::uniform_int_distribution<size_t>(0, 200)(random), ' ');
+        for (auto &c:buffer) c = alphabet[std::uniform_int_distribution<size_t>(0, alphabet.size() - 1)(random)];
+
+        for (size_t k = 1; k < kernels.size(); k++) {
+            for (int kind = 0; kind < 3; kind++) {
+                auto pick = [kind](const SkipKernels &kernel) {
+                    return kind == 0 ? kernel.comment : kind == 1 ? kernel.string : kernel.blank;
+                };
+                std::string mismatch;
+                for (size_t begin = 0; begin <= std::min<size_t>(buffer.size(), 33) && mismatch.empty(); begin++) {
+                    for (size_t end = begin; end <= buffer.size() && mismatch.empty();
+                         end += end - begin < 70 ? 1 : 13) {
+                        auto first = buffer.data() + begin, last = buffer.data() + end;
+                        auto expected = pick(kernels[0])(first, last), actual = pick(kernels[k])(first, last);
+                        if (actual.stop != expected.stop || actual.newlines != expected.newlines ||
+                            actual.lastNewline != expected.lastNewline) {
+                            mismatch = "[" + std::to_string(begin) + ", " + std::to_string(end) + ")\nscalar: " +
+                                       describe(expected, first) + "\n" + kernels[k].name + ": " +
+                                       describe(actual, first);
+                        }
+                    }
+                }
+                checker.expect(mismatch.empty(), std::string(kernels[k].name) + " " + kinds[kind] + " buffer " +
+                                                 std::to_string(seed), mismatch);
+            }
+        }
+    }
+    return checker.finish();
+}
@@ -0,0 +1,107 @@
+//
+// Created by junior on 19-6-13.
+//
+/**
+ * 测试和性能测试共用的工具.
+ * compileSource() 把一段源码写到临时文件, 用一个独立的 CompilerContext 编译,
+ * 返回是否成功, --dump-* / --opt-stats 的输出和诊断信息, 不写标准输出, 也不留下 .code 文件.
+ */
+
+#ifndef COMPILER_TESTUTIL_H
+#define COMPILER_TESTUTIL_H
+
+#include "CompilerContext.h"
+#include <sstream>
+#include <iostream>
+
+namespace Compiler::Test {
+    struct Result {
+        bool success = false;
+        std::string output;      // --dump-* 和 --opt-stats 的输出
+        std::string diagnostics; // 词法/语法/语义错误
+    };
+
+    inline void writeFile(const std::string &path, const std::string &text) {
+        FILE *file = fopen(path.c_str(), "wb");
+        if (file == nullptr || fwrite(text.data(), 1, text.size(), file) != text.size()) {
+            fprintf(stderr, "cannot write %s\n", path.c_str());
+            exit(2);
+        }
+        fclose(file);
+    }
+
+    inline Result compileFile(const std::string &path, const Options &options) {
+        FileUtil::SourceFile source;
+        if (!FileUtil::openFile(path.c_str(), source)) {
+            fprintf(stderr, "cannot open %s\n", path.c_str());
+            exit(2);
+        }
+        Result result;
+        {
+            CompilerContext context(options);
+            context.writer.captureTo(&result.output);
+            result.success = context.compile(source);
+            context.writer.flush();
+            std::ostringstream diagnostics;
+            diagnostics << context.diagnostics;
+            result.diagnostics = diagnostics.str();
+        }
+        FileUtil::closeFile(source);
+        remove((path + ".code").c_str());
+        return result;
+    }
+
+    inline Result compileSource(const std::string &text, const Options &options,
+                                const std::string &path = "test_source.tny") {
+        writeFile(path, text);
+        auto result = compileFile(path, options);
+        remove(path.c_str());
+        return result;
+    }
+
+    /**
+     * 记录失败的检查, 失败时输出用例的名字和不一致的内容, 最后由 finish() 给出进程的退出码.
+     */
+    class Checker {
+    public:
+        bool expect(bool condition, const std::string &name, const std::string &detail = "") {
+            checks++;
+            if (!condition) {
+                failures++;
+                std::cerr << "FAIL " << name << "\n" << detail << (detail.empty() ? "" : "\n");
+            }
+            return condition;
+        }
+
+        // 两次编译的结果(成功与否, 输出, 诊断信息)必须完全相同
+        bool same(const Result &expected, const Result &actual, const std::string &name) {
+            if (expected.success == actual.success && expected.output == actual.output &&
+                expected.diagnostics == actual.diagnostics) {
+                return expect(true, name);
+            }
+            return expect(false, name, "expected (" + std::string(expected.success ? "success" : "failure") + "):\n" +
+                                       excerpt(expected, actual) + "\nactual (" +
+                                       (actual.success ? "success" : "failure") + "):\n" + excerpt(actual, expected));
+        }
+
+        int finish() const {
+            std::cout << checks - failures << "/" << checks << " checks passed\n";
+            return failures == 0 ? 0 : 1;
+        }
+
+    private:
+        int checks = 0, failures = 0;
+
+        // 从第一个不同的字节开始的一小段, 输出可能有几MB
+        static std::string excerpt(const Result &result, const Result &other) {
+            auto &text = result.output != other.output ? result.output : result.diagnostics;
+            auto &otherText = result.output != other.output ? other.output : other.diagnostics;
+            size_t first = 0;
+            while (first < text.size() && first < otherText.size() && text[first] == otherText[first]) first++;
+            size_t begin = first > 200 ? first - 200 : 0;
+            return "..." + text.substr(begin, 400) + "...";
+        }
+    };
+}
+
+#endif //COMPILER_TESTUTIL_H